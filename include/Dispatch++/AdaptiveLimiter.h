@@ -0,0 +1,269 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/LimitedQueue.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define DISPATCH_ADAPTIVE_LIMITER_BUCKETS 40
+#define DISPATCH_ADAPTIVE_LIMITER_BACKOFF 0.9
+#define DISPATCH_ADAPTIVE_LIMITER_SMOOTHING 0.2
+
+class _DispatchAdaptiveLimiterState: public std::enable_shared_from_this<_DispatchAdaptiveLimiterState> {
+
+public:
+
+    enum struct Algorithm {
+        /// Adds one to the limit after each window within the target, and cuts it by a tenth after each one over it.
+        AIMD,
+        /// Scales the limit by the ratio of the target to the latency, with room to probe upwards.
+        GRADIENT
+    };
+
+    inline _DispatchAdaptiveLimiterState(
+            const DispatchQueue& target,
+            int64_t targetLatency,
+            Algorithm algorithm,
+            size_t initialLimit,
+            size_t minLimit,
+            size_t maxLimit)
+        : _algorithm(algorithm), _targetLatency(targetLatency), _minLimit(std::max<size_t>(minLimit, 1)),
+          _maxLimit(std::max(maxLimit, std::max<size_t>(minLimit, 1))),
+          _limit(double(std::clamp(initialLimit, _minLimit, _maxLimit))) {
+        _queue = std::make_shared<_DispatchLimitedQueueState>(target, size_t(_limit));
+    }
+
+    std::shared_ptr<_DispatchLimitedQueueState> _queue;
+    Algorithm _algorithm;
+    int64_t _targetLatency;
+    size_t _minLimit;
+    size_t _maxLimit;
+    // Bucket i counts the latencies below 2^(i+1) microseconds, and not below 2^i but for bucket 0.
+    std::atomic<uint64_t> _histogram[DISPATCH_ADAPTIVE_LIMITER_BUCKETS] {};
+    std::atomic<int64_t> _windowMean {0};
+    std::atomic<uint64_t> _increases {0};
+    std::atomic<uint64_t> _decreases {0};
+
+    inline static int64_t _now() {
+        timespec now {};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    inline void _async(DispatchBlock work) {
+        auto weakSelf = std::weak_ptr<_DispatchAdaptiveLimiterState>(shared_from_this());
+        _queue->_async(^{
+            auto start = _now();
+            work();
+            if (auto state = weakSelf.lock()) {
+                state->_record(_now() - start);
+            }
+        });
+    }
+
+private:
+
+    std::mutex _mutex;
+    // The fractional limit the algorithm works on; the queue gets it rounded.
+    double _limit;
+    // The current window: it closes after as many samples as the limit.
+    uint64_t _samples {0};
+    int64_t _total {0};
+    size_t _peakRunning {0};
+
+    // Runs on the target queue, after each work item.
+    inline void _record(int64_t latency) {
+        auto micros = uint64_t(std::max<int64_t>(latency, 0) / 1000);
+        auto bucket = micros < 2 ? 0 : size_t(63 - __builtin_clzll(micros));
+        _histogram[std::min<size_t>(bucket, DISPATCH_ADAPTIVE_LIMITER_BUCKETS - 1)]++;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _samples++;
+        _total += latency;
+        // Still counts the work item just run.
+        _peakRunning = std::max(_peakRunning, _queue->_running.load());
+        if (double(_samples) < _limit) {
+            return;
+        }
+        auto mean = _total / int64_t(_samples);
+        _windowMean = mean;
+        _adjust(mean);
+        _samples = 0;
+        _total = 0;
+        _peakRunning = 0;
+    }
+
+    inline void _adjust(int64_t mean) {
+        auto limit = _limit;
+        // A limit the work never reaches says nothing about the room left: it only goes down.
+        auto saturated = double(_peakRunning) >= limit / 2;
+        switch (_algorithm) {
+            case Algorithm::AIMD:
+                if (mean > _targetLatency) {
+                    limit *= DISPATCH_ADAPTIVE_LIMITER_BACKOFF;
+                } else if (saturated) {
+                    limit += 1;
+                }
+                break;
+            case Algorithm::GRADIENT: {
+                auto gradient = std::clamp(double(_targetLatency) / double(std::max<int64_t>(mean, 1)), 0.5, 1.0);
+                auto probed = limit * gradient + (saturated ? std::sqrt(limit) : 0);
+                limit = limit * (1 - DISPATCH_ADAPTIVE_LIMITER_SMOOTHING) + probed * DISPATCH_ADAPTIVE_LIMITER_SMOOTHING;
+                break;
+            }
+        }
+        limit = std::clamp(limit, double(_minLimit), double(_maxLimit));
+        if (size_t(limit) > size_t(_limit)) {
+            _increases++;
+        } else if (size_t(limit) < size_t(_limit)) {
+            _decreases++;
+        }
+        _limit = limit;
+        _queue->_setMaxConcurrent(size_t(limit));
+    }
+
+};
+
+///
+/// A queue whose concurrency limit follows the latency of its work.
+///
+/// The right limit for work on a downstream service changes with its load: a fixed one
+/// either queues work the service could take, or overloads it. This queue runs work as
+/// `DispatchLimitedQueue` does, times each work item, and adjusts the limit after each
+/// window of as many items as the limit, to keep the mean latency near a target:
+///
+/// - `AIMD` adds one while the latency stays within the target, and cuts by a tenth
+///   as soon as it does not;
+/// - `GRADIENT` scales the limit by `target / latency`, smoothed, plus the square root
+///   of the limit to probe for more room.
+///
+/// The limit grows only while the work fills at least half of it. The latencies are
+/// counted in a histogram with power of two buckets.
+///
+class DispatchAdaptiveLimiter {
+
+public:
+
+    typedef _DispatchAdaptiveLimiterState::Algorithm Algorithm;
+
+    ///
+    /// - parameter target: The queue the work runs on; it should be concurrent.
+    /// - parameter targetLatency: The mean latency of a work item to keep to.
+    /// - parameter algorithm: How the limit follows the latency.
+    /// - parameter initialLimit: The limit to start with.
+    /// - parameter minLimit: The lowest the limit goes.
+    /// - parameter maxLimit: The highest the limit goes.
+    ///
+    inline DispatchAdaptiveLimiter(
+            const DispatchQueue& target,
+            const DispatchTimeInterval& targetLatency,
+            Algorithm algorithm = Algorithm::AIMD,
+            size_t initialLimit = 4,
+            size_t minLimit = 1,
+            size_t maxLimit = 1000)
+    {
+        _state = std::make_shared<_DispatchAdaptiveLimiterState>(
+                target, std::max<int64_t>(targetLatency.rawValue, 1), algorithm, initialLimit, minLimit, maxLimit);
+    }
+
+    DispatchAdaptiveLimiter(const DispatchAdaptiveLimiter&) = delete;
+    DispatchAdaptiveLimiter& operator= (const DispatchAdaptiveLimiter&) = delete;
+
+    /// Submits the work, to run once a slot is free. Never blocks.
+    inline void async(DispatchBlock work) {
+        _state->_async(work);
+    }
+
+    /// The current concurrency limit.
+    [[nodiscard]] inline size_t limit() const {
+        return _state->_queue->_maxConcurrent.load();
+    }
+
+    /// The number of work items waiting for a slot.
+    [[nodiscard]] inline size_t pending() const {
+        return _state->_queue->_pending.load();
+    }
+
+    /// The number of work items running.
+    [[nodiscard]] inline size_t running() const {
+        return _state->_queue->_running.load();
+    }
+
+    /// The number of work items completed so far.
+    [[nodiscard]] inline uint64_t completed() const {
+        return _state->_queue->_completed.load();
+    }
+
+    /// The mean latency over the last window.
+    [[nodiscard]] inline DispatchTimeInterval meanLatency() const {
+        return DispatchTimeInterval::nanoseconds(_state->_windowMean.load());
+    }
+
+    /// The number of times the limit went up, and down.
+    [[nodiscard]] inline uint64_t increases() const {
+        return _state->_increases.load();
+    }
+
+    [[nodiscard]] inline uint64_t decreases() const {
+        return _state->_decreases.load();
+    }
+
+    ///
+    /// - returns: The count of latencies in each bucket: bucket `i` holds those below
+    ///   2^(i+1) microseconds, and from 2^i on but for bucket 0. The last one holds all above.
+    ///
+    [[nodiscard]] inline std::vector<uint64_t> latencyHistogram() const {
+        std::vector<uint64_t> histogram;
+        for (auto& bucket : _state->_histogram) {
+            histogram.push_back(bucket.load());
+        }
+        return histogram;
+    }
+
+    ///
+    /// - parameter percentile: Between 0 and 1.
+    /// - returns: An upper bound of the latency below which the percentile of the work items fall,
+    ///   or `never()` when it falls in the last bucket, which has none.
+    ///
+    [[nodiscard]] inline DispatchTimeInterval latencyPercentile(double percentile) const {
+        auto histogram = latencyHistogram();
+        uint64_t total = 0;
+        for (auto count : histogram) {
+            total += count;
+        }
+        auto rank = uint64_t(std::ceil(std::clamp(percentile, 0.0, 1.0) * double(total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < histogram.size(); i++) {
+            seen += histogram[i];
+            if (seen >= rank && seen > 0) {
+                if (i == histogram.size() - 1) {
+                    return DispatchTimeInterval::never();
+                }
+                return DispatchTimeInterval::microseconds(int64_t(1) << (i + 1));
+            }
+        }
+        return DispatchTimeInterval::nanoseconds(0);
+    }
+
+private:
+
+    std::shared_ptr<_DispatchAdaptiveLimiterState> _state;
+
+};
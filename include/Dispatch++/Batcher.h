@@ -0,0 +1,273 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+template<typename T>
+class _DispatchBatcherState: public std::enable_shared_from_this<_DispatchBatcherState<T>> {
+
+public:
+
+    typedef void (^Handler)(std::vector<T>& batch);
+
+    struct _Node {
+        T value;
+        _Node *next;
+    };
+
+    // A lock-free stack per CPU: pushes on different CPUs never touch the same cache line.
+    struct alignas(64) _Shard {
+        std::atomic<_Node *> head {nullptr};
+    };
+
+    inline _DispatchBatcherState(const DispatchQueue& queue, Handler handler, size_t batchSize, const DispatchTimeInterval& maxDelay)
+        : _targetQueue(queue), _handler(handler), _batchSize(std::max<size_t>(batchSize, 1)), _maxDelay(maxDelay),
+          _shards(std::max<unsigned>(std::thread::hardware_concurrency(), 1)) {}
+
+    inline ~_DispatchBatcherState() {
+        for (auto& shard : _shards) {
+            auto node = shard.head.exchange(nullptr);
+            while (node != nullptr) {
+                auto next = node->next;
+                delete node;
+                node = next;
+            }
+        }
+    }
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.Batcher"};
+    DispatchQueue _targetQueue;
+    _DispatchRetainedBlock<Handler> _handler;
+    size_t _batchSize;
+    DispatchTimeInterval _maxDelay;
+    std::vector<_Shard> _shards;
+    // Can dip below zero for a moment, when a drain takes an item before its push counts it.
+    std::atomic<int64_t> _size {0};
+    std::shared_ptr<DispatchSourceUserDataAdd> _wakeup;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    bool _armed {false};
+    std::atomic<uint64_t> _batches {0};
+    std::atomic<uint64_t> _items {0};
+
+    inline void _start() {
+        auto weakSelf = std::weak_ptr<_DispatchBatcherState<T>>(this->shared_from_this());
+        _timer = DispatchSource::makeTimerSource(&_queue);
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_drain();
+            }
+        });
+        _timer->schedule(DispatchTime::distantFuture());
+        _timer->resume();
+
+        _wakeup = DispatchSource::makeUserDataAddSource(&_queue);
+        _wakeup->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_woken();
+            }
+        });
+        _wakeup->resume();
+    }
+
+    inline void _stop() {
+        _drain();
+        _timer->cancel();
+        _wakeup->cancel();
+    }
+
+    // Lock-free, from any thread. Only the first item of a batch and the one that fills it
+    // wake the queue, and the source merges those wakeups.
+    inline void _push(T&& value) {
+        auto node = new _Node {std::move(value), nullptr};
+        auto& shard = _shards[_shardIndex()];
+        node->next = shard.head.load(std::memory_order_relaxed);
+        while (!shard.head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+
+        auto previous = _size.fetch_add(1, std::memory_order_acq_rel);
+        if (previous == 0 || previous + 1 == int64_t(_batchSize)) {
+            _wakeup->dataAdd(1);
+        }
+    }
+
+    // Runs on the queue.
+    inline void _drain() {
+        // A full batch pushed while draining goes at once: its pushes saw the count go past
+        // the batch size without reaching it, and woke no one.
+        int64_t remaining;
+        do {
+            remaining = _handOver();
+        } while (remaining >= int64_t(_batchSize));
+
+        // What was pushed while draining waits for the deadline, or fills a batch.
+        _armed = false;
+        _arm(remaining);
+    }
+
+private:
+
+    // Hands all pending items over, and returns how many were pushed meanwhile.
+    inline int64_t _handOver() {
+        std::vector<T> items;
+        for (auto& shard : _shards) {
+            auto node = shard.head.exchange(nullptr, std::memory_order_acquire);
+            // The stack holds the newest first; the items of each CPU are handed in push order.
+            auto first = items.size();
+            while (node != nullptr) {
+                auto next = node->next;
+                items.push_back(std::move(node->value));
+                delete node;
+                node = next;
+            }
+            std::reverse(items.begin() + std::ptrdiff_t(first), items.end());
+        }
+        auto remaining = _size.fetch_sub(int64_t(items.size()), std::memory_order_acq_rel) - int64_t(items.size());
+
+        for (size_t begin = 0; begin < items.size(); begin += _batchSize) {
+            auto end = std::min(items.size(), begin + _batchSize);
+            auto batch = std::make_shared<std::vector<T>>(
+                    std::make_move_iterator(items.begin() + std::ptrdiff_t(begin)),
+                    std::make_move_iterator(items.begin() + std::ptrdiff_t(end)));
+            _batches++;
+            _items += batch->size();
+            auto handler = _handler;
+            _targetQueue.async(^{
+                handler.get()(*batch);
+            });
+        }
+        return remaining;
+    }
+
+    inline size_t _shardIndex() const {
+#if defined(__linux__)
+        auto cpu = sched_getcpu();
+        if (cpu >= 0) {
+            return size_t(cpu) % _shards.size();
+        }
+#endif
+        return std::hash<std::thread::id>()(std::this_thread::get_id()) % _shards.size();
+    }
+
+    inline void _woken() {
+        auto size = _size.load(std::memory_order_acquire);
+        if (size >= int64_t(_batchSize)) {
+            _drain();
+        } else {
+            _arm(size);
+        }
+    }
+
+    // The deadline counts from the first item of the batch.
+    inline void _arm(int64_t size) {
+        if (size <= 0) {
+            _timer->schedule(DispatchTime::distantFuture());
+        } else if (!_armed) {
+            _armed = true;
+            _timer->schedule(DispatchTime::now() + _maxDelay);
+        }
+    }
+
+};
+
+///
+/// Collects items pushed from any thread, and hands them to a handler in batches.
+///
+/// Pushing is lock-free: each item goes onto a stack of the CPU the thread runs on. A
+/// batch is handed to the handler queue once `batchSize` items are pending, or once the
+/// first of them has waited `maxDelay`. The pushes that start and fill a batch wake the
+/// batcher through a `DATA_ADD` source, so concurrent pushes coalesce into one wakeup
+/// and one handler invocation per batch, instead of one `async` per item.
+///
+/// Items pushed on the same CPU are handed over in order; items from different CPUs
+/// may be reordered. Destroying the batcher hands over the pending items.
+///
+template<typename T>
+class DispatchBatcher {
+
+public:
+
+    typedef typename _DispatchBatcherState<T>::Handler Handler;
+
+    ///
+    /// - parameter queue: The queue the handler is invoked on.
+    /// - parameter batchSize: The most items handed over at once, and the count that hands them over.
+    /// - parameter maxDelay: The longest an item waits for its batch.
+    /// - parameter handler: Invoked with each batch, which it may move the items out of.
+    ///
+    inline DispatchBatcher(
+            const DispatchQueue& queue,
+            size_t batchSize,
+            const DispatchTimeInterval& maxDelay,
+            Handler handler)
+    {
+        _state = std::make_shared<_DispatchBatcherState<T>>(queue, handler, batchSize, maxDelay);
+        _state->_start();
+    }
+
+    DispatchBatcher(const DispatchBatcher&) = delete;
+    DispatchBatcher& operator= (const DispatchBatcher&) = delete;
+
+    inline ~DispatchBatcher() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    inline void push(const T& value) {
+        _state->_push(T(value));
+    }
+
+    inline void push(T&& value) {
+        _state->_push(std::move(value));
+    }
+
+    /// Hands the pending items over now.
+    inline void flush() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_drain();
+        });
+    }
+
+    /// The number of items pushed but not handed over yet.
+    [[nodiscard]] inline size_t pending() const {
+        return size_t(std::max<int64_t>(_state->_size.load(), 0));
+    }
+
+    /// The number of batches handed over so far.
+    [[nodiscard]] inline uint64_t batches() const {
+        return _state->_batches.load();
+    }
+
+    /// The number of items handed over so far.
+    [[nodiscard]] inline uint64_t items() const {
+        return _state->_items.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchBatcherState<T>> _state;
+
+};
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <Block.h>
 #include <dispatch/dispatch.h>
 #include "Dispatch++/QoS.h"
 #include "Dispatch++/Time.h"
@@ -99,3 +100,46 @@ private:
     friend class DispatchQueue;
 
 };
+
+/// Holds a heap copy of a block, so it can be stored past the scope of the
+/// block literal. Copies retain the same block.
+template <typename BlockType>
+class _DispatchRetainedBlock {
+
+public:
+
+    _DispatchRetainedBlock() = default;
+
+    inline explicit _DispatchRetainedBlock(BlockType block): _block(block ? Block_copy(block) : nullptr) {}
+
+    inline _DispatchRetainedBlock(const _DispatchRetainedBlock& other): _block(other._block ? Block_copy(other._block) : nullptr) {}
+    inline _DispatchRetainedBlock& operator= (const _DispatchRetainedBlock& other) {
+        if (this != &other) {
+            auto block = other._block ? Block_copy(other._block) : nullptr;
+            if (_block) {
+                Block_release(_block);
+            }
+            _block = block;
+        }
+        return *this;
+    }
+
+    inline ~_DispatchRetainedBlock() {
+        if (_block) {
+            Block_release(_block);
+        }
+    }
+
+    [[nodiscard]] inline BlockType get() const {
+        return _block;
+    }
+
+    inline explicit operator bool() const {
+        return _block != nullptr;
+    }
+
+private:
+
+    BlockType _block {nullptr};
+
+};
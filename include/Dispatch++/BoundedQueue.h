@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Semaphore.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+class _DispatchBoundedQueueState: public std::enable_shared_from_this<_DispatchBoundedQueueState> {
+
+public:
+
+    inline _DispatchBoundedQueueState(const DispatchQueue& queue, size_t capacity)
+        : _queue(queue), _capacity(std::max<size_t>(capacity, 1)) {
+        // Created empty and filled, as a semaphore released below its initial value is a client bug.
+        for (size_t i = 0; i < _capacity; i++) {
+            _slots.signal();
+        }
+    }
+
+    DispatchQueue _queue;
+    size_t _capacity;
+    DispatchSemaphore _slots {0};
+    std::mutex _mutex;
+    // The callbacks of the submitters turned away, each run once a slot frees up.
+    std::deque<std::pair<DispatchQueue, _DispatchRetainedBlock<DispatchBlock>>> _waiters;
+    std::atomic<size_t> _pending {0};
+    std::atomic<size_t> _running {0};
+    std::atomic<size_t> _maxDepth {0};
+    std::atomic<uint64_t> _admitted {0};
+    std::atomic<uint64_t> _rejected {0};
+
+    inline bool _tryAcquire() {
+        return _slots.wait(DispatchTime::now()) == DispatchTimeoutResult::SUCCESS;
+    }
+
+    // Holds a slot: the work keeps it until it has run.
+    inline void _submit(DispatchBlock work) {
+        _admitted++;
+        auto depth = ++_pending + _running.load();
+        auto maxDepth = _maxDepth.load();
+        while (depth > maxDepth && !_maxDepth.compare_exchange_weak(maxDepth, depth)) {}
+
+        auto state = shared_from_this();
+        _queue.async(^{
+            state->_running++;
+            state->_pending--;
+            work();
+            state->_running--;
+            state->_release();
+        });
+    }
+
+    inline bool _submitOrNotify(DispatchBlock work, const DispatchQueue& queue, DispatchBlock notify) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_tryAcquire()) {
+            _submit(work);
+            return true;
+        }
+        _rejected++;
+        _waiters.emplace_back(queue, _DispatchRetainedBlock<DispatchBlock>(notify));
+        return false;
+    }
+
+private:
+
+    // The slot is returned before the waiters are looked at, so one that registers meanwhile finds it.
+    // All of them are woken: one woken alone could lose the slot, or not want it, and leave
+    // the others waiting on a queue that has gone idle.
+    inline void _release() {
+        _slots.signal();
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_waiters.empty()) {
+            return;
+        }
+        auto waiters = std::move(_waiters);
+        _waiters.clear();
+        lock.unlock();
+
+        for (auto& waiter : waiters) {
+            auto notify = waiter.second;
+            waiter.first.async(^{
+                notify.get()();
+            });
+        }
+    }
+
+};
+
+///
+/// A queue that admits a bounded number of work items.
+///
+/// `DispatchQueue::async` never pushes back: a producer faster than its consumer grows
+/// the queue until memory runs out. This wrapper holds a slot for each work item from
+/// its submission until it has run, and admits no more than `capacity` at once. A
+/// submitter that finds no free slot chooses how to wait for one:
+///
+/// - `tryAsync` fails at once, for the submitter to shed the load;
+/// - `asyncOrWait` blocks the calling thread on a semaphore, up to a timeout;
+/// - `asyncOrNotify` fails at once, and runs a callback once a slot frees up, for the
+///   submitter to try again without blocking a thread.
+///
+/// The work runs on the target queue, serial or concurrent, as with `async`.
+///
+class DispatchBoundedQueue {
+
+public:
+
+    ///
+    /// - parameter queue: The queue the work runs on.
+    /// - parameter capacity: The most work items submitted and not yet run.
+    ///
+    inline DispatchBoundedQueue(const DispatchQueue& queue, size_t capacity) {
+        _state = std::make_shared<_DispatchBoundedQueueState>(queue, capacity);
+    }
+
+    DispatchBoundedQueue(const DispatchBoundedQueue&) = delete;
+    DispatchBoundedQueue& operator= (const DispatchBoundedQueue&) = delete;
+
+    ///
+    /// Submits the work if a slot is free.
+    ///
+    /// - returns: Whether the work was submitted.
+    ///
+    inline bool tryAsync(DispatchBlock work) {
+        if (!_state->_tryAcquire()) {
+            _state->_rejected++;
+            return false;
+        }
+        _state->_submit(work);
+        return true;
+    }
+
+    /// Submits the work, blocking until a slot is free.
+    inline void asyncOrWait(DispatchBlock work) {
+        _state->_slots.wait();
+        _state->_submit(work);
+    }
+
+    ///
+    /// Submits the work, blocking until a slot is free or the timeout passes.
+    ///
+    /// - returns: Whether the work was submitted.
+    ///
+    inline bool asyncOrWait(DispatchBlock work, DispatchTime timeout) {
+        if (_state->_slots.wait(timeout) != DispatchTimeoutResult::SUCCESS) {
+            _state->_rejected++;
+            return false;
+        }
+        _state->_submit(work);
+        return true;
+    }
+
+    ///
+    /// Submits the work if a slot is free, or else runs `notify` on `queue` once one frees up.
+    ///
+    /// The notification does not hold the slot: every waiting submitter is notified when
+    /// one frees up, and must try again, possibly losing the slot to another submitter.
+    ///
+    /// - returns: Whether the work was submitted.
+    ///
+    inline bool asyncOrNotify(DispatchBlock work, const DispatchQueue& queue, DispatchBlock notify) {
+        return _state->_submitOrNotify(work, queue, notify);
+    }
+
+    [[nodiscard]] inline size_t capacity() const {
+        return _state->_capacity;
+    }
+
+    /// The number of work items submitted and waiting to run.
+    [[nodiscard]] inline size_t pending() const {
+        return _state->_pending.load();
+    }
+
+    /// The number of work items running.
+    [[nodiscard]] inline size_t running() const {
+        return _state->_running.load();
+    }
+
+    /// The most work items pending and running at once so far.
+    [[nodiscard]] inline size_t maxDepth() const {
+        return _state->_maxDepth.load();
+    }
+
+    /// The number of work items submitted so far.
+    [[nodiscard]] inline uint64_t admitted() const {
+        return _state->_admitted.load();
+    }
+
+    /// The number of submissions turned away so far.
+    [[nodiscard]] inline uint64_t rejected() const {
+        return _state->_rejected.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchBoundedQueueState> _state;
+
+};
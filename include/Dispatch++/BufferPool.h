@@ -0,0 +1,97 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Data.h"
+#include "Dispatch++/Queue.h"
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+///
+/// A pool of fixed-size buffers, recycled instead of going back to the allocator.
+///
+/// `wrap` turns a buffer into a `DispatchData` that returns it to the pool once the
+/// last reference to the data is gone. Buffers beyond `capacity` are freed on release.
+///
+class DispatchBufferPool: public std::enable_shared_from_this<DispatchBufferPool> {
+
+public:
+
+    inline static std::shared_ptr<DispatchBufferPool> make(size_t bufferSize, size_t capacity) {
+        return std::shared_ptr<DispatchBufferPool>(new DispatchBufferPool(bufferSize, capacity));
+    }
+
+    DispatchBufferPool(const DispatchBufferPool&) = delete;
+    DispatchBufferPool& operator= (const DispatchBufferPool&) = delete;
+
+    inline ~DispatchBufferPool() {
+        for (auto buffer : _free) {
+            free(buffer);
+        }
+    }
+
+    [[nodiscard]] inline size_t bufferSize() const {
+        return _bufferSize;
+    }
+
+    /// Takes a buffer of `bufferSize()` bytes from the pool, allocating one when it is empty.
+    inline void *acquire() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_free.empty()) {
+                auto buffer = _free.back();
+                _free.pop_back();
+                return buffer;
+            }
+        }
+        _allocations++;
+        return malloc(_bufferSize);
+    }
+
+    inline void release(void *buffer) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_free.size() < _capacity) {
+                _free.push_back(buffer);
+                return;
+            }
+        }
+        free(buffer);
+    }
+
+    /// Wraps the first `count` bytes of an acquired buffer, without copying them.
+    inline DispatchData wrap(void *buffer, size_t count) {
+        auto pool = shared_from_this();
+        return DispatchData(buffer, int(count), _releaseQueue, ^{
+            pool->release(buffer);
+        });
+    }
+
+    /// The number of buffers the pool had to allocate so far.
+    [[nodiscard]] inline uint64_t allocations() const {
+        return _allocations.load();
+    }
+
+private:
+
+    inline DispatchBufferPool(size_t bufferSize, size_t capacity): _bufferSize(bufferSize), _capacity(capacity) {
+        _free.reserve(capacity);
+    }
+
+    size_t _bufferSize;
+    size_t _capacity;
+    std::mutex _mutex;
+    std::vector<void *> _free;
+    std::atomic<uint64_t> _allocations {0};
+    DispatchQueue _releaseQueue {DispatchQueue::global(DispatchQoS::QoSClass::UTILITY)};
+
+};
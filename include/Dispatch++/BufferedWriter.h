@@ -0,0 +1,291 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <utility>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+#define DISPATCH_BUFFERED_WRITER_DEFAULT_THRESHOLD (64 * 1024)
+
+#if defined(IOV_MAX)
+#define DISPATCH_BUFFERED_WRITER_MAX_IOV IOV_MAX
+#else
+#define DISPATCH_BUFFERED_WRITER_MAX_IOV 1024
+#endif
+
+class _DispatchBufferedWriterState: public std::enable_shared_from_this<_DispatchBufferedWriterState> {
+
+public:
+
+    inline _DispatchBufferedWriterState(int fileDescriptor, size_t threshold, const DispatchTimeInterval& maxDelay)
+        : _fd(fileDescriptor), _threshold(threshold), _maxDelay(maxDelay) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.BufferedWriter"};
+    std::shared_ptr<DispatchSourceWrite> _writeSource;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    _DispatchRetainedBlock<void (^)(int error)> _errorHandler;
+    std::atomic<uint64_t> _syscalls {0};
+    std::atomic<uint64_t> _bytesWritten {0};
+
+    inline void _start() {
+        auto flags = fcntl(_fd, F_GETFL);
+        if (flags != -1 && (flags & O_NONBLOCK) == 0) {
+            fcntl(_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+
+        auto weakSelf = std::weak_ptr<_DispatchBufferedWriterState>(shared_from_this());
+        _writeSource = DispatchSource::makeWriteSource(_fd, &_queue);
+        _writeSource->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_flush();
+            }
+        });
+        // Resumed only while the descriptor is full.
+
+        _timer = DispatchSource::makeTimerSource(&_queue);
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_flush();
+            }
+        });
+        _timer->schedule(DispatchTime::distantFuture());
+        _timer->resume();
+    }
+
+    inline void _stop() {
+        _flush();
+        _timer->cancel();
+        if (!_waitingForSpace) {
+            // A suspended source can neither be cancelled nor released.
+            _writeSource->resume();
+        }
+        _writeSource->cancel();
+    }
+
+    inline void _write(const DispatchData& fragment) {
+        if (_error != 0 || fragment.count() == 0) {
+            return;
+        }
+        _fragments.push_back(std::make_shared<DispatchData>(fragment));
+        _pending += fragment.count();
+
+        if (_waitingForSpace) {
+            return;
+        }
+        if (_pending >= _threshold) {
+            _flush();
+        } else if (_fragments.size() == 1) {
+            _timer->schedule(DispatchTime::now() + _maxDelay);
+        }
+    }
+
+    // Writes as much as the descriptor takes, one `writev` per `IOV_MAX` regions.
+    inline void _flush() {
+        _timer->schedule(DispatchTime::distantFuture());
+
+        while (!_fragments.empty() && _error == 0) {
+            std::vector<struct iovec> iov;
+            iov.reserve(std::min(_fragments.size(), size_t(DISPATCH_BUFFERED_WRITER_MAX_IOV)));
+            auto *vector = &iov;
+            for (auto& fragment : _fragments) {
+                fragment->enumerateBytes(^(const void *bytes, size_t count, size_t offset, bool *stop) {
+                    vector->push_back({const_cast<void *>(bytes), count});
+                    *stop = vector->size() == DISPATCH_BUFFERED_WRITER_MAX_IOV;
+                });
+                if (iov.size() == DISPATCH_BUFFERED_WRITER_MAX_IOV) {
+                    break;
+                }
+            }
+
+            _syscalls++;
+            auto written = writev(_fd, iov.data(), int(iov.size()));
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                _waitForSpace(true);
+                return;
+            }
+            if (written < 0) {
+                _fail(errno);
+                return;
+            }
+            _bytesWritten += uint64_t(written);
+            _consume(size_t(written));
+        }
+        _waitForSpace(false);
+        _notifyIfDrained();
+    }
+
+    inline void _notify(const DispatchQueue& queue, const _DispatchRetainedBlock<DispatchBlock>& completion) {
+        _completions.push_back({queue, completion});
+        _notifyIfDrained();
+    }
+
+private:
+
+    int _fd;
+    size_t _threshold;
+    DispatchTimeInterval _maxDelay;
+
+    std::deque<std::shared_ptr<DispatchData>> _fragments;
+    size_t _pending {0};
+    bool _waitingForSpace {false};
+    int _error {0};
+    std::vector<std::pair<DispatchQueue, _DispatchRetainedBlock<DispatchBlock>>> _completions;
+
+    // Drops `count` written bytes from the front; a partly written fragment is replaced by
+    // the subrange still to go, which shares its buffers.
+    inline void _consume(size_t count) {
+        _pending -= count;
+        while (count > 0) {
+            auto& front = _fragments.front();
+            auto size = front->count();
+            if (count < size) {
+                front = std::make_shared<DispatchData>(front->subdata(int(count), int(size)));
+                return;
+            }
+            count -= size;
+            _fragments.pop_front();
+        }
+    }
+
+    inline void _waitForSpace(bool waiting) {
+        if (waiting == _waitingForSpace) {
+            return;
+        }
+        _waitingForSpace = waiting;
+        if (waiting) {
+            _writeSource->resume();
+        } else {
+            _writeSource->suspend();
+        }
+    }
+
+    inline void _fail(int error) {
+        _error = error;
+        _fragments.clear();
+        _pending = 0;
+        _waitForSpace(false);
+        if (_errorHandler) {
+            _errorHandler.get()(error);
+        }
+        _notifyIfDrained();
+    }
+
+    inline void _notifyIfDrained() {
+        if (!_fragments.empty()) {
+            return;
+        }
+        for (auto& [queue, completion] : _completions) {
+            auto block = completion;
+            queue.async(^{
+                block.get()();
+            });
+        }
+        _completions.clear();
+    }
+
+};
+
+///
+/// Coalesces small writes to one file descriptor into vectored `writev` calls.
+///
+/// Fragments are queued as they are, without copying, and go out together when
+/// `threshold` bytes are pending, when `maxDelay` has passed since the first of
+/// them was queued, or on `flush()`. When the descriptor is full the writer
+/// waits for a write source event and carries on from where the kernel stopped,
+/// keeping the unwritten part of a fragment as a subrange of it.
+///
+/// The descriptor is made non-blocking, and is not closed. After a write error
+/// the pending fragments are discarded, the error handler is invoked on the
+/// writer's queue, and further writes are ignored.
+///
+class DispatchBufferedWriter {
+
+public:
+
+    inline explicit DispatchBufferedWriter(
+            int fileDescriptor,
+            size_t threshold = DISPATCH_BUFFERED_WRITER_DEFAULT_THRESHOLD,
+            const DispatchTimeInterval& maxDelay = DispatchTimeInterval::milliseconds(1),
+            void (^errorHandler)(int error) = nullptr)
+    {
+        _state = std::make_shared<_DispatchBufferedWriterState>(fileDescriptor, threshold, maxDelay);
+        _state->_errorHandler = _DispatchRetainedBlock<void (^)(int error)>(errorHandler);
+        _state->_start();
+    }
+
+    DispatchBufferedWriter(const DispatchBufferedWriter&) = delete;
+    DispatchBufferedWriter& operator= (const DispatchBufferedWriter&) = delete;
+
+    /// Writes out what the descriptor takes right away, and stops the writer's sources.
+    inline ~DispatchBufferedWriter() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    inline void write(const DispatchData& fragment) {
+        auto state = _state;
+        auto data = fragment;
+        state->_queue.async(^{
+            state->_write(data);
+        });
+    }
+
+    /// Writes the pending fragments now, instead of waiting for a threshold.
+    inline void flush() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_flush();
+        });
+    }
+
+    /// Invokes `completion` on `queue` once everything written before has reached the
+    /// descriptor, or has been discarded after an error.
+    inline void notify(const DispatchQueue& queue, DispatchBlock completion) {
+        auto state = _state;
+        auto target = queue;
+        auto retainedCompletion = _DispatchRetainedBlock<DispatchBlock>(completion);
+        state->_queue.async(^{
+            state->_flush();
+            state->_notify(target, retainedCompletion);
+        });
+    }
+
+    /// The number of `writev` calls made.
+    [[nodiscard]] inline uint64_t syscalls() const {
+        return _state->_syscalls.load();
+    }
+
+    [[nodiscard]] inline uint64_t bytesWritten() const {
+        return _state->_bytesWritten.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchBufferedWriterState> _state;
+
+};
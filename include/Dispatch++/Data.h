@@ -10,6 +10,7 @@
 #include "Dispatch++/Object.h"
 
 class DispatchIO;
+class _DispatchURingChannel;
 
 class DispatchData: DispatchObject {
 
@@ -70,6 +71,22 @@ public:
 
     DispatchData(const void *bytesNoCopy, int count, const DispatchQueue &queue, void (^deallocator)(void));
 
+    /// Create a `Data` backed by one zero-filled buffer whose address is a multiple of `alignment`.
+    ///
+    /// The buffer is padded past `count` to a multiple of `alignment`, so it can be handed to
+    /// `O_DIRECT` reads and writes that must cover whole blocks.
+    ///
+    /// - parameter count: The number of bytes in the data.
+    /// - parameter alignment: The alignment of the buffer address and capacity, a power of two.
+    /// - parameter initializer: Invoked with the buffer and its capacity to fill it, before the data is created.
+    static DispatchData aligned(
+            size_t count,
+            size_t alignment,
+            DISPATCH_NOESCAPE void (^initializer)(void *bytes, size_t capacity) = nullptr);
+
+    /// Whether the data is a single contiguous buffer whose address is a multiple of `alignment`.
+    [[nodiscard]] bool isAligned(size_t alignment) const;
+
     [[nodiscard]] inline size_t count() const {
         return dispatch_data_get_size(_wrapped);
     }
@@ -147,6 +164,18 @@ public:
         return result;
     }
 
+    /// Enumerate the contents of the data one contiguous region at a time, without copying.
+    ///
+    /// - parameter block: Invoked with the bytes of each region, their count and their offset
+    ///     in the data. Setting `stop` to true ends the enumeration.
+    void enumerateBytes(DISPATCH_NOESCAPE void (^block)(const void *bytes, size_t count, size_t offset, bool *stop)) const {
+        dispatch_data_apply(_wrapped, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+            bool stop = false;
+            block(buffer, size, offset, &stop);
+            return !stop;
+        });
+    }
+
 private:
 
     dispatch_data_t _wrapped {nullptr};
@@ -165,4 +194,5 @@ private:
     void _copyBytesHelper(void *toPointer, int startIndex, int endIndex);
 
     friend DispatchIO;
+    friend _DispatchURingChannel;
 };
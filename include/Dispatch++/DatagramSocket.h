@@ -0,0 +1,450 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/BufferPool.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+#define DISPATCH_HAVE_MMSG 1
+#else
+#define DISPATCH_HAVE_MMSG 0
+#endif
+
+#define DISPATCH_DATAGRAM_DEFAULT_BATCH_SIZE 64
+#define DISPATCH_DATAGRAM_DEFAULT_MAX_SIZE 2048
+// Regions of one outgoing datagram passed to the kernel.
+#define DISPATCH_DATAGRAM_MAX_IOV 8
+
+struct DispatchDatagram {
+    std::shared_ptr<DispatchData> data;
+    struct sockaddr_storage address {};
+    socklen_t addressLength {0};
+    /// Whether a received datagram was longer than the buffer, and cut to its size.
+    bool truncated {false};
+};
+
+typedef void (^DispatchDatagramHandler)(const std::vector<DispatchDatagram>& datagrams);
+
+struct _DispatchDatagramSend {
+    std::vector<DispatchDatagram> datagrams;
+    size_t sent {0};
+    DispatchQueue queue;
+    _DispatchRetainedBlock<void (^)(size_t sent, int error)> completion;
+};
+
+class _DispatchDatagramSocketState: public std::enable_shared_from_this<_DispatchDatagramSocketState> {
+
+public:
+
+    inline _DispatchDatagramSocketState(int fileDescriptor, const DispatchQueue& queue, size_t batchSize, size_t maxDatagramSize)
+        : _fd(fileDescriptor),
+          _queue(queue),
+          _batchSize(std::max(batchSize, size_t(1))),
+          _pool(DispatchBufferPool::make(maxDatagramSize, _batchSize * 4)) {}
+
+    int _fd;
+    DispatchQueue _queue;
+    std::shared_ptr<DispatchSourceRead> _readSource;
+    std::shared_ptr<DispatchSourceWrite> _writeSource;
+    _DispatchRetainedBlock<DispatchDatagramHandler> _handler;
+    std::atomic<bool> _resumed {false};
+    std::atomic<uint64_t> _received {0};
+    std::atomic<uint64_t> _truncated {0};
+    std::atomic<uint64_t> _receiveCalls {0};
+    std::atomic<uint64_t> _sendCalls {0};
+
+    inline void _start() {
+        auto flags = fcntl(_fd, F_GETFL);
+        if (flags != -1 && (flags & O_NONBLOCK) == 0) {
+            fcntl(_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+
+        auto weakSelf = std::weak_ptr<_DispatchDatagramSocketState>(shared_from_this());
+        _readSource = DispatchSource::makeReadSource(_fd, &_queue);
+        _readSource->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_receive();
+            }
+        });
+
+        // Resumed only while a send waits for room in the socket buffer.
+        _writeSource = DispatchSource::makeWriteSource(_fd, &_queue);
+        _writeSource->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_flushSends();
+            }
+        });
+    }
+
+    // One batch per read event; the source fires again while datagrams remain.
+    inline void _receive() {
+        auto batch = std::vector<DispatchDatagram>(_batchSize);
+        auto buffers = std::vector<void *>(_batchSize);
+        for (auto& buffer : buffers) {
+            buffer = _pool->acquire();
+        }
+
+        auto lengths = std::vector<size_t>(_batchSize);
+        _receiveCalls++;
+        auto count = _receiveBatch(batch, buffers, lengths);
+
+        for (size_t i = 0; i < buffers.size(); i++) {
+            if (i < count) {
+                if (batch[i].truncated) {
+                    _truncated++;
+                }
+                batch[i].data = std::make_shared<DispatchData>(_pool->wrap(buffers[i], lengths[i]));
+            } else {
+                _pool->release(buffers[i]);
+            }
+        }
+        if (count == 0) {
+            return;
+        }
+        batch.resize(count);
+        _received += count;
+        if (_handler) {
+            _handler.get()(batch);
+        }
+    }
+
+    // Sends queued while an earlier one waits for room go out after it, in order.
+    inline void _send(_DispatchDatagramSend send) {
+        if (_cancelled) {
+            _complete(send, ECANCELED);
+            return;
+        }
+        _sends.push_back(std::move(send));
+        if (_sends.size() == 1) {
+            _flushSends();
+        }
+    }
+
+    inline void _flushSends() {
+        while (!_sends.empty()) {
+            auto& send = _sends.front();
+            int error = 0;
+            send.sent = _sendFrom(send.datagrams, send.sent, error);
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                _waitForSpace(true);
+                return;
+            }
+            _complete(send, error);
+            _sends.pop_front();
+        }
+        _waitForSpace(false);
+    }
+
+    inline void _resume() {
+        if (!_resumed.exchange(true)) {
+            _readSource->resume();
+        }
+    }
+
+    inline void _cancel() {
+        // A suspended source can neither be cancelled nor released.
+        _resume();
+        _readSource->cancel();
+
+        auto state = shared_from_this();
+        _queue.async(^{
+            if (state->_cancelled) {
+                return;
+            }
+            state->_cancelled = true;
+            state->_waitForSpace(true);
+            state->_writeSource->cancel();
+            for (auto& send : state->_sends) {
+                state->_complete(send, ECANCELED);
+            }
+            state->_sends.clear();
+        });
+    }
+
+private:
+
+    size_t _batchSize;
+    std::shared_ptr<DispatchBufferPool> _pool;
+    std::deque<_DispatchDatagramSend> _sends;
+    bool _waitingForSpace {false};
+    bool _cancelled {false};
+
+    inline void _waitForSpace(bool waiting) {
+        if (waiting == _waitingForSpace) {
+            return;
+        }
+        _waitingForSpace = waiting;
+        if (waiting) {
+            _writeSource->resume();
+        } else {
+            _writeSource->suspend();
+        }
+    }
+
+    inline static void _complete(const _DispatchDatagramSend& send, int error) {
+        if (!send.completion) {
+            return;
+        }
+        auto completion = send.completion;
+        auto sent = send.sent;
+        send.queue.async(^{
+            completion.get()(sent, error);
+        });
+    }
+
+    // Sends from `datagrams[sent]` on, and returns how many have been sent in all.
+    inline size_t _sendFrom(const std::vector<DispatchDatagram>& datagrams, size_t sent, int& error) {
+        error = 0;
+        while (sent < datagrams.size()) {
+            auto count = std::min(datagrams.size() - sent, _batchSize);
+            auto messages = std::vector<struct msghdr>(count);
+            auto iov = std::vector<struct iovec>(count * DISPATCH_DATAGRAM_MAX_IOV);
+            // Datagrams in more regions than a message takes are copied into one buffer each.
+            auto flattened = std::vector<DispatchData>();
+            flattened.reserve(count);
+
+            for (size_t i = 0; i < count; i++) {
+                auto& datagram = datagrams[sent + i];
+                auto *vector = &iov[i * DISPATCH_DATAGRAM_MAX_IOV];
+                __block size_t regions = 0;
+                if (datagram.data) {
+                    datagram.data->enumerateBytes(^(const void *bytes, size_t length, size_t offset, bool *stop) {
+                        regions++;
+                    });
+                }
+                if (regions > DISPATCH_DATAGRAM_MAX_IOV) {
+                    auto total = datagram.data->count();
+                    auto *source = datagram.data.get();
+                    flattened.push_back(DispatchData::aligned(total, sizeof(void *), ^(void *bytes, size_t) {
+                        source->copyBytes(bytes, int(total));
+                    }));
+                    regions = 0;
+                    flattened.back().enumerateBytes(^(const void *bytes, size_t length, size_t offset, bool *stop) {
+                        vector[regions++] = {const_cast<void *>(bytes), length};
+                    });
+                } else if (regions > 0) {
+                    regions = 0;
+                    datagram.data->enumerateBytes(^(const void *bytes, size_t length, size_t offset, bool *stop) {
+                        vector[regions++] = {const_cast<void *>(bytes), length};
+                    });
+                }
+                auto& message = messages[i];
+                message.msg_iov = vector;
+                message.msg_iovlen = regions;
+                if (datagram.addressLength != 0) {
+                    message.msg_name = const_cast<struct sockaddr_storage *>(&datagram.address);
+                    message.msg_namelen = datagram.addressLength;
+                }
+            }
+
+            _sendCalls++;
+            auto result = _sendBatch(messages);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                error = errno;
+                break;
+            }
+            sent += size_t(result);
+        }
+        return sent;
+    }
+
+    // Receives into `buffers`, filling in the addresses in `batch` and the datagram sizes in
+    // `lengths`, and returns the number of datagrams received.
+    inline size_t _receiveBatch(
+            std::vector<DispatchDatagram>& batch,
+            const std::vector<void *>& buffers,
+            std::vector<size_t>& lengths)
+    {
+        auto bufferSize = _pool->bufferSize();
+#if DISPATCH_HAVE_MMSG
+        auto messages = std::vector<struct mmsghdr>(batch.size());
+        auto iov = std::vector<struct iovec>(batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            iov[i] = {buffers[i], bufferSize};
+            auto& header = messages[i].msg_hdr;
+            header.msg_iov = &iov[i];
+            header.msg_iovlen = 1;
+            header.msg_name = &batch[i].address;
+            header.msg_namelen = sizeof(batch[i].address);
+        }
+
+        int count;
+        do {
+            count = recvmmsg(_fd, messages.data(), unsigned(messages.size()), MSG_DONTWAIT, nullptr);
+        } while (count < 0 && errno == EINTR);
+        if (count <= 0) {
+            return 0;
+        }
+        for (int i = 0; i < count; i++) {
+            batch[size_t(i)].addressLength = messages[size_t(i)].msg_hdr.msg_namelen;
+            batch[size_t(i)].truncated = (messages[size_t(i)].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+            lengths[size_t(i)] = std::min(size_t(messages[size_t(i)].msg_len), bufferSize);
+        }
+        return size_t(count);
+#else
+        size_t count = 0;
+        while (count < batch.size()) {
+            auto& datagram = batch[count];
+            struct iovec vector = {buffers[count], bufferSize};
+            struct msghdr message {};
+            message.msg_iov = &vector;
+            message.msg_iovlen = 1;
+            message.msg_name = &datagram.address;
+            message.msg_namelen = sizeof(datagram.address);
+            auto n = recvmsg(_fd, &message, MSG_DONTWAIT);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                break;
+            }
+            datagram.addressLength = message.msg_namelen;
+            datagram.truncated = (message.msg_flags & MSG_TRUNC) != 0;
+            lengths[count] = std::min(size_t(n), bufferSize);
+            count++;
+        }
+        return count;
+#endif
+    }
+
+    inline int _sendBatch(std::vector<struct msghdr>& messages) {
+#if DISPATCH_HAVE_MMSG
+        auto batch = std::vector<struct mmsghdr>(messages.size());
+        for (size_t i = 0; i < messages.size(); i++) {
+            batch[i].msg_hdr = messages[i];
+        }
+        return sendmmsg(_fd, batch.data(), unsigned(batch.size()), MSG_DONTWAIT);
+#else
+        int sent = 0;
+        for (auto& message : messages) {
+            if (sendmsg(_fd, &message, MSG_DONTWAIT) < 0) {
+                return sent > 0 ? sent : -1;
+            }
+            sent++;
+        }
+        return sent;
+#endif
+    }
+
+};
+
+///
+/// A datagram socket that receives and sends in batches.
+///
+/// Each read source event drains up to `batchSize` datagrams with a single
+/// `recvmmsg` (a `recvmsg` loop where it is unavailable) into buffers taken from a
+/// `DispatchBufferPool`, and hands them to the receive handler together. The
+/// `DispatchData` of each datagram wraps its pooled buffer, which goes back to the
+/// pool once the data is released. Datagrams longer than `maxDatagramSize` arrive
+/// cut to it, with `truncated` set. `send` submits a batch with `sendmmsg`, and while
+/// the socket buffer is full waits for room on a write source; later sends queue behind it.
+///
+/// The socket is made non-blocking and is not closed. Like a dispatch source, it
+/// starts suspended: set the receive handler, then `resume()`.
+///
+class DispatchDatagramSocket {
+
+public:
+
+    inline DispatchDatagramSocket(
+            int fileDescriptor,
+            const DispatchQueue& queue,
+            size_t batchSize = DISPATCH_DATAGRAM_DEFAULT_BATCH_SIZE,
+            size_t maxDatagramSize = DISPATCH_DATAGRAM_DEFAULT_MAX_SIZE)
+    {
+        _state = std::make_shared<_DispatchDatagramSocketState>(fileDescriptor, queue, batchSize, maxDatagramSize);
+        _state->_start();
+    }
+
+    DispatchDatagramSocket(const DispatchDatagramSocket&) = delete;
+    DispatchDatagramSocket& operator= (const DispatchDatagramSocket&) = delete;
+
+    inline ~DispatchDatagramSocket() {
+        cancel();
+    }
+
+    /// Sets the handler invoked on the socket's queue with each received batch. Call before `resume()`.
+    inline void setReceiveHandler(DispatchDatagramHandler handler) {
+        _state->_handler = _DispatchRetainedBlock<DispatchDatagramHandler>(handler);
+    }
+
+    inline void resume() {
+        _state->_resume();
+    }
+
+    /// Stops receiving. A receive handler invocation already under way still completes, and
+    /// the sends still waiting for room complete with `ECANCELED`.
+    inline void cancel() {
+        _state->_cancel();
+    }
+
+    ///
+    /// Sends `datagrams` in as few `sendmmsg` calls as the batch size allows.
+    ///
+    /// - parameter datagrams: The datagrams, each sent to its `address`, or to the
+    ///     connected peer when `addressLength` is 0.
+    /// - parameter completion: Invoked on `queue` with the number of datagrams sent,
+    ///     and the error that stopped the batch, or 0. When the socket buffer is full the
+    ///     send waits for room on a write source, rather than failing with `EAGAIN`.
+    ///
+    inline void send(
+            const std::vector<DispatchDatagram>& datagrams,
+            const DispatchQueue& queue,
+            void (^completion)(size_t sent, int error))
+    {
+        auto state = _state;
+        auto send = _DispatchDatagramSend {datagrams, 0, queue, _DispatchRetainedBlock<void (^)(size_t, int)>(completion)};
+        state->_queue.async(^{
+            state->_send(send);
+        });
+    }
+
+    /// The number of datagrams received so far.
+    [[nodiscard]] inline uint64_t received() const {
+        return _state->_received.load();
+    }
+
+    /// The number of datagrams received longer than `maxDatagramSize`, and truncated.
+    [[nodiscard]] inline uint64_t truncated() const {
+        return _state->_truncated.load();
+    }
+
+    /// The number of receive system calls made so far.
+    [[nodiscard]] inline uint64_t receiveCalls() const {
+        return _state->_receiveCalls.load();
+    }
+
+    /// The number of send system calls made so far.
+    [[nodiscard]] inline uint64_t sendCalls() const {
+        return _state->_sendCalls.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchDatagramSocketState> _state;
+
+};
@@ -0,0 +1,307 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Shared by the debouncer and the throttler: triggers are merged by a user data source, and
+// a timer source decides when the handler runs.
+class _DispatchCoalescerState: public std::enable_shared_from_this<_DispatchCoalescerState> {
+
+public:
+
+    enum struct Merge {
+        /// The handler gets the sum of the triggers' data; with the default data, their count.
+        ADD,
+        /// The handler gets the bitwise or of the triggers' data.
+        OR
+    };
+
+    /// Invoked with the merged data of the triggers since the last run.
+    typedef void (^Handler)(uint64_t data);
+
+    inline _DispatchCoalescerState(
+            const DispatchQueue& queue,
+            Handler handler,
+            Merge merge,
+            const DispatchTimeInterval& window,
+            const DispatchTimeInterval& maxDelay,
+            bool throttle)
+        : _targetQueue(queue), _handler(handler), _merge(merge), _window(window), _maxDelay(maxDelay), _throttle(throttle) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.Coalescer"};
+    DispatchQueue _targetQueue;
+    _DispatchRetainedBlock<Handler> _handler;
+    Merge _merge;
+    DispatchTimeInterval _window;
+    DispatchTimeInterval _maxDelay;
+    bool _throttle;
+    std::shared_ptr<DispatchSourceUserDataAdd> _addSource;
+    std::shared_ptr<DispatchSourceUserDataOr> _orSource;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    uint64_t _pending {0};
+    bool _hasPending {false};
+    // Debouncing: when the current burst began. Throttling: whether a window is open.
+    DispatchTime _burstStart {DispatchTime::distantFuture()};
+    bool _inWindow {false};
+    std::atomic<uint64_t> _triggers {0};
+    std::atomic<uint64_t> _runs {0};
+
+    inline void _start() {
+        auto weakSelf = std::weak_ptr<_DispatchCoalescerState>(shared_from_this());
+        _timer = DispatchSource::makeTimerSource(&_queue);
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_timerFired();
+            }
+        });
+        _timer->schedule(DispatchTime::distantFuture());
+        _timer->resume();
+
+        if (_merge == Merge::ADD) {
+            _addSource = DispatchSource::makeUserDataAddSource(&_queue);
+            _addSource->setEventHandler(^{
+                if (auto state = weakSelf.lock()) {
+                    state->_received(state->_addSource->getData());
+                }
+            });
+            _addSource->resume();
+        } else {
+            _orSource = DispatchSource::makeUserDataOrSource(&_queue);
+            _orSource->setEventHandler(^{
+                if (auto state = weakSelf.lock()) {
+                    state->_received(state->_orSource->getData());
+                }
+            });
+            _orSource->resume();
+        }
+    }
+
+    inline void _stop() {
+        _timer->cancel();
+        if (_addSource) {
+            _addSource->cancel();
+        }
+        if (_orSource) {
+            _orSource->cancel();
+        }
+    }
+
+    // Lock-free, from any thread: the source merges the data until its handler runs.
+    inline void _trigger(uint data) {
+        _triggers++;
+        if (_addSource) {
+            _addSource->dataAdd(data);
+        } else {
+            _orSource->dataOr(data);
+        }
+    }
+
+    inline void _flush() {
+        if (_hasPending) {
+            _run();
+        }
+    }
+
+private:
+
+    // Runs on the queue, with the data merged since the last time.
+    inline void _received(uint data) {
+        _pending = _merge == Merge::ADD ? _pending + data : _pending | data;
+        _hasPending = true;
+        auto now = DispatchTime::now();
+
+        if (_throttle) {
+            // Leading edge: the first trigger runs at once, and opens a window.
+            if (!_inWindow) {
+                _inWindow = true;
+                _run();
+                _timer->schedule(now + _window);
+            }
+            return;
+        }
+
+        // Trailing edge: each trigger pushes the run back, up to the maximum delay.
+        if (_burstStart == DispatchTime::distantFuture()) {
+            _burstStart = now;
+        }
+        auto deadline = now + _window;
+        if (_maxDelay != DispatchTimeInterval::never() && _burstStart + _maxDelay < deadline) {
+            deadline = _burstStart + _maxDelay;
+        }
+        _timer->schedule(deadline);
+    }
+
+    inline void _timerFired() {
+        if (_throttle) {
+            // The trailing edge of a window runs what came during it, and opens the next one.
+            if (_hasPending) {
+                _run();
+                _timer->schedule(DispatchTime::now() + _window);
+            } else {
+                _inWindow = false;
+                _timer->schedule(DispatchTime::distantFuture());
+            }
+            return;
+        }
+        _flush();
+        _timer->schedule(DispatchTime::distantFuture());
+    }
+
+    inline void _run() {
+        auto data = _pending;
+        _pending = 0;
+        _hasPending = false;
+        _burstStart = DispatchTime::distantFuture();
+        _runs++;
+        auto handler = _handler;
+        _targetQueue.async(^{
+            handler.get()(data);
+        });
+    }
+
+};
+
+///
+/// Runs a handler once a burst of triggers has settled.
+///
+/// `trigger` can be called from any thread, and only merges its data into a user data
+/// source, without locking. The handler runs on the target queue once no trigger has
+/// come for `window`, with the data merged over the burst; so 10k triggers in quick
+/// succession make one run. With a `maxDelay`, a burst that never settles still runs
+/// the handler at least that often.
+///
+class DispatchDebouncer {
+
+public:
+
+    typedef _DispatchCoalescerState::Merge Merge;
+    typedef _DispatchCoalescerState::Handler Handler;
+
+    ///
+    /// - parameter queue: The queue the handler runs on.
+    /// - parameter window: How long the triggers must stop before the handler runs.
+    /// - parameter merge: How the data of the triggers is merged.
+    /// - parameter maxDelay: The longest a trigger waits for the handler, however long the burst.
+    ///
+    inline DispatchDebouncer(
+            const DispatchQueue& queue,
+            const DispatchTimeInterval& window,
+            Handler handler,
+            Merge merge = Merge::ADD,
+            const DispatchTimeInterval& maxDelay = DispatchTimeInterval::never())
+    {
+        _state = std::make_shared<_DispatchCoalescerState>(queue, handler, merge, window, maxDelay, false);
+        _state->_start();
+    }
+
+    DispatchDebouncer(const DispatchDebouncer&) = delete;
+    DispatchDebouncer& operator= (const DispatchDebouncer&) = delete;
+
+    inline ~DispatchDebouncer() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    inline void trigger(uint data = 1) {
+        _state->_trigger(data);
+    }
+
+    /// Runs the handler now for the pending triggers, if any.
+    inline void flush() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_flush();
+        });
+    }
+
+    /// The number of triggers so far.
+    [[nodiscard]] inline uint64_t triggers() const {
+        return _state->_triggers.load();
+    }
+
+    /// The number of times the handler has been submitted.
+    [[nodiscard]] inline uint64_t runs() const {
+        return _state->_runs.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchCoalescerState> _state;
+
+};
+
+///
+/// Runs a handler at most once per window, however often it is triggered.
+///
+/// The first trigger runs the handler at once and opens a window; the triggers that come
+/// during the window are merged, and run the handler when it closes, opening the next
+/// one. A steady stream of triggers thus runs the handler once per window, and a single
+/// trigger is not delayed. `trigger` is lock-free, as for `DispatchDebouncer`.
+///
+class DispatchThrottler {
+
+public:
+
+    typedef _DispatchCoalescerState::Merge Merge;
+    typedef _DispatchCoalescerState::Handler Handler;
+
+    ///
+    /// - parameter queue: The queue the handler runs on.
+    /// - parameter window: The shortest time between two runs of the handler.
+    /// - parameter merge: How the data of the triggers is merged.
+    ///
+    inline DispatchThrottler(
+            const DispatchQueue& queue,
+            const DispatchTimeInterval& window,
+            Handler handler,
+            Merge merge = Merge::ADD)
+    {
+        _state = std::make_shared<_DispatchCoalescerState>(
+                queue, handler, merge, window, DispatchTimeInterval::never(), true);
+        _state->_start();
+    }
+
+    DispatchThrottler(const DispatchThrottler&) = delete;
+    DispatchThrottler& operator= (const DispatchThrottler&) = delete;
+
+    inline ~DispatchThrottler() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    inline void trigger(uint data = 1) {
+        _state->_trigger(data);
+    }
+
+    /// The number of triggers so far.
+    [[nodiscard]] inline uint64_t triggers() const {
+        return _state->_triggers.load();
+    }
+
+    /// The number of times the handler has been submitted.
+    [[nodiscard]] inline uint64_t runs() const {
+        return _state->_runs.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchCoalescerState> _state;
+
+};
@@ -0,0 +1,339 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/Queue.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#endif
+
+// The alignment assumed when the file system does not report one.
+#define DISPATCH_DIRECT_IO_DEFAULT_ALIGNMENT 4096
+
+class _DispatchDirectIOChannel: public std::enable_shared_from_this<_DispatchDirectIOChannel> {
+
+public:
+
+    inline _DispatchDirectIOChannel(int fileDescriptor, const DispatchQueue& queue, void (^cleanupHandler)(int error))
+        : _fd(fileDescriptor), _cleanupQueue(queue), _cleanupHandler(cleanupHandler)
+    {
+#if defined(F_NOCACHE)
+        // Darwin has no O_DIRECT; the descriptor has to opt out of the buffer cache instead.
+        _direct = fcntl(_fd, F_NOCACHE, 1) == 0;
+#elif defined(O_DIRECT)
+        auto flags = fcntl(_fd, F_GETFL);
+        _direct = flags != -1 && (flags & O_DIRECT) != 0;
+#endif
+        _detectAlignment();
+    }
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.DirectIO", DispatchQueue::Attributes::CONCURRENT};
+    int _fd;
+    bool _direct {false};
+    size_t _blockSize {DISPATCH_DIRECT_IO_DEFAULT_ALIGNMENT};
+    size_t _memoryAlignment {DISPATCH_DIRECT_IO_DEFAULT_ALIGNMENT};
+    std::atomic<bool> _closing {false};
+    // Set by a barrier, so the operations submitted before the close still run.
+    std::atomic<bool> _closed {false};
+
+    [[nodiscard]] inline size_t _roundUp(size_t length) const {
+        return (length + _blockSize - 1) / _blockSize * _blockSize;
+    }
+
+    inline std::shared_ptr<DispatchData> _read(off_t offset, size_t length, int& error) {
+        if (_closed) {
+            error = EBADF;
+            return nullptr;
+        }
+        if (offset % off_t(_blockSize) != 0) {
+            error = EINVAL;
+            return nullptr;
+        }
+
+        // The tail is read as a whole block and cut back to `length`.
+        auto capacity = _roundUp(length);
+        __block size_t transferred = 0;
+        __block int readError = 0;
+        auto fd = _fd;
+        auto blockSize = _blockSize;
+        auto buffer = DispatchData::aligned(capacity, _memoryAlignment, ^(void *bytes, size_t) {
+            while (transferred < capacity) {
+                auto n = pread(fd, static_cast<char *>(bytes) + transferred, capacity - transferred, offset + off_t(transferred));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    readError = errno;
+                    break;
+                }
+                transferred += size_t(n);
+                // End of file; a further direct read would start off a block boundary.
+                if (n == 0 || transferred % blockSize != 0) {
+                    break;
+                }
+            }
+        });
+        error = readError;
+        if (error != 0) {
+            return nullptr;
+        }
+        return std::make_shared<DispatchData>(buffer.subdata(0, int(std::min(transferred, length))));
+    }
+
+    inline int _write(off_t offset, DispatchData data) {
+        if (_closed) {
+            return EBADF;
+        }
+        if (offset % off_t(_blockSize) != 0) {
+            return EINVAL;
+        }
+
+        auto count = data.count();
+        if (count == 0) {
+            return 0;
+        }
+        auto capacity = _roundUp(count);
+
+        struct stat st {};
+        if (fstat(_fd, &st) != 0) {
+            return errno;
+        }
+
+        __block int error = 0;
+        if (capacity == count && data.isAligned(_memoryAlignment)) {
+            data.withUnsafeBytes(^(const void *bytes, size_t) {
+                error = _writeFully(bytes, capacity, offset);
+            });
+            return error;
+        }
+
+        // Copy into an aligned buffer. An unaligned tail is padded with what the file already
+        // holds past it, so the whole-block write leaves that data alone.
+        auto fd = _fd;
+        auto tail = offset + off_t(capacity - _blockSize);
+        auto blockSize = _blockSize;
+        auto buffer = DispatchData::aligned(capacity, _memoryAlignment, ^(void *bytes, size_t) {
+            if (capacity != count && tail < st.st_size) {
+                if (pread(fd, static_cast<char *>(bytes) + capacity - blockSize, blockSize, tail) < 0) {
+                    error = errno;
+                }
+            }
+        });
+        if (error != 0) {
+            return error;
+        }
+        auto *source = &data;
+        buffer.withUnsafeBytes(^(const void *bytes, size_t) {
+            source->copyBytes(const_cast<void *>(bytes), int(count));
+            error = _writeFully(bytes, capacity, offset);
+        });
+        if (error != 0) {
+            return error;
+        }
+
+        // Drop the padding the write appended past the end of the file.
+        auto end = offset + off_t(count);
+        if (capacity != count && st.st_size < offset + off_t(capacity)) {
+            if (ftruncate(_fd, std::max(st.st_size, end)) != 0) {
+                return errno;
+            }
+        }
+        return 0;
+    }
+
+    inline void _close() {
+        if (_closing.exchange(true)) {
+            return;
+        }
+        auto channel = shared_from_this();
+        auto cleanupQueue = _cleanupQueue;
+        auto cleanupHandler = _cleanupHandler;
+        // Runs once the operations submitted before it are done, and before the ones submitted after it.
+        _queue.async(DispatchWorkItemFlags::BARRIER, ^{
+            channel->_closed = true;
+            cleanupQueue.async(^{
+                if (cleanupHandler) {
+                    cleanupHandler.get()(0);
+                }
+            });
+        });
+    }
+
+private:
+
+    DispatchQueue _cleanupQueue;
+    _DispatchRetainedBlock<void (^)(int error)> _cleanupHandler;
+
+    inline int _writeFully(const void *bytes, size_t length, off_t offset) const {
+        size_t written = 0;
+        while (written < length) {
+            auto n = pwrite(_fd, static_cast<const char *>(bytes) + written, length - written, offset + off_t(written));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                return errno;
+            }
+            written += size_t(n);
+        }
+        return 0;
+    }
+
+    inline void _detectAlignment() {
+#if defined(__linux__) && defined(STATX_DIOALIGN)
+        struct statx stx {};
+        if (statx(_fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN) != 0
+                && stx.stx_dio_offset_align != 0) {
+            _blockSize = stx.stx_dio_offset_align;
+            _memoryAlignment = std::max(size_t(stx.stx_dio_mem_align), sizeof(void *));
+            return;
+        }
+#endif
+        struct stat st {};
+        if (fstat(_fd, &st) != 0) {
+            return;
+        }
+#if defined(BLKSSZGET)
+        int sectorSize = 0;
+        if (S_ISBLK(st.st_mode) && ioctl(_fd, BLKSSZGET, &sectorSize) == 0 && sectorSize > 0) {
+            _blockSize = size_t(sectorSize);
+            _memoryAlignment = size_t(sectorSize);
+            return;
+        }
+#endif
+        // The preferred IO size is a multiple of the logical block size.
+        if (st.st_blksize >= 512) {
+            _blockSize = size_t(st.st_blksize);
+            _memoryAlignment = size_t(st.st_blksize);
+        }
+    }
+
+};
+
+///
+/// A channel for file descriptors opened for direct IO, bypassing the page cache.
+///
+/// `DispatchIO` copies through libdispatch's own buffers, which do not keep the
+/// alignment `O_DIRECT` needs, so this channel does its reads and writes with
+/// `pread`/`pwrite` on a concurrent queue, into and out of buffers made by
+/// `DispatchData::aligned`.
+///
+/// Offsets must be multiples of `blockSize()`, the file system's direct IO
+/// alignment; other offsets fail with `EINVAL`. Lengths need not be: a short read
+/// returns what precedes the end of the file, and the unaligned tail of a write is
+/// padded to a whole block with the bytes already on disk, then trimmed off with
+/// `ftruncate` when it extended the file. Writes are exclusive with respect to
+/// the other operations on the channel.
+///
+class DispatchDirectIO {
+
+public:
+
+    ///
+    /// Opens `path` for direct IO. Where the file system refuses `O_DIRECT` the file is
+    /// opened without it, which `isDirect()` reports.
+    ///
+    /// - returns: The file descriptor, or -1 with `errno` set.
+    ///
+    inline static int open(const std::string& path, int oflag, mode_t mode = 0644) {
+#if defined(O_DIRECT)
+        auto fd = ::open(path.c_str(), oflag | O_DIRECT, mode);
+        if (fd != -1 || errno != EINVAL) {
+            return fd;
+        }
+#endif
+        return ::open(path.c_str(), oflag, mode);
+    }
+
+    inline DispatchDirectIO(int fileDescriptor, const DispatchQueue& queue, void (^cleanupHandler)(int error)) {
+        _channel = std::make_shared<_DispatchDirectIOChannel>(fileDescriptor, queue, cleanupHandler);
+    }
+
+    /// The alignment required of offsets.
+    [[nodiscard]] inline size_t blockSize() const {
+        return _channel->_blockSize;
+    }
+
+    /// The alignment required of buffer addresses.
+    [[nodiscard]] inline size_t memoryAlignment() const {
+        return _channel->_memoryAlignment;
+    }
+
+    /// Whether the page cache is actually bypassed.
+    [[nodiscard]] inline bool isDirect() const {
+        return _channel->_direct;
+    }
+
+    [[nodiscard]] inline int fileDescriptor() const {
+        return _channel->_fd;
+    }
+
+    /// An empty buffer suitable for writes to this channel, filled by `initializer`.
+    [[nodiscard]] inline DispatchData makeBuffer(
+            size_t count,
+            DISPATCH_NOESCAPE void (^initializer)(void *bytes, size_t capacity) = nullptr) const
+    {
+        return DispatchData::aligned(count, std::max(_channel->_memoryAlignment, _channel->_blockSize), initializer);
+    }
+
+    inline void read(
+            off_t offset,
+            size_t length,
+            const DispatchQueue& queue,
+            void (^handler)(const std::shared_ptr<DispatchData> data, int error))
+    {
+        auto channel = _channel;
+        auto target = queue;
+        auto retainedHandler = _DispatchRetainedBlock<void (^)(const std::shared_ptr<DispatchData>, int)>(handler);
+        channel->_queue.async(^{
+            int error = 0;
+            auto data = channel->_read(offset, length, error);
+            target.async(^{
+                retainedHandler.get()(data, error);
+            });
+        });
+    }
+
+    inline void write(off_t offset, const DispatchData& data, const DispatchQueue& queue, void (^handler)(int error)) {
+        auto channel = _channel;
+        auto buffer = data;
+        auto target = queue;
+        auto retainedHandler = _DispatchRetainedBlock<void (^)(int)>(handler);
+        channel->_queue.async(DispatchWorkItemFlags::BARRIER, ^{
+            auto error = channel->_write(offset, buffer);
+            target.async(^{
+                retainedHandler.get()(error);
+            });
+        });
+    }
+
+    /// Rejects further operations, and invokes the cleanup handler once the pending ones are done.
+    /// The file descriptor is left open for the cleanup handler to close.
+    inline void close() {
+        _channel->_close();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchDirectIOChannel> _channel;
+
+};
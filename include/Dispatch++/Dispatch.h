@@ -10,10 +10,35 @@
 #include <Dispatch++/Object.h>
 #include <Dispatch++/QoS.h>
 #include <Dispatch++/Queue.h>
+#include <Dispatch++/AdaptiveLimiter.h>
+#include <Dispatch++/Batcher.h>
+#include <Dispatch++/BoundedQueue.h>
+#include <Dispatch++/BufferedWriter.h>
+#include <Dispatch++/BufferPool.h>
 #include <Dispatch++/Data.h>
+#include <Dispatch++/DatagramSocket.h>
+#include <Dispatch++/Debouncer.h>
+#include <Dispatch++/DirectIO.h>
+#include <Dispatch++/FileWatcher.h>
+#include <Dispatch++/FixedRateTimer.h>
 #include <Dispatch++/Group.h>
 #include <Dispatch++/IO.h>
+#include <Dispatch++/IOScheduler.h>
+#include <Dispatch++/LimitedQueue.h>
+#include <Dispatch++/LogSink.h>
+#include <Dispatch++/MemoryPressure.h>
+#include <Dispatch++/PeriodicScheduler.h>
+#include <Dispatch++/PreciseTimer.h>
+#include <Dispatch++/ProcessPool.h>
+#include <Dispatch++/ReadAhead.h>
 #include <Dispatch++/Semaphore.h>
+#include <Dispatch++/SharedData.h>
+#include <Dispatch++/ShmChannel.h>
 #include <Dispatch++/Source.h>
+#include <Dispatch++/Subprocess.h>
+#include <Dispatch++/TCPServer.h>
 #include <Dispatch++/Time.h>
+#include <Dispatch++/TimerWheel.h>
+#include <Dispatch++/URingIO.h>
+#include <Dispatch++/WAL.h>
 #include <Dispatch++/Impl.h>
@@ -0,0 +1,559 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <mutex>
+#include <sys/inotify.h>
+#include <unordered_map>
+#endif
+
+#define DISPATCH_FILE_WATCHER_DEFAULT_DEBOUNCE_MS 100
+// How often paths that disappeared are looked for again.
+#define DISPATCH_FILE_WATCHER_REARM_INTERVAL_MS 1000
+
+#if defined(__linux__)
+
+class _DispatchInotifySource;
+
+// One inotify instance for the whole process, read by a single read source, which fans the
+// events out to the file system sources watching each inode.
+class _DispatchInotify {
+
+public:
+
+    inline static _DispatchInotify& shared() {
+        static auto *instance = new _DispatchInotify();
+        return *instance;
+    }
+
+    inline int add(const char *path, uint32_t mask, _DispatchInotifySource *source, const std::weak_ptr<_DispatchInotifySource>& weakSource) {
+        if (_fd < 0) {
+            errno = ENOSYS;
+            return -1;
+        }
+        // Several sources may watch one inode; their masks add up.
+        auto wd = inotify_add_watch(_fd, path, mask | IN_MASK_ADD);
+        if (wd < 0) {
+            return -1;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _watchers[wd].push_back({source, weakSource});
+        return wd;
+    }
+
+    inline void remove(int wd, _DispatchInotifySource *source) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto entry = _watchers.find(wd);
+        if (entry == _watchers.end()) {
+            return;
+        }
+        std::erase_if(entry->second, [source](const _Watcher& watcher) {
+            return watcher.source == source;
+        });
+        if (entry->second.empty()) {
+            _watchers.erase(entry);
+            inotify_rm_watch(_fd, wd);
+        }
+    }
+
+    inline static uint32_t inotifyMask(uint events) {
+        uint32_t mask = 0;
+        if (events & uint(DispatchSource::FileSystemEvent::DELETE)) mask |= IN_DELETE_SELF;
+        if (events & uint(DispatchSource::FileSystemEvent::WRITE)) mask |= IN_MODIFY | IN_CLOSE_WRITE;
+        if (events & uint(DispatchSource::FileSystemEvent::EXTEND)) mask |= IN_MODIFY;
+        if (events & uint(DispatchSource::FileSystemEvent::ATTRIB)) mask |= IN_ATTRIB;
+        if (events & uint(DispatchSource::FileSystemEvent::LINK)) mask |= IN_ATTRIB;
+        if (events & uint(DispatchSource::FileSystemEvent::RENAME)) mask |= IN_MOVE_SELF;
+        if (events & uint(DispatchSource::FileSystemEvent::REVOKE)) mask |= IN_UNMOUNT;
+        return mask;
+    }
+
+    inline static uint fileSystemEvents(uint32_t mask) {
+        uint events = 0;
+        if (mask & (IN_DELETE_SELF | IN_IGNORED)) events |= uint(DispatchSource::FileSystemEvent::DELETE);
+        if (mask & IN_MODIFY) events |= uint(DispatchSource::FileSystemEvent::WRITE) | uint(DispatchSource::FileSystemEvent::EXTEND);
+        if (mask & IN_CLOSE_WRITE) events |= uint(DispatchSource::FileSystemEvent::WRITE);
+        if (mask & IN_ATTRIB) events |= uint(DispatchSource::FileSystemEvent::ATTRIB) | uint(DispatchSource::FileSystemEvent::LINK);
+        if (mask & IN_MOVE_SELF) events |= uint(DispatchSource::FileSystemEvent::RENAME);
+        if (mask & IN_UNMOUNT) events |= uint(DispatchSource::FileSystemEvent::REVOKE);
+        return events;
+    }
+
+private:
+
+    struct _Watcher {
+        _DispatchInotifySource *source;
+        std::weak_ptr<_DispatchInotifySource> weakSource;
+    };
+
+    int _fd;
+    DispatchQueue _queue {"tech.shifor.Dispatch++.Inotify"};
+    std::shared_ptr<DispatchSourceRead> _readSource;
+    std::mutex _mutex;
+    std::unordered_map<int, std::vector<_Watcher>> _watchers;
+
+    inline _DispatchInotify(): _fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+        if (_fd < 0) {
+            return;
+        }
+        _readSource = DispatchSource::makeReadSource(_fd, &_queue);
+        _readSource->setEventHandler(^{
+            _DispatchInotify::shared()._read();
+        });
+        _readSource->resume();
+    }
+
+    inline void _read();
+
+};
+
+// A file system object source over the shared inotify instance; the events of each inode are
+// merged into a DATA_OR source, which provides the rest of the source behaviour.
+class _DispatchInotifySource: public DispatchSourceFileSystemObject {
+
+public:
+
+    inline static std::shared_ptr<_DispatchInotifySource> make(
+            const char *path,
+            int32_t handle,
+            uint eventMask,
+            const DispatchQueue *queue)
+    {
+        auto source = std::shared_ptr<_DispatchInotifySource>(new _DispatchInotifySource(handle, eventMask, queue));
+        source->_wd = _DispatchInotify::shared().add(path, _DispatchInotify::inotifyMask(eventMask), source.get(), source);
+        if (source->_wd < 0) {
+            // A suspended source can neither be cancelled nor released.
+            auto error = errno;
+            source->_source->resume();
+            source->_source->cancel();
+            errno = error;
+            return nullptr;
+        }
+        return source;
+    }
+
+    inline ~_DispatchInotifySource() {
+        _unwatch();
+    }
+
+    // Called by the inotify reader with the events of the watched inode.
+    inline void _deliver(uint events, bool ignored) {
+        if (ignored) {
+            // The watch is gone with the inode; the descriptor may be reused for another one.
+            _wd.store(-1);
+        }
+        events &= _mask;
+        if (events != 0) {
+            _source->dataOr(events);
+        }
+    }
+
+    // MARK: - DispatchSourceProtocol
+
+    inline void setEventHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setEventHandler(qos, flags, handler);
+    }
+
+    inline void setEventHandler(DispatchWorkItem handler) override {
+        _source->setEventHandler(std::move(handler));
+    }
+
+    inline void setCancelHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setCancelHandler(qos, flags, handler);
+    }
+
+    inline void setCancelHandler(DispatchWorkItem handler) override {
+        _source->setCancelHandler(std::move(handler));
+    }
+
+    inline void setRegistrationHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setRegistrationHandler(qos, flags, handler);
+    }
+
+    inline void setRegistrationHandler(DispatchWorkItem handler) override {
+        _source->setRegistrationHandler(std::move(handler));
+    }
+
+    inline void activate() override {
+        _source->activate();
+    }
+
+    inline void cancel() override {
+        _unwatch();
+        _source->cancel();
+    }
+
+    inline void resume() override {
+        _source->resume();
+    }
+
+    inline void suspend() override {
+        _source->suspend();
+    }
+
+    inline uint getHandle() override {
+        return uint(_handle);
+    }
+
+    inline uint getMask() override {
+        return _mask;
+    }
+
+    inline uint getData() override {
+        return _source->getData();
+    }
+
+    inline bool isCancelled() override {
+        return _source->isCancelled();
+    }
+
+private:
+
+    inline _DispatchInotifySource(int32_t handle, uint eventMask, const DispatchQueue *queue)
+        : _handle(handle), _mask(eventMask), _source(DispatchSource::makeUserDataOrSource(queue)) {}
+
+    int32_t _handle;
+    uint _mask;
+    std::atomic<int> _wd {-1};
+    std::shared_ptr<DispatchSourceUserDataOr> _source;
+
+    inline void _unwatch() {
+        auto wd = _wd.exchange(-1);
+        if (wd >= 0) {
+            _DispatchInotify::shared().remove(wd, this);
+        }
+    }
+
+};
+
+inline void _DispatchInotify::_read() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    while (true) {
+        auto n = ::read(_fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        for (char *cursor = buffer; cursor < buffer + n;) {
+            auto event = reinterpret_cast<const struct inotify_event *>(cursor);
+            cursor += sizeof(struct inotify_event) + event->len;
+
+            auto ignored = (event->mask & IN_IGNORED) != 0;
+            std::vector<std::shared_ptr<_DispatchInotifySource>> sources;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto entry = _watchers.find(event->wd);
+                if (entry == _watchers.end()) {
+                    continue;
+                }
+                for (auto& watcher : entry->second) {
+                    if (auto source = watcher.weakSource.lock()) {
+                        sources.push_back(source);
+                    }
+                }
+                if (ignored) {
+                    _watchers.erase(entry);
+                }
+            }
+            auto events = fileSystemEvents(event->mask);
+            for (auto& source : sources) {
+                source->_deliver(events, ignored);
+            }
+        }
+    }
+}
+
+#endif // defined(__linux__)
+
+class _DispatchFileWatcherState: public std::enable_shared_from_this<_DispatchFileWatcherState> {
+
+public:
+
+    typedef void (^ReloadHandler)(const std::vector<std::string>& paths);
+
+    inline _DispatchFileWatcherState(const DispatchQueue& queue, ReloadHandler handler, const DispatchTimeInterval& debounce)
+        : _userQueue(queue), _handler(handler), _debounce(debounce) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.FileWatcher"};
+    std::atomic<uint64_t> _reloads {0};
+    std::atomic<uint64_t> _events {0};
+
+    inline void _start() {
+        auto weakSelf = std::weak_ptr<_DispatchFileWatcherState>(shared_from_this());
+        _timer = DispatchSource::makeTimerSource(&_queue);
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_fire();
+            }
+        });
+        _timer->schedule(DispatchTime::distantFuture());
+        _timer->resume();
+    }
+
+    inline void _stop() {
+        for (auto& [path, source] : _sources) {
+            source->cancel();
+        }
+        _sources.clear();
+        _missing.clear();
+        _timer->cancel();
+    }
+
+    inline void _watch(const std::string& path) {
+        if (_sources.count(path) != 0 || _missing.count(path) != 0) {
+            return;
+        }
+        if (!_arm(path)) {
+            _missing.insert(path);
+            _scheduleRearm();
+        }
+    }
+
+    inline void _unwatch(const std::string& path) {
+        auto entry = _sources.find(path);
+        if (entry != _sources.end()) {
+            entry->second->cancel();
+            _sources.erase(entry);
+        }
+        _missing.erase(path);
+        _changed.erase(path);
+    }
+
+private:
+
+    DispatchQueue _userQueue;
+    _DispatchRetainedBlock<ReloadHandler> _handler;
+    DispatchTimeInterval _debounce;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    std::map<std::string, std::shared_ptr<DispatchSourceFileSystemObject>> _sources;
+    std::set<std::string> _missing;
+    std::set<std::string> _changed;
+    bool _pending {false};
+
+    inline static uint _mask() {
+        return uint(DispatchSource::FileSystemEvent::WRITE) | uint(DispatchSource::FileSystemEvent::EXTEND) |
+               uint(DispatchSource::FileSystemEvent::ATTRIB) | uint(DispatchSource::FileSystemEvent::DELETE) |
+               uint(DispatchSource::FileSystemEvent::RENAME) | uint(DispatchSource::FileSystemEvent::REVOKE);
+    }
+
+    // Replaced files show up as a delete or rename of the watched inode.
+    inline static uint _goneMask() {
+        return uint(DispatchSource::FileSystemEvent::DELETE) | uint(DispatchSource::FileSystemEvent::RENAME) |
+               uint(DispatchSource::FileSystemEvent::REVOKE);
+    }
+
+    inline std::shared_ptr<DispatchSourceFileSystemObject> _makeSource(const std::string& path) {
+#if defined(__linux__)
+        // inotify watches the path's inode directly, so no descriptor is held per file.
+        return _DispatchInotifySource::make(path.c_str(), -1, _mask(), &_queue);
+#else
+#if defined(O_EVTONLY)
+        int fd = open(path.c_str(), O_EVTONLY | O_CLOEXEC);
+#else
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+        if (fd < 0) {
+            return nullptr;
+        }
+        auto source = DispatchSource::makeFileSystemObjectSource(fd, DispatchSource::FileSystemEvent(_mask()), &_queue);
+        if (!source) {
+            close(fd);
+            return nullptr;
+        }
+        source->setCancelHandler(^{
+            close(fd);
+        });
+        return source;
+#endif
+    }
+
+    inline bool _arm(const std::string& path) {
+        auto source = _makeSource(path);
+        if (!source) {
+            return false;
+        }
+        auto weakSelf = std::weak_ptr<_DispatchFileWatcherState>(shared_from_this());
+        auto weakSource = std::weak_ptr<DispatchSourceFileSystemObject>(source);
+        auto watched = path;
+        source->setEventHandler(^{
+            auto state = weakSelf.lock();
+            auto eventSource = weakSource.lock();
+            if (state && eventSource) {
+                state->_changedPath(watched, eventSource->getData());
+            }
+        });
+        source->resume();
+        _sources[path] = source;
+        return true;
+    }
+
+    inline void _changedPath(const std::string& path, uint events) {
+        auto entry = _sources.find(path);
+        if (entry == _sources.end()) {
+            return;
+        }
+        _events++;
+        _changed.insert(path);
+        if ((events & _goneMask()) != 0) {
+            entry->second->cancel();
+            _sources.erase(entry);
+            _missing.insert(path);
+        }
+        // Trailing debounce: the reload waits for a quiet period.
+        _pending = true;
+        _timer->schedule(DispatchTime::now() + _debounce);
+    }
+
+    inline void _scheduleRearm() {
+        if (!_pending) {
+            _timer->schedule(DispatchTime::now() + DispatchTimeInterval::milliseconds(DISPATCH_FILE_WATCHER_REARM_INTERVAL_MS));
+        }
+    }
+
+    inline void _fire() {
+        _pending = false;
+        for (auto it = _missing.begin(); it != _missing.end();) {
+            auto path = *it;
+            if (_arm(path)) {
+                it = _missing.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (!_changed.empty()) {
+            auto paths = std::vector<std::string>(_changed.begin(), _changed.end());
+            _changed.clear();
+            _reloads++;
+            auto handler = _handler;
+            _userQueue.async(^{
+                handler.get()(paths);
+            });
+        }
+
+        if (_missing.empty()) {
+            _timer->schedule(DispatchTime::distantFuture());
+        } else {
+            _scheduleRearm();
+        }
+    }
+
+};
+
+///
+/// Watches many files, and reports bursts of changes to them as one reload.
+///
+/// Each path has a file system object source (inotify on Linux, which needs no
+/// descriptor per file; a vnode source elsewhere). Changes are collected, and
+/// once no event has come for `debounce`, the reload handler is invoked with
+/// the paths that changed.
+///
+/// A file replaced by renaming another over it, as editors and deploy tools
+/// do, is seen as the old file going away: the watcher re-arms on the new file
+/// at the next reload. Paths that do not exist (yet) are looked for every
+/// second, and reported as changed once they appear.
+///
+class DispatchFileWatcher {
+
+public:
+
+    typedef _DispatchFileWatcherState::ReloadHandler ReloadHandler;
+
+    inline DispatchFileWatcher(
+            const DispatchQueue& queue,
+            ReloadHandler handler,
+            const DispatchTimeInterval& debounce = DispatchTimeInterval::milliseconds(DISPATCH_FILE_WATCHER_DEFAULT_DEBOUNCE_MS))
+    {
+        _state = std::make_shared<_DispatchFileWatcherState>(queue, handler, debounce);
+        auto state = _state;
+        state->_queue.async(^{
+            state->_start();
+        });
+    }
+
+    DispatchFileWatcher(const DispatchFileWatcher&) = delete;
+    DispatchFileWatcher& operator= (const DispatchFileWatcher&) = delete;
+
+    inline ~DispatchFileWatcher() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    inline void watch(const std::string& path) {
+        auto state = _state;
+        auto watched = path;
+        state->_queue.async(^{
+            state->_watch(watched);
+        });
+    }
+
+    inline void watch(const std::vector<std::string>& paths) {
+        auto state = _state;
+        auto watched = paths;
+        state->_queue.async(^{
+            for (auto& path : watched) {
+                state->_watch(path);
+            }
+        });
+    }
+
+    inline void unwatch(const std::string& path) {
+        auto state = _state;
+        auto unwatched = path;
+        state->_queue.async(^{
+            state->_unwatch(unwatched);
+        });
+    }
+
+    /// The number of reloads reported so far.
+    [[nodiscard]] inline uint64_t reloads() const {
+        return _state->_reloads.load();
+    }
+
+    /// The number of file system events received so far.
+    [[nodiscard]] inline uint64_t events() const {
+        return _state->_events.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchFileWatcherState> _state;
+
+};
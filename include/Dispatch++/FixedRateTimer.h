@@ -0,0 +1,251 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+
+class _DispatchFixedRateTimerState: public std::enable_shared_from_this<_DispatchFixedRateTimerState> {
+
+public:
+
+    enum struct Clock {
+        /// Monotonic time, as `DispatchTime`; the timer is unaffected by changes to the clock.
+        MONOTONIC,
+        /// Wall clock time, as `DispatchWallTime`; deadlines follow changes to the clock.
+        WALL
+    };
+
+    enum struct MissedTicks {
+        /// Runs once, for the latest tick due, and skips the earlier ones.
+        SKIP,
+        /// Runs once for each tick due, back to back.
+        FIRE_ALL,
+        /// Runs once, for all the ticks due together.
+        COALESCE
+    };
+
+    /// Invoked with the tick, counted from 0 at the epoch, and the number of ticks it stands for.
+    typedef void (^TickHandler)(uint64_t tick, uint64_t count);
+
+    inline _DispatchFixedRateTimerState(
+            const DispatchQueue& queue,
+            int64_t interval,
+            int64_t leeway,
+            Clock clock,
+            MissedTicks policy,
+            TickHandler handler)
+        : _queue(queue), _interval(interval), _leeway(leeway), _clock(clock), _policy(policy), _handler(handler) {}
+
+    DispatchQueue _queue;
+    int64_t _interval;
+    int64_t _leeway;
+    Clock _clock;
+    MissedTicks _policy;
+    _DispatchRetainedBlock<TickHandler> _handler;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    // The time of tick 0, on `_clock`, and the next tick to run.
+    int64_t _epoch {0};
+    uint64_t _next {0};
+    std::atomic<uint64_t> _fires {0};
+    std::atomic<uint64_t> _skipped {0};
+    std::atomic<int64_t> _lastLateness {0};
+    std::atomic<int64_t> _maxLateness {0};
+    std::atomic<int64_t> _totalLateness {0};
+    std::atomic<uint64_t> _wakeups {0};
+
+    inline int64_t _now() const {
+        timespec now {};
+        clock_gettime(_clock == Clock::WALL ? CLOCK_REALTIME : CLOCK_MONOTONIC, &now);
+        return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    inline void _start(int64_t delay) {
+        auto weakSelf = std::weak_ptr<_DispatchFixedRateTimerState>(shared_from_this());
+        auto flags = _leeway == 0 ? DispatchSource::TimerFlags::STRICT : DispatchSource::TimerFlags::NONE;
+        _timer = DispatchSource::makeTimerSource(flags, &_queue);
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_fire();
+            }
+        });
+        _epoch = _now() + delay;
+        _next = 0;
+        _schedule();
+        _timer->resume();
+    }
+
+    inline void _cancel() {
+        if (_timer) {
+            _timer->cancel();
+        }
+    }
+
+    // Each deadline is computed from the epoch, never from the previous fire, so errors do not add up.
+    inline void _schedule() {
+        auto deadline = _epoch + int64_t(_next) * _interval;
+        auto leeway = DispatchTimeInterval::nanoseconds(_leeway);
+        if (_clock == Clock::WALL) {
+            timespec when {};
+            when.tv_sec = time_t(deadline / 1000000000);
+            when.tv_nsec = long(deadline % 1000000000);
+            _timer->schedule(DispatchWallTime(when), DispatchTimeInterval::never(), leeway);
+        } else {
+            auto delay = std::max<int64_t>(deadline - _now(), 0);
+            _timer->schedule(DispatchTime::now() + DispatchTimeInterval::nanoseconds(delay), DispatchTimeInterval::never(), leeway);
+        }
+    }
+
+    // Runs on the target queue.
+    inline void _fire() {
+        auto now = _now();
+        if (now < _epoch + int64_t(_next) * _interval) {
+            // Woken early, as the wall clock was set back: wait for the tick again.
+            _schedule();
+            return;
+        }
+        _wakeups++;
+        auto due = uint64_t((now - _epoch) / _interval);
+        auto count = due - _next + 1;
+        _record(now - (_epoch + int64_t(_next) * _interval));
+
+        switch (_policy) {
+            case MissedTicks::SKIP:
+                _skipped += count - 1;
+                _fires++;
+                _handler.get()(due, 1);
+                break;
+            case MissedTicks::FIRE_ALL:
+                for (auto tick = _next; tick <= due; tick++) {
+                    _fires++;
+                    _handler.get()(tick, 1);
+                }
+                break;
+            case MissedTicks::COALESCE:
+                _fires++;
+                _handler.get()(due, count);
+                break;
+        }
+        _next = due + 1;
+        if (!_timer->isCancelled()) {
+            _schedule();
+        }
+    }
+
+    // The lateness of a wakeup, against the tick it was programmed for.
+    inline void _record(int64_t lateness) {
+        _lastLateness = lateness;
+        _totalLateness += lateness;
+        if (lateness > _maxLateness.load()) {
+            _maxLateness = lateness;
+        }
+    }
+
+};
+
+///
+/// A timer that fires at a fixed rate, without drift.
+///
+/// A repeating timer source schedules each fire from the previous one, so the errors
+/// of each fire add up over time. This timer computes tick `n` as `epoch + n * interval`
+/// and programs the source for each tick in turn, so a late fire delays only that tick.
+///
+/// When the timer falls behind by more than a tick, as after a stall of the target queue,
+/// its `MissedTicks` policy chooses whether the ticks due are skipped, all run, or run
+/// once together. The lateness of each wakeup against its tick is recorded.
+///
+/// With no leeway the source is `STRICT`, for the least jitter.
+///
+class DispatchFixedRateTimer {
+
+public:
+
+    typedef _DispatchFixedRateTimerState::Clock Clock;
+    typedef _DispatchFixedRateTimerState::MissedTicks MissedTicks;
+    typedef _DispatchFixedRateTimerState::TickHandler TickHandler;
+
+    ///
+    /// - parameter queue: The queue the handler is invoked on.
+    /// - parameter interval: The time between two ticks.
+    /// - parameter handler: Invoked for the ticks, as the policy decides.
+    /// - parameter policy: What to do with the ticks missed during a stall.
+    /// - parameter leeway: How late a tick may fire, to save power.
+    /// - parameter clock: The clock the ticks are counted on.
+    ///
+    inline DispatchFixedRateTimer(
+            const DispatchQueue& queue,
+            const DispatchTimeInterval& interval,
+            TickHandler handler,
+            MissedTicks policy = MissedTicks::SKIP,
+            const DispatchTimeInterval& leeway = DispatchTimeInterval::nanoseconds(0),
+            Clock clock = Clock::MONOTONIC)
+    {
+        _state = std::make_shared<_DispatchFixedRateTimerState>(
+                queue, std::max<int64_t>(interval.rawValue, 1), std::max<int64_t>(leeway.rawValue, 0), clock, policy, handler);
+    }
+
+    DispatchFixedRateTimer(const DispatchFixedRateTimer&) = delete;
+    DispatchFixedRateTimer& operator= (const DispatchFixedRateTimer&) = delete;
+
+    inline ~DispatchFixedRateTimer() {
+        _state->_cancel();
+    }
+
+    /// Starts the timer, with tick 0 an interval from now.
+    inline void start() {
+        start(DispatchTimeInterval::nanoseconds(_state->_interval));
+    }
+
+    /// Starts the timer, with tick 0 after `delay`.
+    inline void start(const DispatchTimeInterval& delay) {
+        _state->_start(std::max<int64_t>(delay.rawValue, 0));
+    }
+
+    inline void cancel() {
+        _state->_cancel();
+    }
+
+    /// The number of times the handler has been invoked.
+    [[nodiscard]] inline uint64_t fires() const {
+        return _state->_fires.load();
+    }
+
+    /// The number of ticks skipped under `SKIP`.
+    [[nodiscard]] inline uint64_t skipped() const {
+        return _state->_skipped.load();
+    }
+
+    /// How late the last wakeup was.
+    [[nodiscard]] inline DispatchTimeInterval lastLateness() const {
+        return DispatchTimeInterval::nanoseconds(_state->_lastLateness.load());
+    }
+
+    /// How late the latest wakeup so far was.
+    [[nodiscard]] inline DispatchTimeInterval maxLateness() const {
+        return DispatchTimeInterval::nanoseconds(_state->_maxLateness.load());
+    }
+
+    /// How late the wakeups were on average.
+    [[nodiscard]] inline DispatchTimeInterval meanLateness() const {
+        auto wakeups = _state->_wakeups.load();
+        return DispatchTimeInterval::nanoseconds(wakeups == 0 ? 0 : _state->_totalLateness.load() / int64_t(wakeups));
+    }
+
+private:
+
+    std::shared_ptr<_DispatchFixedRateTimerState> _state;
+
+};
@@ -156,6 +156,36 @@ public:
                 });
     }
 
+    ///
+    /// Copies bytes from one file descriptor to another without passing them
+    /// through a `DispatchData`.
+    ///
+    /// Where the descriptor types allow it the copy stays in the kernel: `copy_file_range`
+    /// between two regular files, `splice` when either end is a pipe, and `sendfile` from a
+    /// regular file to anything else. When no zero-copy call applies, when either descriptor
+    /// is non-blocking, or when the kernel refuses the call before any byte was copied, the
+    /// transfer falls back to the `read(fromFileDescriptor:)` / `write(toFileDescriptor:)`
+    /// path. Both descriptors are used at their current offsets.
+    ///
+    /// The zero-copy calls run one chunk at a time on a utility queue, so a long transfer never
+    /// holds a worker thread for its whole length; a pipe that is not ready is waited on with a
+    /// dispatch source rather than a blocked `splice`.
+    ///
+    /// - parameter fromFileDescriptor: The descriptor to read from.
+    /// - parameter toFileDescriptor: The descriptor to write to.
+    /// - parameter length: The number of bytes to copy, or `SIZE_MAX` to copy until end-of-file.
+    /// - parameter queue: The queue on which `progress` is invoked.
+    /// - parameter progress: Invoked with `done` set to false after each intermediate chunk, and
+    ///     exactly once with `done` set to true when the transfer ends. `transferred` is the total
+    ///     number of bytes copied so far; `error` is an errno value, or 0.
+    ///
+    static void transfer(
+            int fromFileDescriptor,
+            int toFileDescriptor,
+            size_t length,
+            const DispatchQueue& queue,
+            void (^progress)(bool done, size_t transferred, int error));
+
     inline void setInterval(const DispatchTimeInterval& interval, IntervalFlags flags = IntervalFlags::NONE) {
         dispatch_io_set_interval(_wrapped, interval.rawValue, dispatch_io_interval_flags_t(flags));
     }
@@ -193,3 +223,22 @@ private:
 
 };
 
+/// Reads `length` bytes at `offset` from `channel` and hands them to `handler` in
+/// one piece, rather than in the chunks `DispatchIO::read` delivers as they arrive.
+inline void _dispatchIOReadFully(
+        DispatchIO& channel,
+        off_t offset,
+        size_t length,
+        const DispatchQueue& queue,
+        void (^handler)(const std::shared_ptr<DispatchData> data, int error))
+{
+    auto accumulated = std::make_shared<DispatchData>();
+    channel.read(offset, int(length), queue, ^(bool done, const std::shared_ptr<DispatchData> data, int error) {
+        if (data) {
+            accumulated->append(*data);
+        }
+        if (done) {
+            handler(accumulated, error);
+        }
+    });
+}
@@ -0,0 +1,189 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/IO.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#define DISPATCH_IO_SCHEDULER_DEFAULT_MAX_COALESCED_SIZE (256 * 1024)
+
+typedef void (^DispatchIOSchedulerHandler)(bool done, const std::shared_ptr<DispatchData> data, int error);
+
+struct _DispatchIOSchedulerRequest {
+
+    _DispatchIOSchedulerRequest(off_t offset, size_t length, const DispatchQueue& queue, DispatchIOSchedulerHandler handler)
+        : offset(offset), length(length), queue(queue), handler(handler) {}
+
+    off_t offset;
+    size_t length;
+    DispatchQueue queue;
+    _DispatchRetainedBlock<DispatchIOSchedulerHandler> handler;
+
+};
+
+class _DispatchIOSchedulerState: public std::enable_shared_from_this<_DispatchIOSchedulerState> {
+
+public:
+
+    inline _DispatchIOSchedulerState(const DispatchIO& channel, const DispatchTimeInterval& mergeWindow, size_t maxCoalescedSize)
+        : _channel(channel), _mergeWindow(mergeWindow), _maxCoalescedSize(std::max(maxCoalescedSize, size_t(1))) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.IOScheduler"};
+    std::atomic<uint64_t> _requested {0};
+    std::atomic<uint64_t> _issued {0};
+
+    inline void _enqueue(const std::shared_ptr<_DispatchIOSchedulerRequest>& request) {
+        _requested++;
+        _pending.push_back(request);
+        if (_pending.size() > 1) {
+            return;
+        }
+
+        // The first request of a batch opens the merge window; it closes only that batch,
+        // not a later one when an explicit flush got there first.
+        auto weakSelf = std::weak_ptr<_DispatchIOSchedulerState>(shared_from_this());
+        auto batch = _batch;
+        _queue.asyncAfter(DispatchTime::now() + _mergeWindow, ^{
+            auto state = weakSelf.lock();
+            if (state && state->_batch == batch) {
+                state->_flush();
+            }
+        });
+    }
+
+    inline void _flush() {
+        auto batch = std::move(_pending);
+        _pending.clear();
+        if (batch.empty()) {
+            return;
+        }
+        _batch++;
+
+        std::stable_sort(batch.begin(), batch.end(), [](const auto& a, const auto& b) {
+            return a->offset < b->offset;
+        });
+
+        size_t first = 0;
+        auto start = batch[0]->offset;
+        auto end = start + off_t(batch[0]->length);
+        for (size_t i = 1; i < batch.size(); i++) {
+            auto& request = batch[i];
+            auto requestEnd = request->offset + off_t(request->length);
+            // Adjacent or overlapping, and still within the coalescing limit.
+            if (request->offset <= end && size_t(std::max(end, requestEnd) - start) <= _maxCoalescedSize) {
+                end = std::max(end, requestEnd);
+                continue;
+            }
+            _issue(start, end, std::vector<std::shared_ptr<_DispatchIOSchedulerRequest>>(batch.begin() + first, batch.begin() + i));
+            first = i;
+            start = request->offset;
+            end = requestEnd;
+        }
+        _issue(start, end, std::vector<std::shared_ptr<_DispatchIOSchedulerRequest>>(batch.begin() + first, batch.end()));
+    }
+
+private:
+
+    DispatchIO _channel;
+    DispatchTimeInterval _mergeWindow;
+    size_t _maxCoalescedSize;
+
+    std::vector<std::shared_ptr<_DispatchIOSchedulerRequest>> _pending;
+    // Counts the batches flushed, so a merge window outlived by its batch does nothing.
+    uint64_t _batch {0};
+
+    inline void _issue(off_t start, off_t end, std::vector<std::shared_ptr<_DispatchIOSchedulerRequest>> requests) {
+        _issued++;
+        auto group = std::make_shared<std::vector<std::shared_ptr<_DispatchIOSchedulerRequest>>>(std::move(requests));
+        _dispatchIOReadFully(_channel, start, size_t(end - start), _queue, ^(const std::shared_ptr<DispatchData> data, int error) {
+            for (auto& request : *group) {
+                auto handler = request->handler;
+                if (error != 0) {
+                    request->queue.async(^{
+                        handler.get()(true, nullptr, error);
+                    });
+                    continue;
+                }
+
+                // A short read leaves the requests past the end of the file empty.
+                auto count = data->count();
+                auto from = std::min(size_t(request->offset - start), count);
+                auto to = std::min(from + request->length, count);
+                auto piece = std::make_shared<DispatchData>(data->subdata(int(from), int(to)));
+                request->queue.async(^{
+                    handler.get()(true, piece, 0);
+                });
+            }
+        });
+    }
+
+};
+
+///
+/// A scheduling layer in front of a `RANDOM` `DispatchIO` channel that merges
+/// nearby reads.
+///
+/// Reads submitted within `mergeWindow` of the first pending one are collected,
+/// sorted by offset, and adjacent or overlapping ranges are coalesced into single
+/// channel reads of at most `maxCoalescedSize` bytes (a request larger than that is
+/// issued on its own). Each caller receives its own range, cut out of the merged
+/// read with `subdata`.
+///
+/// Each `read` invokes its handler once, with `done` set and all of the data.
+///
+class DispatchIOReadScheduler {
+
+public:
+
+    inline DispatchIOReadScheduler(
+            const DispatchIO& channel,
+            const DispatchTimeInterval& mergeWindow,
+            size_t maxCoalescedSize = DISPATCH_IO_SCHEDULER_DEFAULT_MAX_COALESCED_SIZE)
+    {
+        _state = std::make_shared<_DispatchIOSchedulerState>(channel, mergeWindow, maxCoalescedSize);
+    }
+
+    inline void read(off_t offset, int length, const DispatchQueue& queue, DispatchIOSchedulerHandler ioHandler) {
+        auto state = _state;
+        auto request = std::make_shared<_DispatchIOSchedulerRequest>(offset, size_t(length), queue, ioHandler);
+        state->_queue.async(^{
+            state->_enqueue(request);
+        });
+    }
+
+    /// Issues the pending reads now instead of at the end of the merge window.
+    inline void flush() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_flush();
+        });
+    }
+
+    /// The number of reads submitted to the scheduler.
+    [[nodiscard]] inline uint64_t requestedReads() const {
+        return _state->_requested.load();
+    }
+
+    /// The number of reads the scheduler issued on the channel.
+    [[nodiscard]] inline uint64_t issuedReads() const {
+        return _state->_issued.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchIOSchedulerState> _state;
+
+};
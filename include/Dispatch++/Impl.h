@@ -8,6 +8,18 @@
 #pragma once
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
 #include "Data.h"
 #include "Queue.h"
 #include "Block.h"
@@ -83,6 +95,34 @@ inline DispatchData::DispatchData(const void *bytesNoCopy, int count, const Disp
             );
 }
 
+inline DispatchData DispatchData::aligned(
+        size_t count,
+        size_t alignment,
+        DISPATCH_NOESCAPE void (^initializer)(void *bytes, size_t capacity))
+{
+    alignment = std::max(alignment, sizeof(void *));
+    auto capacity = std::max((count + alignment - 1) / alignment * alignment, alignment);
+    void *buffer = nullptr;
+    [[maybe_unused]] auto result = posix_memalign(&buffer, alignment, capacity);
+    DISPATCH_ASSERT(result == 0, "aligned allocation failed");
+    memset(buffer, 0, capacity);
+    if (initializer) {
+        initializer(buffer, capacity);
+    }
+    return DispatchData(buffer, int(count), Deallocator::FREE);
+}
+
+inline bool DispatchData::isAligned(size_t alignment) const {
+    __block size_t regions = 0;
+    __block bool aligned = true;
+    dispatch_data_apply(_wrapped, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+        regions++;
+        aligned = uintptr_t(buffer) % alignment == 0;
+        return regions == 1;
+    });
+    return regions <= 1 && aligned;
+}
+
 inline void DispatchData::append(const void *bytes, size_t count) {
     // Nil base address does nothing.
     if (bytes == nullptr) { return; }
@@ -170,6 +210,226 @@ inline DispatchIO::DispatchIO(uint type, const DispatchIO& io, const DispatchQue
     _wrapped = dispatch_io_create_with_io(dispatch_io_type_t(type), io._wrapped, queue._wrapped, handler);
 }
 
+#define DISPATCH_IO_TRANSFER_CHUNK_SIZE (1024 * 1024)
+
+enum class _DispatchIOTransferMethod {
+    READ_WRITE,
+    COPY_FILE_RANGE,
+    SENDFILE,
+    SPLICE
+};
+
+inline static _DispatchIOTransferMethod _dispatchIOTransferMethod(int fromFileDescriptor, int toFileDescriptor) {
+#if defined(__linux__)
+    struct stat fromStat {};
+    struct stat toStat {};
+    if (fstat(fromFileDescriptor, &fromStat) != 0 || fstat(toFileDescriptor, &toStat) != 0) {
+        return _DispatchIOTransferMethod::READ_WRITE;
+    }
+
+    // Each zero-copy chunk blocks a worker thread until the kernel is done with it,
+    // non-blocking descriptors are left to the source driven path.
+    if ((fcntl(fromFileDescriptor, F_GETFL) & O_NONBLOCK) || (fcntl(toFileDescriptor, F_GETFL) & O_NONBLOCK)) {
+        return _DispatchIOTransferMethod::READ_WRITE;
+    }
+
+    if (S_ISFIFO(fromStat.st_mode) || S_ISFIFO(toStat.st_mode)) {
+        return _DispatchIOTransferMethod::SPLICE;
+    }
+    if (S_ISREG(fromStat.st_mode) && S_ISREG(toStat.st_mode)) {
+        return _DispatchIOTransferMethod::COPY_FILE_RANGE;
+    }
+    if (S_ISREG(fromStat.st_mode)) {
+        return _DispatchIOTransferMethod::SENDFILE;
+    }
+#endif
+    return _DispatchIOTransferMethod::READ_WRITE;
+}
+
+inline static ssize_t _dispatchIOTransferChunk(
+        _DispatchIOTransferMethod method,
+        int fromFileDescriptor,
+        int toFileDescriptor,
+        size_t size)
+{
+#if defined(__linux__)
+    switch (method) {
+        case _DispatchIOTransferMethod::COPY_FILE_RANGE:
+            return copy_file_range(fromFileDescriptor, nullptr, toFileDescriptor, nullptr, size, 0);
+        case _DispatchIOTransferMethod::SENDFILE:
+            return sendfile(toFileDescriptor, fromFileDescriptor, nullptr, size);
+        case _DispatchIOTransferMethod::SPLICE:
+            return splice(fromFileDescriptor, nullptr, toFileDescriptor, nullptr, size, SPLICE_F_MOVE | SPLICE_F_MORE);
+        case _DispatchIOTransferMethod::READ_WRITE:
+            break;
+    }
+#endif
+    errno = ENOSYS;
+    return -1;
+}
+
+// Errors returned by a zero-copy call that only mean "not for these descriptors".
+inline static bool _dispatchIOTransferShouldFallback(int error) {
+    return error == EINVAL || error == ENOSYS || error == EXDEV || error == EOPNOTSUPP || error == EBADF;
+}
+
+inline static void _dispatchIOTransferReadWrite(
+        int fromFileDescriptor,
+        int toFileDescriptor,
+        size_t remaining,
+        size_t transferred,
+        const DispatchQueue& queue,
+        void (^progress)(bool, size_t, int))
+{
+    auto size = std::min(remaining, size_t(DISPATCH_IO_TRANSFER_CHUNK_SIZE));
+    // A copy, retaining the queue: the handlers run after the caller's reference may be gone.
+    auto target = queue;
+    dispatch_read(dispatch_fd_t(fromFileDescriptor), size, target._wrapped, ^(dispatch_data_t data, int error) {
+        auto count = dispatch_data_get_size(data);
+        if (error != 0 || count == 0) {
+            progress(true, transferred, error);
+            return;
+        }
+
+        dispatch_write(dispatch_fd_t(toFileDescriptor), data, target._wrapped, ^(dispatch_data_t _Nullable rest, int writeError) {
+            auto written = count - (rest == nullptr ? 0 : dispatch_data_get_size(rest));
+            auto total = transferred + written;
+            if (writeError != 0 || written == remaining || count < size) {
+                progress(true, total, writeError);
+                return;
+            }
+
+            progress(false, total, 0);
+            _dispatchIOTransferReadWrite(fromFileDescriptor, toFileDescriptor, remaining - written, total, target, progress);
+        });
+    });
+}
+
+// A zero-copy transfer, one chunk per block on a utility queue so no worker is held for
+// the whole copy. Splices do not block on the pipe: a pipe that is not ready is waited on
+// with a source, and the transfer goes on from its event.
+class _DispatchIOTransfer: public std::enable_shared_from_this<_DispatchIOTransfer> {
+
+public:
+
+    inline _DispatchIOTransfer(
+            _DispatchIOTransferMethod method,
+            int fromFileDescriptor,
+            int toFileDescriptor,
+            size_t length,
+            const DispatchQueue& queue,
+            void (^progress)(bool, size_t, int))
+        : _method(method), _from(fromFileDescriptor), _to(toFileDescriptor), _length(length), _target(queue),
+          _progress(progress) {}
+
+    inline void _schedule() {
+        auto transfer = shared_from_this();
+        DispatchQueue::global(DispatchQoS::QoSClass::UTILITY).async(^{
+            transfer->_step();
+        });
+    }
+
+private:
+
+    _DispatchIOTransferMethod _method;
+    int _from;
+    int _to;
+    size_t _length;
+    DispatchQueue _target;
+    _DispatchRetainedBlock<void (^)(bool, size_t, int)> _progress;
+    size_t _transferred {0};
+    std::shared_ptr<DispatchSourceProtocol> _waitSource;
+
+    inline void _step() {
+        if (_transferred >= _length) {
+            _report(true, 0);
+            return;
+        }
+        auto size = std::min(_length - _transferred, size_t(DISPATCH_IO_TRANSFER_CHUNK_SIZE));
+        ssize_t n;
+#if defined(__linux__)
+        if (_method == _DispatchIOTransferMethod::SPLICE) {
+            n = splice(_from, nullptr, _to, nullptr, size, SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+        } else
+#endif
+        {
+            n = _dispatchIOTransferChunk(_method, _from, _to, size);
+        }
+        if (n < 0) {
+            auto error = errno;
+            if (error == EINTR) {
+                _schedule();
+            } else if (error == EAGAIN && _method == _DispatchIOTransferMethod::SPLICE) {
+                _wait();
+            } else if (_transferred == 0 && _dispatchIOTransferShouldFallback(error)) {
+                _dispatchIOTransferReadWrite(_from, _to, _length, 0, _target, _progress.get());
+            } else {
+                _report(true, error);
+            }
+            return;
+        }
+        if (n == 0) {
+            _report(true, 0);
+            return;
+        }
+
+        _transferred += size_t(n);
+        if (_transferred < _length) {
+            _report(false, 0);
+        }
+        _schedule();
+    }
+
+    // Waits for the pipe end that is not ready: the source, unless it has data, or else the destination.
+    inline void _wait() {
+        struct stat fromStat {};
+        struct pollfd readable = {_from, POLLIN, 0};
+        auto fromIsPipe = fstat(_from, &fromStat) == 0 && S_ISFIFO(fromStat.st_mode);
+        auto queue = DispatchQueue::global(DispatchQoS::QoSClass::UTILITY);
+        std::shared_ptr<DispatchSourceProtocol> source;
+        if (fromIsPipe && poll(&readable, 1, 0) == 0) {
+            source = DispatchSource::makeReadSource(_from, &queue);
+        } else {
+            source = DispatchSource::makeWriteSource(_to, &queue);
+        }
+        _waitSource = source;
+        auto transfer = shared_from_this();
+        source->setEventHandler(^{
+            // The source refers back to the transfer; dropping it breaks the cycle.
+            auto waited = std::move(transfer->_waitSource);
+            if (waited) {
+                waited->cancel();
+                transfer->_step();
+            }
+        });
+        source->resume();
+    }
+
+    inline void _report(bool done, int error) {
+        auto progress = _progress;
+        auto transferred = _transferred;
+        _target.async(^{
+            progress.get()(done, transferred, error);
+        });
+    }
+
+};
+
+inline void DispatchIO::transfer(
+        int fromFileDescriptor,
+        int toFileDescriptor,
+        size_t length,
+        const DispatchQueue& queue,
+        void (^progress)(bool, size_t, int))
+{
+    auto method = _dispatchIOTransferMethod(fromFileDescriptor, toFileDescriptor);
+    if (method == _DispatchIOTransferMethod::READ_WRITE) {
+        _dispatchIOTransferReadWrite(fromFileDescriptor, toFileDescriptor, length, 0, queue, progress);
+        return;
+    }
+    std::make_shared<_DispatchIOTransfer>(method, fromFileDescriptor, toFileDescriptor, length, queue, progress)->_schedule();
+}
+
 // MARK: - DispatchObject
 
 inline void DispatchObject::setTarget(const DispatchQueue& queue)  {
@@ -378,6 +638,75 @@ inline std::shared_ptr<DispatchSourceWrite> DispatchSource::makeWriteSource(int3
     return std::shared_ptr<DispatchSourceWrite>(new DispatchSource(source));
 }
 
+inline std::shared_ptr<DispatchSourceFileSystemObject> DispatchSource::makeFileSystemObjectSource(
+        int32_t fileDescriptor,
+        FileSystemEvent eventMask,
+        const DispatchQueue *queue)
+{
+#if defined(__linux__)
+    // The watch follows the descriptor's link to its inode.
+    auto path = "/proc/self/fd/" + std::to_string(fileDescriptor);
+    return _DispatchInotifySource::make(path.c_str(), fileDescriptor, uint(eventMask), queue);
+#else
+    auto handle = uint(fileDescriptor);
+    auto wrapped = queue == nullptr ? nullptr : queue->_wrapped;
+    auto source = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, handle, uint(eventMask), wrapped);
+    if (source == nullptr) {
+        return nullptr;
+    }
+
+    return std::shared_ptr<DispatchSourceFileSystemObject>(new DispatchSource(source));
+#endif
+}
+
+inline std::shared_ptr<DispatchSourceProcess> DispatchSource::makeProcessSource(
+        pid_t pid,
+        ProcessEvent eventMask,
+        const DispatchQueue *queue)
+{
+#if DISPATCH_HAVE_PIDFD
+    if ((uint(eventMask) & uint(ProcessEvent::EXIT)) == 0) {
+        return nullptr;
+    }
+    auto pidfd = int(syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd < 0) {
+        return nullptr;
+    }
+    return std::make_shared<_DispatchPidfdSource>(pid, pidfd, queue);
+#else
+    auto handle = uint(pid);
+    auto wrapped = queue == nullptr ? nullptr : queue->_wrapped;
+    auto source = dispatch_source_create(DISPATCH_SOURCE_TYPE_PROC, handle, uint(eventMask), wrapped);
+    if (source == nullptr) {
+        return nullptr;
+    }
+
+    return std::shared_ptr<DispatchSourceProcess>(new DispatchSource(source));
+#endif
+}
+
+inline std::shared_ptr<DispatchSourceMemoryPressure> DispatchSource::makeMemoryPressureSource(
+        MemoryPressureEvent eventMask,
+        const DispatchQueue *queue)
+{
+#if defined(__linux__)
+    auto path = _DispatchCgroupMemoryPressureSource::eventsPath();
+    if (path.empty()) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    return _DispatchCgroupMemoryPressureSource::make(path, uint(eventMask), queue);
+#else
+    auto wrapped = queue == nullptr ? nullptr : queue->_wrapped;
+    auto source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, uint(eventMask), wrapped);
+    if (source == nullptr) {
+        return nullptr;
+    }
+
+    return std::shared_ptr<DispatchSourceMemoryPressure>(new DispatchSource(source));
+#endif
+}
+
 // MARK: - DispatchTime
 
 inline DispatchTime& DispatchTime::distantFuture() {
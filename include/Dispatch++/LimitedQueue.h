@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Utils.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class _DispatchLimitedQueueState: public std::enable_shared_from_this<_DispatchLimitedQueueState> {
+
+public:
+
+    struct _Node {
+        _DispatchRetainedBlock<DispatchBlock> work;
+        std::atomic<_Node *> next {nullptr};
+    };
+
+    inline _DispatchLimitedQueueState(const DispatchQueue& target, size_t maxConcurrent)
+        : _target(target), _maxConcurrent(std::max<size_t>(maxConcurrent, 1)) {}
+
+    inline ~_DispatchLimitedQueueState() {
+        while (_head != nullptr) {
+            auto next = _head->next.load();
+            delete _head;
+            _head = next;
+        }
+    }
+
+    DispatchQueue _target;
+    std::atomic<size_t> _maxConcurrent;
+    // A linked list with a dummy head: producers swap the tail, the one starting work takes from the head.
+    _Node *_head {new _Node()};
+    std::atomic<_Node *> _tail {_head};
+    // The work items linked and not yet claimed, and the slots claimed by running work.
+    std::atomic<int64_t> _queued {0};
+    std::atomic<size_t> _active {0};
+    // The work items to start; whoever raises it from zero starts them all.
+    std::atomic<int64_t> _starts {0};
+    std::atomic<size_t> _pending {0};
+    std::atomic<size_t> _running {0};
+    std::atomic<uint64_t> _completed {0};
+
+    inline void _async(DispatchBlock work) {
+        auto node = new _Node();
+        node->work = _DispatchRetainedBlock<DispatchBlock>(work);
+        _pending++;
+        auto previous = _tail.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+
+        // Counted once linked, so a start always finds its item.
+        _queued++;
+        _schedule();
+    }
+
+    // Raising the limit starts waiting work at once; lowering it lets the running work finish.
+    inline void _setMaxConcurrent(size_t maxConcurrent) {
+        _maxConcurrent = std::max<size_t>(maxConcurrent, 1);
+        _schedule();
+    }
+
+private:
+
+    // Starts work while both a slot and an item can be claimed. Each submission and each
+    // completion calls it after its own change, so one of them always sees both.
+    inline void _schedule() {
+        while (_queued.load() > 0) {
+            auto active = _active.load();
+            if (active >= _maxConcurrent.load()) {
+                return;
+            }
+            if (!_active.compare_exchange_weak(active, active + 1)) {
+                continue;
+            }
+            if (_queued.fetch_sub(1) > 0) {
+                _start();
+                continue;
+            }
+            // Another one took the item: give the slot back, and look again.
+            _queued++;
+            _active--;
+        }
+    }
+
+    inline void _start() {
+        if (_starts.fetch_add(1, std::memory_order_acq_rel) != 0) {
+            return;
+        }
+        auto state = shared_from_this();
+        do {
+            auto work = _pop();
+            _target.async(^{
+                state->_running++;
+                work.get()();
+                state->_running--;
+                state->_completed++;
+                state->_active--;
+                state->_schedule();
+            });
+        } while (_starts.fetch_sub(1, std::memory_order_acq_rel) > 1);
+    }
+
+    inline _DispatchRetainedBlock<DispatchBlock> _pop() {
+        auto next = _head->next.load(std::memory_order_acquire);
+        // An item counted is linked, but one ahead of it may still be in the middle of its push.
+        while (next == nullptr) {
+            dispatchCPURelax();
+            next = _head->next.load(std::memory_order_acquire);
+        }
+        auto work = next->work;
+        next->work = _DispatchRetainedBlock<DispatchBlock>();
+        delete _head;
+        _head = next;
+        _pending--;
+        return work;
+    }
+
+};
+
+///
+/// A queue that runs at most a number of work items at once, on a target queue.
+///
+/// Limiting a concurrent queue with a semaphore `wait` in each work item parks a worker
+/// thread per waiting item, and the pool grows a thread for each. This queue holds the
+/// work items in a lock-free list instead, and submits one to the target queue only when
+/// fewer than `maxConcurrent` are running; each completion submits the next. No thread
+/// ever waits for a slot.
+///
+/// Work items start in submission order, and with a limit of 1 run one at a time like a
+/// serial queue. The target should be concurrent for more than one to run at once.
+///
+class DispatchLimitedQueue {
+
+public:
+
+    ///
+    /// - parameter target: The queue the work runs on.
+    /// - parameter maxConcurrent: The most work items running at once.
+    ///
+    inline DispatchLimitedQueue(const DispatchQueue& target, size_t maxConcurrent) {
+        _state = std::make_shared<_DispatchLimitedQueueState>(target, maxConcurrent);
+    }
+
+    DispatchLimitedQueue(const DispatchLimitedQueue&) = delete;
+    DispatchLimitedQueue& operator= (const DispatchLimitedQueue&) = delete;
+
+    /// Submits the work, to run once a slot is free. Never blocks.
+    inline void async(DispatchBlock work) {
+        _state->_async(work);
+    }
+
+    [[nodiscard]] inline size_t maxConcurrent() const {
+        return _state->_maxConcurrent.load();
+    }
+
+    /// Changes the limit. Work beyond a lowered limit is not interrupted, and the limit holds again once it finishes.
+    inline void setMaxConcurrent(size_t maxConcurrent) {
+        _state->_setMaxConcurrent(maxConcurrent);
+    }
+
+    /// The number of work items waiting for a slot.
+    [[nodiscard]] inline size_t pending() const {
+        return _state->_pending.load();
+    }
+
+    /// The number of work items running.
+    [[nodiscard]] inline size_t running() const {
+        return _state->_running.load();
+    }
+
+    /// The number of work items completed so far.
+    [[nodiscard]] inline uint64_t completed() const {
+        return _state->_completed.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchLimitedQueueState> _state;
+
+};
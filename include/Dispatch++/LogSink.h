@@ -0,0 +1,370 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/Group.h"
+#include "Dispatch++/IO.h"
+#include "Dispatch++/QoS.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Lines longer than this are truncated.
+#define DISPATCH_LOG_SINK_LINE_SIZE 240
+#define DISPATCH_LOG_SINK_DEFAULT_RING_CAPACITY 1024
+
+struct _DispatchLogSlot {
+    uint64_t seconds;
+    uint32_t nanoseconds;
+    uint8_t level;
+    uint8_t length;
+    char text[DISPATCH_LOG_SINK_LINE_SIZE];
+};
+
+// Single producer (the logging thread), single consumer (the drainer).
+class _DispatchLogRing {
+
+public:
+
+    inline explicit _DispatchLogRing(size_t capacity): _slots(capacity) {}
+
+    inline bool push(uint8_t level, std::string_view message) {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == _slots.size()) {
+            return false;
+        }
+
+        auto& slot = _slots[head % _slots.size()];
+        struct timespec now {};
+        clock_gettime(CLOCK_REALTIME, &now);
+        slot.seconds = uint64_t(now.tv_sec);
+        slot.nanoseconds = uint32_t(now.tv_nsec);
+        slot.level = level;
+        slot.length = uint8_t(std::min(message.size(), size_t(DISPATCH_LOG_SINK_LINE_SIZE)));
+        memcpy(slot.text, message.data(), slot.length);
+
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename Consumer>
+    inline size_t drain(Consumer&& consumer) {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        auto head = _head.load(std::memory_order_acquire);
+        for (auto i = tail; i != head; i++) {
+            consumer(_slots[i % _slots.size()]);
+        }
+        _tail.store(head, std::memory_order_release);
+        return size_t(head - tail);
+    }
+
+    [[nodiscard]] inline bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_relaxed);
+    }
+
+    // Called by the producer.
+    [[nodiscard]] inline bool full() const {
+        return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire) == _slots.size();
+    }
+
+private:
+
+    std::vector<_DispatchLogSlot> _slots;
+    alignas(64) std::atomic<uint64_t> _head {0};
+    alignas(64) std::atomic<uint64_t> _tail {0};
+
+};
+
+class _DispatchLogSinkState: public std::enable_shared_from_this<_DispatchLogSinkState> {
+
+public:
+
+    inline _DispatchLogSinkState(int fileDescriptor, size_t ringCapacity, bool dropWhenFull)
+        : _fd(fileDescriptor), _ringCapacity(std::max(ringCapacity, size_t(1))), _dropWhenFull(dropWhenFull) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.LogSink", DispatchQoS::background()};
+    std::shared_ptr<DispatchSourceUserDataOr> _wakeup;
+    std::vector<std::shared_ptr<DispatchSourceSignal>> _signalSources;
+    DispatchGroup _writes;
+    std::atomic<bool> _signalled {false};
+    std::atomic<uint64_t> _dropped {0};
+    std::atomic<uint64_t> _written {0};
+    // Marks the sink's queue, so the sink can tell when it is destroyed from it.
+    DispatchSpecificKey<bool> _onQueue;
+
+    inline void _start() {
+        _queue.setSpecific(_onQueue, std::make_shared<bool>(true));
+        _wakeup = DispatchSource::makeUserDataOrSource(&_queue);
+        auto weakSelf = std::weak_ptr<_DispatchLogSinkState>(shared_from_this());
+        _wakeup->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_drain();
+            }
+        });
+        _wakeup->resume();
+    }
+
+    inline void _log(uint8_t level, std::string_view message) {
+        auto ring = _ring();
+        while (!ring->push(level, message)) {
+            if (_dropWhenFull) {
+                _dropped++;
+                return;
+            }
+            // Backpressure: make sure the drainer runs, and sleep until it has made room.
+            _wakeup->dataOr(1);
+            std::unique_lock<std::mutex> lock(_spaceMutex);
+            _space.wait(lock, [ring] {
+                return !ring->full();
+            });
+        }
+        // One wakeup per drain, however many lines arrive in between.
+        if (!_signalled.exchange(true)) {
+            _wakeup->dataOr(1);
+        }
+    }
+
+    inline void _drain() {
+        _signalled = false;
+
+        std::vector<std::shared_ptr<_DispatchLogRing>> rings;
+        {
+            std::lock_guard<std::mutex> lock(_ringsMutex);
+            rings = _rings;
+        }
+
+        std::string batch;
+        char header[64];
+        for (auto& ring : rings) {
+            ring->drain([&](const _DispatchLogSlot& slot) {
+                struct tm time {};
+                auto seconds = time_t(slot.seconds);
+                gmtime_r(&seconds, &time);
+                auto length = strftime(header, sizeof(header), "%Y-%m-%dT%H:%M:%S", &time);
+                length += size_t(snprintf(header + length, sizeof(header) - length, ".%06uZ %s ",
+                                          slot.nanoseconds / 1000, _levelName(slot.level)));
+                batch.append(header, length);
+                batch.append(slot.text, slot.length);
+                batch.push_back('\n');
+                _written++;
+            });
+        }
+
+        rings.clear();
+        if (!_dropWhenFull) {
+            // Taken after the rings moved their tails, so a thread that saw its ring full is
+            // either waiting already, or sees the room once it gets the lock.
+            { std::lock_guard<std::mutex> lock(_spaceMutex); }
+            _space.notify_all();
+        }
+        {
+            // Rings whose threads have exited, and which are now empty, can go.
+            std::lock_guard<std::mutex> lock(_ringsMutex);
+            _rings.erase(std::remove_if(_rings.begin(), _rings.end(), [](const auto& ring) {
+                return ring.use_count() == 1 && ring->empty();
+            }), _rings.end());
+        }
+
+        if (batch.empty()) {
+            return;
+        }
+        auto writes = _writes;
+        writes.enter();
+        DispatchIO::write(_fd, DispatchData(batch.data(), batch.size()), _queue,
+                          ^(const std::shared_ptr<DispatchData> remaining, int error) {
+            writes.leave();
+        });
+    }
+
+    inline void _addSignal(int32_t signal) {
+        ::signal(signal, SIG_IGN);
+        auto source = DispatchSource::makeSignalSource(signal, &_queue);
+        auto weakSelf = std::weak_ptr<_DispatchLogSinkState>(shared_from_this());
+        source->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_drain();
+            }
+        });
+        source->resume();
+        _signalSources.push_back(source);
+    }
+
+private:
+
+    int _fd;
+    size_t _ringCapacity;
+    bool _dropWhenFull;
+    // Unlike the address, never reused by a later sink.
+    uint64_t _id {_nextID()};
+
+    std::mutex _ringsMutex;
+    std::vector<std::shared_ptr<_DispatchLogRing>> _rings;
+    // Where threads blocked on a full ring wait for the drainer.
+    std::mutex _spaceMutex;
+    std::condition_variable _space;
+
+    struct _ThreadRing {
+        std::weak_ptr<_DispatchLogSinkState> sink;
+        std::shared_ptr<_DispatchLogRing> ring;
+    };
+
+    // The calling thread's ring, created on its first line.
+    inline _DispatchLogRing *_ring() {
+        thread_local std::unordered_map<uint64_t, _ThreadRing> rings;
+        thread_local uint64_t lastSink = 0;
+        thread_local _DispatchLogRing *lastRing = nullptr;
+
+        if (lastSink == _id) {
+            return lastRing;
+        }
+        // The rings of the sinks destroyed since go with them, rather than staying with every thread.
+        for (auto it = rings.begin(); it != rings.end();) {
+            it = it->second.sink.expired() ? rings.erase(it) : std::next(it);
+        }
+        auto& entry = rings[_id];
+        if (!entry.ring) {
+            entry.sink = weak_from_this();
+            entry.ring = std::make_shared<_DispatchLogRing>(_ringCapacity);
+            std::lock_guard<std::mutex> lock(_ringsMutex);
+            _rings.push_back(entry.ring);
+        }
+        lastSink = _id;
+        lastRing = entry.ring.get();
+        return lastRing;
+    }
+
+    inline static uint64_t _nextID() {
+        static std::atomic<uint64_t> next {1};
+        return next++;
+    }
+
+    inline static const char *_levelName(uint8_t level) {
+        static const char *names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+        return level < 4 ? names[level] : "?";
+    }
+
+};
+
+///
+/// A logging sink for hot paths.
+///
+/// Each logging thread stages its lines in its own lock-free ring, without
+/// allocating or touching a shared queue. A drainer on a `BACKGROUND` queue,
+/// woken at most once per drain through a user data source, collects the
+/// rings, formats the lines with their timestamp and level, and writes each
+/// round as a single `DispatchIO::write`.
+///
+/// When a thread's ring is full, `OverflowPolicy::DROP` discards the line and
+/// counts it in `dropped()`; `OverflowPolicy::BLOCK` makes the thread sleep until
+/// the drainer has made room.
+///
+/// A sink must outlive the threads logging to it. Lines longer than
+/// `DISPATCH_LOG_SINK_LINE_SIZE` are truncated.
+///
+class DispatchLogSink {
+
+public:
+
+    enum class Level: uint8_t {
+        DEBUG, INFO, WARNING, ERROR
+    };
+
+    enum class OverflowPolicy: uint {
+        DROP, BLOCK
+    };
+
+    inline explicit DispatchLogSink(
+            int fileDescriptor,
+            OverflowPolicy policy = OverflowPolicy::DROP,
+            size_t ringCapacity = DISPATCH_LOG_SINK_DEFAULT_RING_CAPACITY)
+    {
+        _state = std::make_shared<_DispatchLogSinkState>(fileDescriptor, ringCapacity, policy == OverflowPolicy::DROP);
+        _state->_start();
+    }
+
+    DispatchLogSink(const DispatchLogSink&) = delete;
+    DispatchLogSink& operator= (const DispatchLogSink&) = delete;
+
+    /// Drains what was logged before, and stops the sink's sources. May be called on any
+    /// queue, including the sink's own.
+    inline ~DispatchLogSink() {
+        auto state = _state;
+        auto stop = ^{
+            state->_drain();
+            state->_wakeup->cancel();
+            for (auto& source : state->_signalSources) {
+                source->cancel();
+            }
+        };
+        // A sync onto the queue the caller is already on would never return.
+        if (DispatchQueue::getCurrentSpecific(state->_onQueue)) {
+            stop();
+        } else {
+            state->_queue.sync(stop);
+        }
+    }
+
+    inline void log(Level level, std::string_view message) {
+        _state->_log(uint8_t(level), message);
+    }
+
+    inline void debug(std::string_view message) { log(Level::DEBUG, message); }
+    inline void info(std::string_view message) { log(Level::INFO, message); }
+    inline void warning(std::string_view message) { log(Level::WARNING, message); }
+    inline void error(std::string_view message) { log(Level::ERROR, message); }
+
+    /// Drains the rings when the process receives `signal`, which is otherwise ignored.
+    inline void flushOnSignal(int32_t signal) {
+        auto state = _state;
+        state->_queue.sync(^{
+            state->_addSignal(signal);
+        });
+    }
+
+    /// Drains the rings, and invokes `completion` once everything logged before is written.
+    inline void flush(const DispatchQueue& queue, DispatchBlock completion) {
+        auto state = _state;
+        auto target = queue;
+        auto retainedCompletion = _DispatchRetainedBlock<DispatchBlock>(completion);
+        state->_queue.async(^{
+            state->_drain();
+            state->_writes.notify(target, retainedCompletion.get());
+        });
+    }
+
+    /// The number of lines discarded because a ring was full.
+    [[nodiscard]] inline uint64_t dropped() const {
+        return _state->_dropped.load();
+    }
+
+    /// The number of lines handed to the file descriptor.
+    [[nodiscard]] inline uint64_t written() const {
+        return _state->_written.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchLogSinkState> _state;
+
+};
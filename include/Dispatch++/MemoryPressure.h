@@ -0,0 +1,465 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/FileWatcher.h"
+#include "Dispatch++/QoS.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+
+// How long without a new `high` or `max` event before the pressure is reported as gone.
+#define DISPATCH_MEMORY_PRESSURE_SETTLE_MS 1000
+
+// A memory pressure source over the `memory.events` file of a cgroup (v2). The kernel
+// notifies a modification of the file each time one of its counters grows, which inotify
+// turns into an event; the level is then the counter that grew. The level is delivered
+// through a DATA_REPLACE source, which provides the rest of the source behaviour.
+class _DispatchCgroupMemoryPressureSource: public DispatchSourceMemoryPressure {
+
+public:
+
+    // The `memory.events` file of the cgroup this process runs in, or empty without cgroup v2.
+    inline static std::string eventsPath() {
+        std::string contents;
+        if (!_readFile("/proc/self/cgroup", contents)) {
+            return "";
+        }
+        // The unified hierarchy is the line "0::/path".
+        size_t begin = 0;
+        while (begin < contents.size()) {
+            auto end = contents.find('\n', begin);
+            if (end == std::string::npos) {
+                end = contents.size();
+            }
+            if (contents.compare(begin, 3, "0::") == 0) {
+                auto path = "/sys/fs/cgroup" + contents.substr(begin + 3, end - begin - 3);
+                if (path.back() != '/') {
+                    path += '/';
+                }
+                return path + "memory.events";
+            }
+            begin = end + 1;
+        }
+        return "";
+    }
+
+    inline static std::shared_ptr<_DispatchCgroupMemoryPressureSource> make(
+            const std::string& path,
+            uint eventMask,
+            const DispatchQueue *queue)
+    {
+        auto source = std::shared_ptr<_DispatchCgroupMemoryPressureSource>(
+                new _DispatchCgroupMemoryPressureSource(eventMask, queue));
+        source->_path = path;
+        auto error = source->_readCounters(source->_counters) ? 0 : (errno != 0 ? errno : EINVAL);
+        if (error == 0) {
+            source->_watch = _DispatchInotifySource::make(
+                    path.c_str(), -1, uint(DispatchSource::FileSystemEvent::WRITE), &source->_control);
+            error = source->_watch ? 0 : errno;
+        }
+        if (error != 0) {
+            // A suspended source can neither be cancelled nor released.
+            source->_source->resume();
+            source->_source->cancel();
+            errno = error;
+            return nullptr;
+        }
+
+        auto weakSource = std::weak_ptr<_DispatchCgroupMemoryPressureSource>(source);
+        source->_watch->setEventHandler(^{
+            if (auto strongSource = weakSource.lock()) {
+                strongSource->_check();
+            }
+        });
+        source->_watch->resume();
+        source->_settleTimer = DispatchSource::makeTimerSource(&source->_control);
+        source->_settleTimer->setEventHandler(^{
+            if (auto strongSource = weakSource.lock()) {
+                strongSource->_settle();
+            }
+        });
+        source->_settleTimer->schedule(DispatchTime::distantFuture());
+        source->_settleTimer->resume();
+        return source;
+    }
+
+    inline ~_DispatchCgroupMemoryPressureSource() {
+        _stop();
+    }
+
+    // MARK: - DispatchSourceProtocol
+
+    inline void setEventHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setEventHandler(qos, flags, handler);
+    }
+
+    inline void setEventHandler(DispatchWorkItem handler) override {
+        _source->setEventHandler(std::move(handler));
+    }
+
+    inline void setCancelHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setCancelHandler(qos, flags, handler);
+    }
+
+    inline void setCancelHandler(DispatchWorkItem handler) override {
+        _source->setCancelHandler(std::move(handler));
+    }
+
+    inline void setRegistrationHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setRegistrationHandler(qos, flags, handler);
+    }
+
+    inline void setRegistrationHandler(DispatchWorkItem handler) override {
+        _source->setRegistrationHandler(std::move(handler));
+    }
+
+    inline void activate() override {
+        _source->activate();
+    }
+
+    inline void cancel() override {
+        _stop();
+        _source->cancel();
+    }
+
+    inline void resume() override {
+        _source->resume();
+    }
+
+    inline void suspend() override {
+        _source->suspend();
+    }
+
+    inline uint getHandle() override {
+        return 0;
+    }
+
+    inline uint getMask() override {
+        return _mask;
+    }
+
+    inline uint getData() override {
+        return _source->getData();
+    }
+
+    inline bool isCancelled() override {
+        return _source->isCancelled();
+    }
+
+private:
+
+    struct _Counters {
+        uint64_t high {0};
+        uint64_t max {0};
+        uint64_t oom {0};
+        uint64_t oomKill {0};
+    };
+
+    inline _DispatchCgroupMemoryPressureSource(uint eventMask, const DispatchQueue *queue)
+        : _mask(eventMask), _source(DispatchSource::makeUserDataReplaceSource(queue)) {}
+
+    uint _mask;
+    std::string _path;
+    DispatchQueue _control {"tech.shifor.Dispatch++.MemoryPressure.Cgroup"};
+    _Counters _counters;
+    uint _level {uint(DispatchSource::MemoryPressureEvent::NORMAL)};
+    std::atomic<bool> _stopped {false};
+    std::shared_ptr<DispatchSourceUserDataReplace> _source;
+    std::shared_ptr<DispatchSourceFileSystemObject> _watch;
+    std::shared_ptr<DispatchSourceTimer> _settleTimer;
+
+    inline static bool _readFile(const char *path, std::string& contents) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        char buffer[4096];
+        ssize_t count;
+        contents.clear();
+        while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+            contents.append(buffer, size_t(count));
+        }
+        close(fd);
+        return count == 0;
+    }
+
+    // False when the file cannot be read, or is caught halfway through being written.
+    inline bool _readCounters(_Counters& counters) {
+        std::string contents;
+        errno = 0;
+        if (!_readFile(_path.c_str(), contents)) {
+            return false;
+        }
+        bool sawHigh = false;
+        bool sawMax = false;
+        size_t begin = 0;
+        while (begin < contents.size()) {
+            auto end = contents.find('\n', begin);
+            if (end == std::string::npos) {
+                end = contents.size();
+            }
+            auto space = contents.find(' ', begin);
+            if (space < end) {
+                auto name = contents.substr(begin, space - begin);
+                auto value = strtoull(contents.c_str() + space + 1, nullptr, 10);
+                if (name == "high") {
+                    counters.high = value;
+                    sawHigh = true;
+                } else if (name == "max") {
+                    counters.max = value;
+                    sawMax = true;
+                } else if (name == "oom") {
+                    counters.oom = value;
+                } else if (name == "oom_kill") {
+                    counters.oomKill = value;
+                }
+            }
+            begin = end + 1;
+        }
+        return sawHigh && sawMax;
+    }
+
+    // Runs on the control queue, for each modification of the file.
+    inline void _check() {
+        _Counters counters;
+        if (!_readCounters(counters)) {
+            return;
+        }
+        uint level = 0;
+        if (counters.max > _counters.max || counters.oom > _counters.oom || counters.oomKill > _counters.oomKill) {
+            level = uint(DispatchSource::MemoryPressureEvent::CRITICAL);
+        } else if (counters.high > _counters.high) {
+            level = uint(DispatchSource::MemoryPressureEvent::WARN);
+        }
+        _counters = counters;
+        if (level == 0) {
+            return;
+        }
+        _level = level;
+        _deliver(level);
+        // Each event pushes the return to normal further out.
+        _settleTimer->schedule(DispatchTime::now() + DispatchTimeInterval::milliseconds(DISPATCH_MEMORY_PRESSURE_SETTLE_MS));
+    }
+
+    inline void _settle() {
+        auto normal = uint(DispatchSource::MemoryPressureEvent::NORMAL);
+        if (_level != normal) {
+            _level = normal;
+            _deliver(normal);
+        }
+        _settleTimer->schedule(DispatchTime::distantFuture());
+    }
+
+    inline void _deliver(uint level) {
+        if ((level & _mask) != 0) {
+            _source->dataReplace(level);
+        }
+    }
+
+    inline void _stop() {
+        if (_stopped.exchange(true)) {
+            return;
+        }
+        if (_watch) {
+            _watch->cancel();
+        }
+        if (_settleTimer) {
+            _settleTimer->cancel();
+        }
+    }
+
+};
+
+#endif // defined(__linux__)
+
+class _DispatchMemoryPressureState: public std::enable_shared_from_this<_DispatchMemoryPressureState> {
+
+public:
+
+    typedef size_t (^ShrinkHandler)(DispatchSource::MemoryPressureEvent level);
+
+    struct _Cache {
+        int priority;
+        uint64_t token;
+        _DispatchRetainedBlock<ShrinkHandler> handler;
+    };
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.MemoryPressure", DispatchQoS::background()};
+    std::vector<_Cache> _caches;
+    std::shared_ptr<DispatchSourceMemoryPressure> _source;
+    std::atomic<uint64_t> _nextToken {1};
+    std::atomic<uint64_t> _trims {0};
+    std::atomic<uint64_t> _released {0};
+
+    inline void _start() {
+        auto weakSelf = std::weak_ptr<_DispatchMemoryPressureState>(shared_from_this());
+        auto mask = DispatchSource::MemoryPressureEvent(
+                uint(DispatchSource::MemoryPressureEvent::WARN) | uint(DispatchSource::MemoryPressureEvent::CRITICAL));
+        _source = DispatchSource::makeMemoryPressureSource(mask, &_queue);
+        if (_source) {
+            _source->setEventHandler(^{
+                if (auto state = weakSelf.lock()) {
+                    state->_trim(DispatchSource::MemoryPressureEvent(state->_source->getData()));
+                }
+            });
+            _source->resume();
+        }
+    }
+
+    inline void _stop() {
+        if (_source) {
+            _source->cancel();
+        }
+        _caches.clear();
+    }
+
+    inline void _register(int priority, uint64_t token, const _DispatchRetainedBlock<ShrinkHandler>& handler) {
+        auto position = std::upper_bound(_caches.begin(), _caches.end(), priority, [](int value, const _Cache& cache) {
+            return value < cache.priority;
+        });
+        _caches.insert(position, _Cache {priority, token, handler});
+    }
+
+    inline void _unregister(uint64_t token) {
+        _caches.erase(std::remove_if(_caches.begin(), _caches.end(), [token](const _Cache& cache) {
+            return cache.token == token;
+        }), _caches.end());
+    }
+
+    // Runs on the queue, so caches are trimmed one at a time and never after unregistering.
+    inline void _trim(DispatchSource::MemoryPressureEvent level) {
+        if (level != DispatchSource::MemoryPressureEvent::WARN && level != DispatchSource::MemoryPressureEvent::CRITICAL) {
+            return;
+        }
+        _trims++;
+        for (auto& cache : _caches) {
+            _released += cache.handler.get()(level);
+        }
+    }
+
+};
+
+///
+/// Trims in-process caches when memory runs short, before the process is killed for it.
+///
+/// Caches register a shrink handler with a priority. When the memory pressure source
+/// reports `WARN` or `CRITICAL`, every handler is invoked with the level, in ascending
+/// order of priority, one at a time on a serial `BACKGROUND` queue; so the caches that
+/// are cheapest to rebuild give up their memory first. A handler returns the number of
+/// bytes it released, which is only accounted in `released()`.
+///
+/// On Linux the pressure is that of the cgroup the process runs in; see
+/// `DispatchSource::makeMemoryPressureSource`. Where it cannot be monitored, the
+/// coordinator still trims on `simulate`.
+///
+class DispatchMemoryPressureCoordinator {
+
+public:
+
+    typedef _DispatchMemoryPressureState::ShrinkHandler ShrinkHandler;
+
+    inline DispatchMemoryPressureCoordinator() {
+        _state = std::make_shared<_DispatchMemoryPressureState>();
+        // Nothing runs on the queue until the source is resumed at the end.
+        _state->_start();
+    }
+
+    DispatchMemoryPressureCoordinator(const DispatchMemoryPressureCoordinator&) = delete;
+    DispatchMemoryPressureCoordinator& operator= (const DispatchMemoryPressureCoordinator&) = delete;
+
+    inline ~DispatchMemoryPressureCoordinator() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    ///
+    /// Registers a cache to be trimmed under memory pressure.
+    ///
+    /// - parameter priority: Caches with lower priorities are trimmed first.
+    /// - parameter handler: Releases memory for the given level, and returns how many bytes.
+    /// - returns: The token to unregister the cache with.
+    ///
+    inline uint64_t registerCache(int priority, ShrinkHandler handler) {
+        auto state = _state;
+        auto token = state->_nextToken++;
+        auto retainedHandler = _DispatchRetainedBlock<ShrinkHandler>(handler);
+        state->_queue.async(^{
+            state->_register(priority, token, retainedHandler);
+        });
+        return token;
+    }
+
+    ///
+    /// Unregisters a cache. Once this returns, its handler is not running and will not be
+    /// invoked again, so the cache may be destroyed; it must not be called from a handler.
+    ///
+    inline void unregisterCache(uint64_t token) {
+        auto state = _state;
+        state->_queue.sync(^{
+            state->_unregister(token);
+        });
+    }
+
+    /// Trims the caches as if the memory pressure source had reported `level`.
+    inline void simulate(DispatchSource::MemoryPressureEvent level) {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_trim(level);
+        });
+    }
+
+    /// Whether the memory pressure of the system is monitored, rather than only simulated.
+    [[nodiscard]] inline bool isMonitoring() const {
+        return _state->_source != nullptr;
+    }
+
+    /// The number of times the caches have been trimmed.
+    [[nodiscard]] inline uint64_t trims() const {
+        return _state->_trims.load();
+    }
+
+    /// The number of bytes the shrink handlers reported having released.
+    [[nodiscard]] inline uint64_t released() const {
+        return _state->_released.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchMemoryPressureState> _state;
+
+};
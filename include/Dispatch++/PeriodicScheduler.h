@@ -0,0 +1,317 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+class _DispatchPeriodicSchedulerState: public std::enable_shared_from_this<_DispatchPeriodicSchedulerState> {
+
+public:
+
+    enum struct MissedDeadlines {
+        /// Waits for the next deadline after the late run, counting the ones skipped.
+        SKIP,
+        /// Runs once for each missed deadline, back to back, until the job has caught up.
+        RUN_MISSED,
+        /// Starts the schedule over, an interval after the late run.
+        DELAY
+    };
+
+    struct _Job {
+        int64_t interval;
+        int64_t leeway;
+        int64_t deadline;
+        MissedDeadlines policy;
+        bool running {false};
+        _DispatchRetainedBlock<DispatchBlock> handler;
+    };
+
+    inline explicit _DispatchPeriodicSchedulerState(const DispatchQueue& queue): _targetQueue(queue) {
+        _start = std::chrono::steady_clock::now();
+    }
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.PeriodicScheduler"};
+    DispatchQueue _targetQueue;
+    std::mutex _mutex;
+    std::unordered_map<uint64_t, _Job> _jobs;
+    // The next deadline of each job that is not running, earliest first.
+    std::set<std::pair<int64_t, uint64_t>> _deadlines;
+    uint64_t _nextIdentifier {1};
+    int64_t _programmed {INT64_MAX};
+    int64_t _programmedLeeway {0};
+    bool _stopped {false};
+    std::chrono::steady_clock::time_point _start;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    std::atomic<uint64_t> _runs {0};
+    std::atomic<uint64_t> _missed {0};
+    std::atomic<uint64_t> _wakeups {0};
+
+    inline void _startTimer() {
+        auto weakSelf = std::weak_ptr<_DispatchPeriodicSchedulerState>(shared_from_this());
+        _timer = DispatchSource::makeTimerSource(&_queue);
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_wakeups++;
+                state->_fire();
+            }
+        });
+        _timer->schedule(DispatchTime::distantFuture());
+        _timer->resume();
+    }
+
+    inline void _stop() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+        _timer->cancel();
+        _jobs.clear();
+        _deadlines.clear();
+    }
+
+    inline uint64_t _add(
+            const DispatchTimeInterval& interval,
+            const DispatchTimeInterval& leeway,
+            MissedDeadlines policy,
+            DispatchBlock handler)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto identifier = _nextIdentifier++;
+        if (_stopped) {
+            return identifier;
+        }
+        auto& job = _jobs[identifier];
+        job.interval = std::max<int64_t>(interval.rawValue, 1);
+        job.leeway = std::max<int64_t>(leeway.rawValue, 0);
+        job.deadline = _now() + job.interval;
+        job.policy = policy;
+        job.handler = _DispatchRetainedBlock<DispatchBlock>(handler);
+        _deadlines.emplace(job.deadline, identifier);
+        _reprogram();
+        return identifier;
+    }
+
+    inline void _remove(uint64_t identifier) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _jobs.find(identifier);
+        if (it == _jobs.end()) {
+            return;
+        }
+        if (!it->second.running) {
+            _deadlines.erase({it->second.deadline, identifier});
+        }
+        _jobs.erase(it);
+        _reprogram();
+    }
+
+    inline size_t _count() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _jobs.size();
+    }
+
+private:
+
+    inline int64_t _now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+    // Finds the latest time at which the earliest jobs can all run within their leeway, so
+    // deadlines close to each other share one wakeup; the timer is only touched when it changes.
+    inline void _reprogram() {
+        if (_deadlines.empty()) {
+            if (_programmed != INT64_MAX) {
+                _programmed = INT64_MAX;
+                _timer->schedule(DispatchTime::distantFuture());
+            }
+            return;
+        }
+        auto it = _deadlines.begin();
+        auto wakeup = it->first;
+        auto latest = wakeup + _jobs[it->second].leeway;
+        for (++it; it != _deadlines.end() && it->first <= latest; ++it) {
+            wakeup = it->first;
+            latest = std::min(latest, it->first + _jobs[it->second].leeway);
+        }
+        auto leeway = latest - wakeup;
+        if (wakeup == _programmed && leeway == _programmedLeeway) {
+            return;
+        }
+        _programmed = wakeup;
+        _programmedLeeway = leeway;
+        auto delay = std::max<int64_t>(wakeup - _now(), 0);
+        _timer->schedule(DispatchTime::now() + DispatchTimeInterval::nanoseconds(delay),
+                         DispatchTimeInterval::never(),
+                         DispatchTimeInterval::nanoseconds(leeway));
+    }
+
+    // Runs on the scheduler's queue.
+    inline void _fire() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopped) {
+            return;
+        }
+        _programmed = INT64_MAX;
+        auto now = _now();
+        auto weakSelf = std::weak_ptr<_DispatchPeriodicSchedulerState>(shared_from_this());
+        while (!_deadlines.empty() && _deadlines.begin()->first <= now) {
+            auto identifier = _deadlines.begin()->second;
+            _deadlines.erase(_deadlines.begin());
+            auto& job = _jobs[identifier];
+            job.running = true;
+            _runs++;
+            auto handler = job.handler;
+            auto queue = _queue;
+            _targetQueue.async(^{
+                handler.get()();
+                queue.async(^{
+                    if (auto state = weakSelf.lock()) {
+                        state->_completed(identifier);
+                    }
+                });
+            });
+        }
+        _reprogram();
+    }
+
+    // A job is only scheduled again once its run is over, so runs of a job never overlap.
+    inline void _completed(uint64_t identifier) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _jobs.find(identifier);
+        if (_stopped || it == _jobs.end()) {
+            return;
+        }
+        auto& job = it->second;
+        job.running = false;
+        auto now = _now();
+        auto next = job.deadline + job.interval;
+        if (next <= now) {
+            switch (job.policy) {
+                case MissedDeadlines::SKIP: {
+                    auto skipped = (now - next) / job.interval + 1;
+                    _missed += uint64_t(skipped);
+                    next += skipped * job.interval;
+                    break;
+                }
+                case MissedDeadlines::RUN_MISSED:
+                    break;
+                case MissedDeadlines::DELAY:
+                    _missed++;
+                    next = now + job.interval;
+                    break;
+            }
+        }
+        job.deadline = next;
+        _deadlines.emplace(next, identifier);
+        if (next <= now) {
+            // Caught up straight away, without waiting for the timer.
+            auto weakSelf = std::weak_ptr<_DispatchPeriodicSchedulerState>(shared_from_this());
+            _queue.async(^{
+                if (auto state = weakSelf.lock()) {
+                    state->_fire();
+                }
+            });
+            return;
+        }
+        _reprogram();
+    }
+
+};
+
+///
+/// Runs many periodic jobs off a single timer source.
+///
+/// The next deadline of every job is kept in order, and one timer source is programmed
+/// for the earliest. Each job has a leeway, how late it may run: the timer is set to
+/// the latest time at which the earliest jobs are all still within theirs, so jobs with
+/// nearby deadlines run on one wakeup, as a timer source per job would not.
+///
+/// A job is submitted to the target queue at its deadline, and its next deadline is one
+/// interval later. Runs of a job never overlap: the next one is scheduled when a run is
+/// over. When a run ends after the next deadline, as when a handler is slow or the
+/// process was stopped, the job's `MissedDeadlines` policy decides what happens.
+///
+class DispatchPeriodicScheduler {
+
+public:
+
+    typedef _DispatchPeriodicSchedulerState::MissedDeadlines MissedDeadlines;
+
+    /// - parameter queue: The queue the jobs are submitted to.
+    inline explicit DispatchPeriodicScheduler(const DispatchQueue& queue) {
+        _state = std::make_shared<_DispatchPeriodicSchedulerState>(queue);
+        _state->_startTimer();
+    }
+
+    DispatchPeriodicScheduler(const DispatchPeriodicScheduler&) = delete;
+    DispatchPeriodicScheduler& operator= (const DispatchPeriodicScheduler&) = delete;
+
+    inline ~DispatchPeriodicScheduler() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    ///
+    /// Adds a job, first run an interval from now.
+    ///
+    /// - parameter interval: The time between two deadlines of the job.
+    /// - parameter leeway: How late the job may run, to share a wakeup with other jobs.
+    /// - parameter policy: What to do when a run ends past the next deadline.
+    /// - returns: The identifier to remove the job with.
+    ///
+    inline uint64_t add(
+            const DispatchTimeInterval& interval,
+            const DispatchTimeInterval& leeway,
+            DispatchBlock handler,
+            MissedDeadlines policy = MissedDeadlines::SKIP)
+    {
+        return _state->_add(interval, leeway, policy, handler);
+    }
+
+    /// Removes a job; a run already submitted still completes.
+    inline void remove(uint64_t identifier) {
+        _state->_remove(identifier);
+    }
+
+    /// The number of jobs.
+    [[nodiscard]] inline size_t count() const {
+        return _state->_count();
+    }
+
+    /// The number of runs submitted so far.
+    [[nodiscard]] inline uint64_t runs() const {
+        return _state->_runs.load();
+    }
+
+    /// The number of deadlines missed, skipped or started over from.
+    [[nodiscard]] inline uint64_t missed() const {
+        return _state->_missed.load();
+    }
+
+    /// The number of times the timer has woken the scheduler.
+    [[nodiscard]] inline uint64_t wakeups() const {
+        return _state->_wakeups.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchPeriodicSchedulerState> _state;
+
+};
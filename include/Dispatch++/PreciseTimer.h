@@ -0,0 +1,244 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/QoS.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include "Dispatch++/Utils.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+#define DISPATCH_PRECISE_TIMER_DEFAULT_SPIN_US 200
+
+class _DispatchPreciseTimerState: public std::enable_shared_from_this<_DispatchPreciseTimerState> {
+
+public:
+
+    inline _DispatchPreciseTimerState(DispatchBlock handler, int64_t spinBudget)
+        : _handler(handler), _spinBudget(spinBudget) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.PreciseTimer", DispatchQoS::userInteractive()};
+    _DispatchRetainedBlock<DispatchBlock> _handler;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    std::atomic<int64_t> _spinBudget;
+    // The deadline of the next fire, and for a repeating timer, the start and the fires so far.
+    DispatchTime _deadline {DispatchTime::distantFuture()};
+    DispatchTime _start {DispatchTime::distantFuture()};
+    int64_t _interval {0};
+    uint64_t _count {0};
+    std::atomic<uint64_t> _fires {0};
+    std::atomic<int64_t> _lastLateness {0};
+    std::atomic<int64_t> _maxLateness {0};
+    std::atomic<int64_t> _spinTime {0};
+    // Marks the timer's queue, so calls from the handler take effect before it returns.
+    DispatchSpecificKey<bool> _onQueue;
+
+    // Raw dispatch times are nanoseconds, except on Apple platforms where they are Mach ticks.
+    inline static int64_t _nanoseconds(int64_t ticks) {
+#ifdef __APPLE__
+        static mach_timebase_info_data_t timebase = [] {
+            mach_timebase_info_data_t info {};
+            mach_timebase_info(&info);
+            return info;
+        }();
+        return ticks * int64_t(timebase.numer) / int64_t(timebase.denom);
+#else
+        return ticks;
+#endif
+    }
+
+    inline void _startTimer() {
+        _queue.setSpecific(_onQueue, std::make_shared<bool>(true));
+        auto weakSelf = std::weak_ptr<_DispatchPreciseTimerState>(shared_from_this());
+        _timer = DispatchSource::makeTimerSource(DispatchSource::TimerFlags::STRICT, &_queue);
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_fire();
+            }
+        });
+        _timer->schedule(DispatchTime::distantFuture());
+        _timer->resume();
+    }
+
+    inline void _schedule(DispatchTime deadline, int64_t interval) {
+        _start = deadline;
+        _interval = interval;
+        _count = 0;
+        _arm(deadline);
+    }
+
+    inline void _perform(DispatchBlock work) {
+        if (DispatchQueue::getCurrentSpecific(_onQueue)) {
+            work();
+        } else {
+            _queue.async(work);
+        }
+    }
+
+    // Only disarms the source, so a later schedule still fires.
+    inline void _cancel() {
+        _interval = 0;
+        _arm(DispatchTime::distantFuture());
+    }
+
+    inline void _stop() {
+        _deadline = DispatchTime::distantFuture();
+        _timer->cancel();
+    }
+
+private:
+
+    // The source wakes the queue a spin budget before the deadline.
+    inline void _arm(DispatchTime deadline) {
+        _deadline = deadline;
+        if (deadline == DispatchTime::distantFuture()) {
+            _timer->schedule(DispatchTime::distantFuture());
+            return;
+        }
+        _timer->schedule(deadline - DispatchTimeInterval::nanoseconds(_spinBudget.load()));
+    }
+
+    // Runs on the timer's queue.
+    inline void _fire() {
+        auto deadline = _deadline;
+        if (deadline == DispatchTime::distantFuture()) {
+            return;
+        }
+        // Never spins for much longer than the budget, as for a wakeup meant for an earlier schedule.
+        auto budget = DispatchTimeInterval::nanoseconds(_spinBudget.load());
+        if (DispatchTime::now() + budget + budget < deadline) {
+            _arm(deadline);
+            return;
+        }
+
+        auto spinStart = DispatchTime::now();
+        auto now = spinStart;
+        while (now < deadline) {
+            dispatchCPURelax();
+            now = DispatchTime::now();
+        }
+        _spinTime += _nanoseconds(int64_t(now.rawValue - spinStart.rawValue));
+        auto lateness = _nanoseconds(int64_t(now.rawValue - deadline.rawValue));
+        _lastLateness = lateness;
+        if (lateness > _maxLateness.load()) {
+            _maxLateness = lateness;
+        }
+        _fires++;
+
+        // Re-armed only after the handler, so a cancel or schedule from it replaces the next fire.
+        _deadline = DispatchTime::distantFuture();
+        _handler.get()();
+        if (_interval > 0 && _deadline == DispatchTime::distantFuture()) {
+            // Counted from the start, so the fires do not drift.
+            _count++;
+            _arm(_start + DispatchTimeInterval::nanoseconds(int64_t(_count) * _interval));
+        }
+    }
+
+};
+
+///
+/// A timer for deadlines that must be met to the microsecond.
+///
+/// Even a `STRICT` timer source wakes late by the latency of the scheduler, tens of
+/// microseconds or more. This timer arms its source a spin budget before the deadline,
+/// and then busy-waits, pausing the CPU between reads of the clock, until the exact
+/// deadline. Its handler runs on a dedicated `USER_INTERACTIVE` queue, right at the
+/// deadline; it should be short, and hand longer work off to another queue.
+///
+/// The spin budget trades CPU time for precision: it must cover the usual wakeup
+/// latency, and each fire spends up to that long spinning.
+///
+class DispatchPreciseTimer {
+
+public:
+
+    ///
+    /// - parameter handler: Invoked at each deadline, on the timer's own queue.
+    /// - parameter spinBudget: How early the timer wakes to spin until the deadline.
+    ///
+    inline explicit DispatchPreciseTimer(
+            DispatchBlock handler,
+            const DispatchTimeInterval& spinBudget = DispatchTimeInterval::microseconds(DISPATCH_PRECISE_TIMER_DEFAULT_SPIN_US))
+    {
+        _state = std::make_shared<_DispatchPreciseTimerState>(handler, std::max<int64_t>(spinBudget.rawValue, 0));
+        _state->_startTimer();
+    }
+
+    DispatchPreciseTimer(const DispatchPreciseTimer&) = delete;
+    DispatchPreciseTimer& operator= (const DispatchPreciseTimer&) = delete;
+
+    inline ~DispatchPreciseTimer() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    /// Fires once at `deadline`, replacing any earlier schedule.
+    inline void schedule(DispatchTime deadline) {
+        schedule(deadline, DispatchTimeInterval::never());
+    }
+
+    /// Fires at `deadline`, then every `interval` counted from it, replacing any earlier schedule.
+    inline void schedule(DispatchTime deadline, const DispatchTimeInterval& interval) {
+        auto state = _state;
+        auto repeating = interval == DispatchTimeInterval::never() ? 0 : std::max<int64_t>(interval.rawValue, 1);
+        state->_perform(^{
+            state->_schedule(deadline, repeating);
+        });
+    }
+
+    /// Stops the fires scheduled so far; a later `schedule` arms the timer again. Called from
+    /// the handler, it takes effect before the timer is re-armed.
+    inline void cancel() {
+        auto state = _state;
+        state->_perform(^{
+            state->_cancel();
+        });
+    }
+
+    /// Sets how early the timer wakes to spin until the deadline, from the next fire on.
+    inline void setSpinBudget(const DispatchTimeInterval& spinBudget) {
+        _state->_spinBudget = std::max<int64_t>(spinBudget.rawValue, 0);
+    }
+
+    /// The number of times the handler has been invoked.
+    [[nodiscard]] inline uint64_t fires() const {
+        return _state->_fires.load();
+    }
+
+    /// How late the last fire was.
+    [[nodiscard]] inline DispatchTimeInterval lastLateness() const {
+        return DispatchTimeInterval::nanoseconds(_state->_lastLateness.load());
+    }
+
+    /// How late the latest fire so far was.
+    [[nodiscard]] inline DispatchTimeInterval maxLateness() const {
+        return DispatchTimeInterval::nanoseconds(_state->_maxLateness.load());
+    }
+
+    /// The time spent spinning so far.
+    [[nodiscard]] inline DispatchTimeInterval spinTime() const {
+        return DispatchTimeInterval::nanoseconds(_state->_spinTime.load());
+    }
+
+private:
+
+    std::shared_ptr<_DispatchPreciseTimerState> _state;
+
+};
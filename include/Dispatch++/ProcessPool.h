@@ -0,0 +1,504 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#define DISPATCH_PROCESS_POOL_READ_BUFFER_SIZE (64 * 1024)
+
+// A worker that went away is reported as a failed job rather than with SIGPIPE.
+#if defined(MSG_NOSIGNAL)
+#define DISPATCH_PROCESS_POOL_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define DISPATCH_PROCESS_POOL_SEND_FLAGS 0
+#endif
+
+///
+/// The body of a worker process: turns one request into its response.
+///
+/// It runs in a forked child, so it must not use dispatch queues, sources or
+/// groups; plain computation, allocation and system calls are fine.
+///
+typedef std::vector<char> (^DispatchProcessPoolWorker)(const void *bytes, size_t count);
+
+typedef void (^DispatchProcessPoolCompletion)(const std::shared_ptr<DispatchData> response, int error);
+
+struct _DispatchProcessPoolJob {
+    std::shared_ptr<DispatchData> request;
+    DispatchQueue queue;
+    _DispatchRetainedBlock<DispatchProcessPoolCompletion> completion;
+};
+
+struct _DispatchProcessPoolWorkerState {
+    pid_t pid {-1};
+    int fd {-1};
+    bool connected {true};
+    bool exited {false};
+    bool waitingForSpace {false};
+    std::shared_ptr<DispatchSourceProcess> exitSource;
+    std::shared_ptr<DispatchSourceRead> readSource;
+    std::shared_ptr<DispatchSourceWrite> writeSource;
+    std::shared_ptr<DispatchData> outgoing;
+    std::vector<char> incoming;
+    std::shared_ptr<_DispatchProcessPoolJob> job;
+};
+
+class _DispatchProcessPoolState: public std::enable_shared_from_this<_DispatchProcessPoolState> {
+
+public:
+
+    inline _DispatchProcessPoolState(unsigned workers, DispatchProcessPoolWorker worker)
+        : _size(workers == 0 ? 1 : workers), _worker(worker) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.ProcessPool"};
+    std::atomic<uint64_t> _restarts {0};
+    std::atomic<uint64_t> _completed {0};
+    std::atomic<uint64_t> _failed {0};
+
+    inline void _start() {
+        for (unsigned i = 0; i < _size; i++) {
+            _spawn();
+        }
+    }
+
+    inline void _submit(const std::shared_ptr<_DispatchProcessPoolJob>& job) {
+        if (_stopped) {
+            _complete(job, nullptr, ECANCELED);
+            return;
+        }
+        _pending.push_back(job);
+        _dispatch();
+    }
+
+    // Closing the sockets ends the workers, which exit on end-of-file; their exit sources reap them.
+    inline void _stop() {
+        _stopped = true;
+        for (auto& job : _pending) {
+            _complete(job, nullptr, ECANCELED);
+        }
+        _pending.clear();
+        for (auto& worker : _workers) {
+            _disconnect(worker);
+        }
+    }
+
+    [[nodiscard]] inline std::vector<pid_t> _pids() const {
+        std::vector<pid_t> pids;
+        for (auto& worker : _workers) {
+            if (!worker->exited) {
+                pids.push_back(worker->pid);
+            }
+        }
+        return pids;
+    }
+
+private:
+
+    unsigned _size;
+    _DispatchRetainedBlock<DispatchProcessPoolWorker> _worker;
+    std::vector<std::shared_ptr<_DispatchProcessPoolWorkerState>> _workers;
+    std::deque<std::shared_ptr<_DispatchProcessPoolJob>> _pending;
+    bool _stopped {false};
+
+    inline void _spawn() {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return;
+        }
+        auto pid = fork();
+        if (pid < 0) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+            return;
+        }
+        if (pid == 0) {
+            ::close(fds[0]);
+            // Siblings must see end-of-file when the pool closes their sockets.
+            for (auto& sibling : _workers) {
+                if (sibling->connected) {
+                    ::close(sibling->fd);
+                }
+            }
+            _serve(fds[1], _worker.get());
+        }
+        ::close(fds[1]);
+
+        auto worker = std::make_shared<_DispatchProcessPoolWorkerState>();
+        worker->pid = pid;
+        worker->fd = fds[0];
+        fcntl(worker->fd, F_SETFD, FD_CLOEXEC);
+        fcntl(worker->fd, F_SETFL, fcntl(worker->fd, F_GETFL) | O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+        int on = 1;
+        setsockopt(worker->fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        _workers.push_back(worker);
+
+        auto weakSelf = std::weak_ptr<_DispatchProcessPoolState>(shared_from_this());
+        auto fd = worker->fd;
+        auto cancelled = std::make_shared<std::atomic<int>>(0);
+        auto closeWhenCancelled = _DispatchRetainedBlock<DispatchSourceHandler>(^{
+            if (++*cancelled == 2) {
+                ::close(fd);
+            }
+        });
+
+        worker->readSource = DispatchSource::makeReadSource(fd, &_queue);
+        worker->readSource->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_receive(worker);
+            }
+        });
+        worker->readSource->setCancelHandler(closeWhenCancelled.get());
+
+        worker->writeSource = DispatchSource::makeWriteSource(fd, &_queue);
+        worker->writeSource->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_flush(worker);
+            }
+        });
+        worker->writeSource->setCancelHandler(closeWhenCancelled.get());
+
+        // The exit event reaps the worker even when the pool is gone, so no zombie is left behind.
+        worker->exitSource = DispatchSource::makeProcessSource(pid, DispatchSource::ProcessEvent::EXIT, &_queue);
+        if (worker->exitSource) {
+            worker->exitSource->setEventHandler(^{
+                int status = 0;
+                while (waitpid(worker->pid, &status, 0) < 0 && errno == EINTR) {}
+                worker->exitSource->cancel();
+                if (auto state = weakSelf.lock()) {
+                    state->_exited(worker);
+                } else {
+                    worker->exitSource = nullptr;
+                }
+            });
+            worker->exitSource->resume();
+        } else {
+            // Without process sources, a utility thread waits for the exit instead.
+            auto queue = _queue;
+            DispatchQueue::global(DispatchQoS::QoSClass::UTILITY).async(^{
+                int status = 0;
+                while (waitpid(worker->pid, &status, 0) < 0 && errno == EINTR) {}
+                queue.async(^{
+                    if (auto state = weakSelf.lock()) {
+                        state->_exited(worker);
+                    }
+                });
+            });
+        }
+
+        worker->readSource->resume();
+        // The write source is resumed only while the socket is full.
+    }
+
+    // The child side: requests and responses are framed with a 64-bit length.
+    [[noreturn]] inline static void _serve(int fd, DispatchProcessPoolWorker worker) {
+        std::vector<char> request;
+        while (true) {
+            uint64_t length = 0;
+            if (!_readFully(fd, &length, sizeof(length))) {
+                _exit(0);
+            }
+            request.resize(size_t(length));
+            if (!_readFully(fd, request.data(), request.size())) {
+                _exit(1);
+            }
+            auto response = worker(request.data(), request.size());
+            length = response.size();
+            if (!_writeFully(fd, &length, sizeof(length)) || !_writeFully(fd, response.data(), response.size())) {
+                _exit(1);
+            }
+        }
+    }
+
+    inline static bool _readFully(int fd, void *bytes, size_t count) {
+        auto cursor = static_cast<char *>(bytes);
+        while (count > 0) {
+            auto n = ::read(fd, cursor, count);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            cursor += n;
+            count -= size_t(n);
+        }
+        return true;
+    }
+
+    inline static bool _writeFully(int fd, const void *bytes, size_t count) {
+        auto cursor = static_cast<const char *>(bytes);
+        while (count > 0) {
+            auto n = ::write(fd, cursor, count);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            cursor += n;
+            count -= size_t(n);
+        }
+        return true;
+    }
+
+    inline void _dispatch() {
+        for (auto& worker : _workers) {
+            if (_pending.empty()) {
+                return;
+            }
+            if (!worker->connected || worker->job) {
+                continue;
+            }
+            worker->job = _pending.front();
+            _pending.pop_front();
+
+            uint64_t length = worker->job->request->count();
+            auto frame = DispatchData(&length, sizeof(length));
+            frame.append(*worker->job->request);
+            worker->outgoing = std::make_shared<DispatchData>(frame);
+            _flush(worker);
+        }
+    }
+
+    inline void _flush(const std::shared_ptr<_DispatchProcessPoolWorkerState>& worker) {
+        while (worker->outgoing && worker->connected) {
+            std::vector<struct iovec> iov;
+            auto *vector = &iov;
+            worker->outgoing->enumerateBytes(^(const void *bytes, size_t count, size_t offset, bool *stop) {
+                vector->push_back({const_cast<void *>(bytes), count});
+                *stop = vector->size() == 64;
+            });
+
+            struct msghdr message {};
+            message.msg_iov = iov.data();
+            message.msg_iovlen = decltype(message.msg_iovlen)(iov.size());
+            auto written = sendmsg(worker->fd, &message, DISPATCH_PROCESS_POOL_SEND_FLAGS);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                _waitForSpace(worker, true);
+                return;
+            }
+            if (written < 0) {
+                // The worker is gone; its exit event fails the job.
+                worker->outgoing = nullptr;
+                break;
+            }
+            auto size = worker->outgoing->count();
+            if (size_t(written) < size) {
+                worker->outgoing = std::make_shared<DispatchData>(worker->outgoing->subdata(int(written), int(size)));
+            } else {
+                worker->outgoing = nullptr;
+            }
+        }
+        _waitForSpace(worker, false);
+    }
+
+    inline void _waitForSpace(const std::shared_ptr<_DispatchProcessPoolWorkerState>& worker, bool waiting) {
+        if (waiting == worker->waitingForSpace || !worker->connected) {
+            return;
+        }
+        worker->waitingForSpace = waiting;
+        if (waiting) {
+            worker->writeSource->resume();
+        } else {
+            worker->writeSource->suspend();
+        }
+    }
+
+    inline void _receive(const std::shared_ptr<_DispatchProcessPoolWorkerState>& worker) {
+        char buffer[DISPATCH_PROCESS_POOL_READ_BUFFER_SIZE];
+        while (true) {
+            auto n = ::read(worker->fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    // End-of-file: the worker died or is exiting, which its exit event reports.
+                    _disconnect(worker);
+                }
+                break;
+            }
+            worker->incoming.insert(worker->incoming.end(), buffer, buffer + n);
+        }
+
+        uint64_t length = 0;
+        if (!worker->job || worker->incoming.size() < sizeof(length)) {
+            return;
+        }
+        memcpy(&length, worker->incoming.data(), sizeof(length));
+        if (worker->incoming.size() < sizeof(length) + length) {
+            return;
+        }
+        auto response = std::make_shared<DispatchData>(worker->incoming.data() + sizeof(length), size_t(length));
+        worker->incoming.erase(worker->incoming.begin(), worker->incoming.begin() + long(sizeof(length) + length));
+        auto job = worker->job;
+        worker->job = nullptr;
+        _completed++;
+        _complete(job, response, 0);
+        _dispatch();
+    }
+
+    inline void _disconnect(const std::shared_ptr<_DispatchProcessPoolWorkerState>& worker) {
+        if (!worker->connected) {
+            return;
+        }
+        worker->connected = false;
+        worker->outgoing = nullptr;
+        // A suspended source can neither be cancelled nor released.
+        if (!worker->waitingForSpace) {
+            worker->waitingForSpace = true;
+            worker->writeSource->resume();
+        }
+        worker->readSource->cancel();
+        worker->writeSource->cancel();
+    }
+
+    // A worker that exits with a job fails it with ECHILD, rather than retrying a job that may
+    // crash every worker it is given to.
+    inline void _exited(const std::shared_ptr<_DispatchProcessPoolWorkerState>& worker) {
+        _disconnect(worker);
+        worker->exited = true;
+        worker->exitSource = nullptr;
+        if (worker->job) {
+            _failed++;
+            _complete(worker->job, nullptr, ECHILD);
+            worker->job = nullptr;
+        }
+        std::erase(_workers, worker);
+        if (!_stopped) {
+            _restarts++;
+            _spawn();
+            _dispatch();
+        }
+    }
+
+    inline static void _complete(
+            const std::shared_ptr<_DispatchProcessPoolJob>& job,
+            const std::shared_ptr<DispatchData>& response,
+            int error)
+    {
+        auto completion = job->completion;
+        if (!completion) {
+            return;
+        }
+        job->queue.async(^{
+            completion.get()(response, error);
+        });
+    }
+
+};
+
+///
+/// A pool of pre-forked worker processes running CPU-heavy or crash-prone jobs
+/// outside the calling process.
+///
+/// Each worker runs `worker` on one request at a time; requests and responses
+/// travel over a Unix socket pair as length-prefixed frames, sent from
+/// `DispatchData` without blocking the pool's queue. Jobs wait in a queue for an
+/// idle worker.
+///
+/// Workers are supervised with process sources rather than by polling `waitpid`:
+/// when one exits, for whatever reason, its exit event reaps it, fails the job it
+/// had with `ECHILD`, and forks a replacement.
+///
+/// Workers are forked from the calling process, and inherit its descriptors and
+/// memory as they are at that moment; see `DispatchProcessPoolWorker` for what
+/// they may do.
+///
+class DispatchProcessPool {
+
+public:
+
+    inline DispatchProcessPool(unsigned workers, DispatchProcessPoolWorker worker) {
+        _state = std::make_shared<_DispatchProcessPoolState>(workers, worker);
+        auto state = _state;
+        state->_queue.sync(^{
+            state->_start();
+        });
+    }
+
+    DispatchProcessPool(const DispatchProcessPool&) = delete;
+    DispatchProcessPool& operator= (const DispatchProcessPool&) = delete;
+
+    /// Fails the queued jobs with `ECANCELED`, and lets the workers exit.
+    inline ~DispatchProcessPool() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    ///
+    /// Runs a job on the next idle worker.
+    ///
+    /// - parameter completion: Invoked on `queue` with the response, or with a null response
+    ///     and `ECHILD` when the worker exited while running the job.
+    ///
+    inline void submit(const DispatchData& request, const DispatchQueue& queue, DispatchProcessPoolCompletion completion) {
+        auto state = _state;
+        auto job = std::make_shared<_DispatchProcessPoolJob>(_DispatchProcessPoolJob {
+            std::make_shared<DispatchData>(request),
+            queue,
+            _DispatchRetainedBlock<DispatchProcessPoolCompletion>(completion)
+        });
+        state->_queue.async(^{
+            state->_submit(job);
+        });
+    }
+
+    /// The process IDs of the live workers.
+    [[nodiscard]] inline std::vector<pid_t> pids() const {
+        auto state = _state;
+        __block std::vector<pid_t> pids;
+        state->_queue.sync(^{
+            pids = state->_pids();
+        });
+        return pids;
+    }
+
+    /// The number of workers forked to replace ones that exited.
+    [[nodiscard]] inline uint64_t restarts() const {
+        return _state->_restarts.load();
+    }
+
+    [[nodiscard]] inline uint64_t completed() const {
+        return _state->_completed.load();
+    }
+
+    /// The number of jobs lost with the worker running them.
+    [[nodiscard]] inline uint64_t failed() const {
+        return _state->_failed.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchProcessPoolState> _state;
+
+};
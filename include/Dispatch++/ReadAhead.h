@@ -0,0 +1,291 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/IO.h"
+#include "Dispatch++/Queue.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Consecutive sequential reads of a RANDOM channel before prefetching starts.
+#define DISPATCH_READ_AHEAD_TRIGGER 2
+
+typedef void (^DispatchReadAheadHandler)(bool done, const std::shared_ptr<DispatchData> data, int error);
+
+struct _DispatchReadAheadRequest {
+
+    _DispatchReadAheadRequest(off_t offset, size_t length, const DispatchQueue& queue, DispatchReadAheadHandler handler)
+        : offset(offset), length(length), queue(queue), handler(handler) {}
+
+    off_t offset;
+    size_t length;
+    unsigned int missing {0};
+    DispatchQueue queue;
+    _DispatchRetainedBlock<DispatchReadAheadHandler> handler;
+
+};
+
+struct _DispatchReadAheadChunk {
+    bool complete {false};
+    int error {0};
+    std::shared_ptr<DispatchData> data;
+    std::vector<std::shared_ptr<_DispatchReadAheadRequest>> waiters;
+};
+
+class _DispatchReadAheadState: public std::enable_shared_from_this<_DispatchReadAheadState> {
+
+public:
+
+    inline _DispatchReadAheadState(const DispatchIO& channel, DispatchIO::StreamType type, size_t chunkSize, unsigned int window)
+        : _channel(channel), _type(type), _chunkSize(std::max(chunkSize, size_t(1))), _window(window) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.ReadAhead"};
+    std::atomic<uint64_t> _hits {0};
+
+    inline void _read(off_t offset, size_t length, const DispatchQueue& queue, DispatchReadAheadHandler handler) {
+        bool sequential;
+        if (_type == DispatchIO::StreamType::STREAM) {
+            // Stream channels ignore offsets and are sequential by nature.
+            offset = _nextOffset;
+            sequential = true;
+        } else {
+            _streak = offset == _nextOffset ? _streak + 1 : 0;
+            sequential = _streak >= DISPATCH_READ_AHEAD_TRIGGER;
+        }
+        _nextOffset = offset + off_t(length);
+
+        if (!sequential) {
+            _evict(-1);
+            _dispatchIOReadFully(_channel, offset, length, queue, ^(const std::shared_ptr<DispatchData> data, int error) {
+                handler(true, data, error);
+            });
+            return;
+        }
+
+        if (_endOfFile >= 0 && offset >= _endOfFile) {
+            auto empty = std::make_shared<DispatchData>();
+            queue.async(^{
+                handler(true, empty, 0);
+            });
+            return;
+        }
+
+        auto request = std::make_shared<_DispatchReadAheadRequest>(offset, length, queue, handler);
+        auto first = _chunkOffset(offset);
+        auto last = _chunkOffset(offset + off_t(std::max(length, size_t(1))) - 1);
+        if (_endOfFile >= 0) {
+            // Chunks past the end of the file are never read; the last one is short.
+            last = std::min(last, _chunkOffset(_endOfFile));
+        }
+
+        _evict(first);
+        _prefetch(first, last + off_t(_window * _chunkSize));
+
+        for (auto chunkOffset = first; chunkOffset <= last; chunkOffset += off_t(_chunkSize)) {
+            auto& chunk = _chunks[chunkOffset];
+            if (!chunk.complete) {
+                chunk.waiters.push_back(request);
+                request->missing++;
+            }
+        }
+
+        if (request->missing == 0) {
+            _hits++;
+            _fulfil(request);
+        }
+    }
+
+private:
+
+    DispatchIO _channel;
+    DispatchIO::StreamType _type;
+    size_t _chunkSize;
+    unsigned int _window;
+
+    std::map<off_t, _DispatchReadAheadChunk> _chunks;
+    off_t _nextOffset {0};
+    off_t _issuedOffset {0};
+    off_t _endOfFile {-1};
+    unsigned int _streak {0};
+
+    [[nodiscard]] inline off_t _chunkOffset(off_t offset) const {
+        return offset - offset % off_t(_chunkSize);
+    }
+
+    // Drops the chunks before `offset` nobody waits for; all of them when `offset` is negative.
+    inline void _evict(off_t offset) {
+        for (auto it = _chunks.begin(); it != _chunks.end();) {
+            if ((offset < 0 || it->first < offset) && it->second.waiters.empty()) {
+                it = _chunks.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (offset < 0) {
+            _issuedOffset = 0;
+        }
+    }
+
+    // Issues the chunk reads in [from, through] that are not cached or in flight yet.
+    inline void _prefetch(off_t from, off_t through) {
+        if (_type == DispatchIO::StreamType::STREAM) {
+            // Stream chunks must be read in order, and exactly once.
+            from = std::max(from, _issuedOffset);
+        }
+        if (_endOfFile >= 0) {
+            through = std::min(through, _chunkOffset(_endOfFile));
+        }
+
+        off_t adviseFrom = -1;
+        for (auto chunkOffset = from; chunkOffset <= through; chunkOffset += off_t(_chunkSize)) {
+            if (_chunks.count(chunkOffset) != 0) {
+                continue;
+            }
+            _chunks[chunkOffset];
+            if (adviseFrom < 0) {
+                adviseFrom = chunkOffset;
+            }
+
+            auto weakSelf = std::weak_ptr<_DispatchReadAheadState>(shared_from_this());
+            _dispatchIOReadFully(_channel, chunkOffset, _chunkSize, _queue, ^(const std::shared_ptr<DispatchData> data, int error) {
+                if (auto state = weakSelf.lock()) {
+                    state->_completed(chunkOffset, data, error);
+                }
+            });
+        }
+        _issuedOffset = std::max(_issuedOffset, through + off_t(_chunkSize));
+
+        if (adviseFrom >= 0) {
+            _advise(adviseFrom, through + off_t(_chunkSize) - adviseFrom);
+        }
+    }
+
+    // Lets the kernel start filling the page cache for the whole window at once.
+    inline void _advise(off_t offset, off_t length) {
+        if (_type == DispatchIO::StreamType::STREAM) {
+            return;
+        }
+        auto fd = _channel.fileDescriptor();
+        if (fd < 0) {
+            return;
+        }
+#if defined(POSIX_FADV_WILLNEED)
+        posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+        struct radvisory advisory {};
+        advisory.ra_offset = offset;
+        advisory.ra_count = int(length);
+        fcntl(fd, F_RDADVISE, &advisory);
+#endif
+    }
+
+    inline void _completed(off_t chunkOffset, const std::shared_ptr<DispatchData>& data, int error) {
+        auto it = _chunks.find(chunkOffset);
+        if (it == _chunks.end()) {
+            return;
+        }
+
+        auto& chunk = it->second;
+        chunk.complete = true;
+        chunk.error = error;
+        chunk.data = data;
+        if (error == 0 && data->count() < _chunkSize) {
+            auto endOfFile = chunkOffset + off_t(data->count());
+            _endOfFile = _endOfFile < 0 ? endOfFile : std::min(_endOfFile, endOfFile);
+        }
+
+        auto waiters = std::move(chunk.waiters);
+        chunk.waiters.clear();
+        for (auto& request : waiters) {
+            if (--request->missing == 0) {
+                _fulfil(request);
+            }
+        }
+    }
+
+    inline void _fulfil(const std::shared_ptr<_DispatchReadAheadRequest>& request) {
+        auto first = _chunkOffset(request->offset);
+        auto result = DispatchData();
+        int error = 0;
+
+        for (auto chunkOffset = first; chunkOffset < request->offset + off_t(request->length); chunkOffset += off_t(_chunkSize)) {
+            auto& chunk = _chunks[chunkOffset];
+            if (chunk.error != 0) {
+                error = chunk.error;
+                break;
+            }
+            result.append(*chunk.data);
+            if (chunk.data->count() < _chunkSize) {
+                break;
+            }
+        }
+
+        auto handler = request->handler;
+        if (error != 0) {
+            request->queue.async(^{
+                handler.get()(true, nullptr, error);
+            });
+            return;
+        }
+
+        auto start = std::min(size_t(request->offset - first), result.count());
+        auto end = std::min(start + request->length, result.count());
+        auto data = std::make_shared<DispatchData>(result.subdata(int(start), int(end)));
+        request->queue.async(^{
+            handler.get()(true, data, 0);
+        });
+    }
+
+};
+
+///
+/// A read-ahead layer in front of a `DispatchIO` channel.
+///
+/// Once reads are found to be sequential (always for `STREAM` channels, after
+/// `DISPATCH_READ_AHEAD_TRIGGER` back to back reads for `RANDOM` ones) the file is
+/// read in chunks of `chunkSize` bytes, and the `window` chunks following the
+/// current read are requested early and kept until the reader passes them. The
+/// kernel is told about the window with `posix_fadvise(POSIX_FADV_WILLNEED)`.
+/// Non sequential reads go straight to the channel and drop the window.
+///
+/// Each `read` invokes its handler once, with `done` set and all of the data.
+///
+class DispatchReadAhead {
+
+public:
+
+    inline DispatchReadAhead(const DispatchIO& channel, DispatchIO::StreamType type, size_t chunkSize, unsigned int window) {
+        _state = std::make_shared<_DispatchReadAheadState>(channel, type, chunkSize, window);
+    }
+
+    inline void read(off_t offset, int length, const DispatchQueue& queue, DispatchReadAheadHandler ioHandler) {
+        auto state = _state;
+        auto target = queue;
+        auto handler = _DispatchRetainedBlock<DispatchReadAheadHandler>(ioHandler);
+        state->_queue.async(^{
+            state->_read(offset, size_t(length), target, handler.get());
+        });
+    }
+
+    /// The number of reads served entirely from chunks that were already prefetched.
+    [[nodiscard]] inline uint64_t hits() const {
+        return _state->_hits.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchReadAheadState> _state;
+
+};
@@ -0,0 +1,287 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Data.h"
+#include <dispatch/dispatch.h>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+#define DISPATCH_HAVE_MEMFD_SEALS 1
+#else
+#define DISPATCH_HAVE_MEMFD_SEALS 0
+#include <atomic>
+#include <cstdio>
+#endif
+
+///
+/// Bytes in an anonymous shared-memory file, which other processes can map
+/// instead of receiving a copy.
+///
+/// `make` fills a `memfd` region and, unless told otherwise, seals it against
+/// writes, shrinking and growing, so a receiver can map it without fearing the
+/// sender changes it underneath. `sendTo` passes the descriptor over a Unix
+/// socket with `SCM_RIGHTS`; `receive` (or `adopt`, for a descriptor obtained
+/// some other way) maps it read-only on the other side, and refuses a region
+/// that could still shrink.
+///
+/// `data()` is a `DispatchData` over the read-only mapping, which is unmapped
+/// with the `UNMAP` deallocator once the last data referring to it is gone.
+/// Without memfd sealing (outside Linux) the region is a POSIX shared memory
+/// object, `isSealed()` is false, and the sender must be trusted not to shrink it.
+///
+class DispatchSharedData {
+
+public:
+
+    ///
+    /// Creates a region of `count` bytes, which `initializer` fills in through a writable mapping.
+    ///
+    /// - parameter seal: Whether to forbid further writes and size changes once filled.
+    /// - returns: The region, or nullptr with `errno` set.
+    ///
+    inline static std::shared_ptr<DispatchSharedData> make(
+            size_t count,
+            DISPATCH_NOESCAPE void (^initializer)(void *bytes, size_t count),
+            bool seal = true)
+    {
+        if (count == 0 || count > size_t(INT_MAX)) {
+            errno = EINVAL;
+            return nullptr;
+        }
+        int fd = _create();
+        if (fd < 0) {
+            return nullptr;
+        }
+        if (ftruncate(fd, off_t(count)) != 0) {
+            return _fail(fd);
+        }
+        auto bytes = mmap(nullptr, count, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (bytes == MAP_FAILED) {
+            return _fail(fd);
+        }
+        if (initializer) {
+            initializer(bytes, count);
+        }
+        // A write seal is refused while a writable mapping exists.
+        munmap(bytes, count);
+
+        if (seal) {
+#if DISPATCH_HAVE_MEMFD_SEALS
+            if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+                return _fail(fd);
+            }
+#endif
+        }
+        return _map(fd, false);
+    }
+
+    ///
+    /// Maps a region received from another process. The region takes ownership of the descriptor.
+    ///
+    /// With memfd sealing, the region must be sealed against shrinking: a sender that could
+    /// shrink it would make reads of the mapping past the new end fault.
+    ///
+    /// - returns: The region, or nullptr with `errno` set, `EPERM` for a region that can
+    ///     shrink; the descriptor is closed either way.
+    ///
+    inline static std::shared_ptr<DispatchSharedData> adopt(int fileDescriptor) {
+        return _map(fileDescriptor, true);
+    }
+
+    DispatchSharedData(const DispatchSharedData&) = delete;
+    DispatchSharedData& operator= (const DispatchSharedData&) = delete;
+
+    inline ~DispatchSharedData() {
+        close(_fd);
+    }
+
+    /// The descriptor of the region, owned by it; `dup` it to keep it past the region.
+    [[nodiscard]] inline int fileDescriptor() const {
+        return _fd;
+    }
+
+    [[nodiscard]] inline size_t count() const {
+        return _count;
+    }
+
+    /// Whether the region can no longer be written to or resized, by anyone.
+    [[nodiscard]] inline bool isSealed() const {
+#if DISPATCH_HAVE_MEMFD_SEALS
+        auto seals = fcntl(_fd, F_GET_SEALS);
+        auto required = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+        return seals != -1 && (seals & required) == required;
+#else
+        return false;
+#endif
+    }
+
+    /// The bytes of the region, over a read-only mapping shared by every call.
+    [[nodiscard]] inline DispatchData data() const {
+        return *_data;
+    }
+
+    ///
+    /// Passes the descriptor, with the region size, over a connected Unix socket.
+    ///
+    /// - returns: 0, or the error of `sendmsg`.
+    ///
+    inline int sendTo(int socket) const {
+        uint64_t count = _count;
+        struct iovec iov = {&count, sizeof(count)};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+
+        struct msghdr message {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        auto header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &_fd, sizeof(int));
+
+        ssize_t sent;
+        do {
+            sent = sendmsg(socket, &message, 0);
+        } while (sent < 0 && errno == EINTR);
+        return sent < 0 ? errno : 0;
+    }
+
+    ///
+    /// Receives a region passed with `sendTo`, blocking until it arrives.
+    ///
+    /// - parameter result: Set to the mapped region on success.
+    /// - returns: 0, the error of `recvmsg` or of mapping the region (`EPERM` when it is not
+    ///     sealed against shrinking, as for `adopt`), or `EBADMSG` when the message carries no
+    ///     descriptor or its size does not match.
+    ///
+    inline static int receive(int socket, std::shared_ptr<DispatchSharedData>& result) {
+        uint64_t count = 0;
+        struct iovec iov = {&count, sizeof(count)};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+
+        struct msghdr message {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received;
+        do {
+#if defined(MSG_CMSG_CLOEXEC)
+            received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+#else
+            received = recvmsg(socket, &message, 0);
+#endif
+        } while (received < 0 && errno == EINTR);
+        if (received < 0) {
+            return errno;
+        }
+
+        int fd = -1;
+        auto header = CMSG_FIRSTHDR(&message);
+        if (header != nullptr && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            memcpy(&fd, CMSG_DATA(header), sizeof(int));
+        }
+        if (fd < 0) {
+            return EBADMSG;
+        }
+        if (received != sizeof(count) || (message.msg_flags & MSG_CTRUNC) != 0) {
+            close(fd);
+            return EBADMSG;
+        }
+
+        auto region = _map(fd, true);
+        if (!region) {
+            return errno;
+        }
+        if (region->_count != count) {
+            return EBADMSG;
+        }
+        result = region;
+        return 0;
+    }
+
+private:
+
+    inline DispatchSharedData(int fileDescriptor, size_t count, const void *bytes)
+        : _fd(fileDescriptor),
+          _count(count),
+          _data(std::make_shared<DispatchData>(bytes, int(count), DispatchData::Deallocator::UNMAP)) {}
+
+    int _fd;
+    size_t _count;
+    std::shared_ptr<DispatchData> _data;
+
+    inline static int _create() {
+#if DISPATCH_HAVE_MEMFD_SEALS
+        return memfd_create("Dispatch++.SharedData", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+        static std::atomic<unsigned> sequence {0};
+        char name[64];
+        snprintf(name, sizeof(name), "/Dispatch++.SharedData.%d.%u", int(getpid()), sequence++);
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            shm_unlink(name);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        return fd;
+#endif
+    }
+
+    inline static std::shared_ptr<DispatchSharedData> _fail(int fd) {
+        auto error = errno;
+        close(fd);
+        errno = error;
+        return nullptr;
+    }
+
+    inline static std::shared_ptr<DispatchSharedData> _map(int fd, bool received) {
+#if DISPATCH_HAVE_MEMFD_SEALS
+        // Checked before the size is read, which a shrink seal keeps from going down after.
+        if (received) {
+            auto seals = fcntl(fd, F_GET_SEALS);
+            if (seals == -1 || (seals & F_SEAL_SHRINK) == 0) {
+                close(fd);
+                errno = EPERM;
+                return nullptr;
+            }
+        }
+#else
+        (void)received;
+#endif
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            return _fail(fd);
+        }
+        if (st.st_size <= 0 || st.st_size > INT_MAX) {
+            close(fd);
+            errno = EINVAL;
+            return nullptr;
+        }
+        auto count = size_t(st.st_size);
+        auto bytes = mmap(nullptr, count, PROT_READ, MAP_SHARED, fd, 0);
+        if (bytes == MAP_FAILED) {
+            return _fail(fd);
+        }
+        return std::shared_ptr<DispatchSharedData>(new DispatchSharedData(fd, count, bytes));
+    }
+
+};
@@ -0,0 +1,393 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include <dispatch/dispatch.h>
+
+#if defined(__linux__) && __has_include(<sys/eventfd.h>)
+#define DISPATCH_HAVE_SHM_CHANNEL 1
+#else
+#define DISPATCH_HAVE_SHM_CHANNEL 0
+#endif
+
+#if DISPATCH_HAVE_SHM_CHANNEL
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#define DISPATCH_SHM_CHANNEL_MAGIC 0x44534843u
+
+struct _DispatchShmHeader {
+    uint32_t magic;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    alignas(64) std::atomic<uint64_t> enqueuePosition;
+    alignas(64) std::atomic<uint64_t> dequeuePosition;
+    // Set by the consumer before it sleeps; the producer that clears it rings the doorbell.
+    alignas(64) std::atomic<uint32_t> consumerWaiting;
+};
+
+struct _DispatchShmSlot {
+    std::atomic<uint64_t> sequence;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock-free");
+
+// The shared mapping, kept alive by every message that still points into it. The peer can
+// write the header at any time, so the geometry is read from it once, checked, and kept here.
+class _DispatchShmRegion {
+
+public:
+
+    inline _DispatchShmRegion(int memoryFD, int doorbellFD, void *base, size_t size)
+        : _memoryFD(memoryFD), _doorbellFD(doorbellFD), _base(base), _size(size) {}
+
+    inline ~_DispatchShmRegion() {
+        munmap(_base, _size);
+        close(_memoryFD);
+        close(_doorbellFD);
+    }
+
+    int _memoryFD;
+    int _doorbellFD;
+    void *_base;
+    size_t _size;
+    uint32_t _slotCount {0};
+    uint32_t _slotSize {0};
+    size_t _stride {0};
+
+    [[nodiscard]] inline _DispatchShmHeader *header() const {
+        return static_cast<_DispatchShmHeader *>(_base);
+    }
+
+    // Whether the slots fit in the mapping; if so, they are the ones used from now on.
+    inline bool setGeometry(uint32_t slotCount, uint32_t slotSize) {
+        auto stride = slotStride(slotSize);
+        if (slotCount == 0 || slotSize == 0 || _headerSize() + size_t(slotCount) * stride > _size) {
+            return false;
+        }
+        _slotCount = slotCount;
+        _slotSize = slotSize;
+        _stride = stride;
+        return true;
+    }
+
+    [[nodiscard]] inline _DispatchShmSlot *slot(uint64_t position) const {
+        auto index = position % _slotCount;
+        auto offset = _headerSize() + index * _stride;
+        return reinterpret_cast<_DispatchShmSlot *>(static_cast<char *>(_base) + offset);
+    }
+
+    [[nodiscard]] inline static size_t slotStride(uint32_t slotSize) {
+        return (sizeof(_DispatchShmSlot) + size_t(slotSize) + 63) / 64 * 64;
+    }
+
+    [[nodiscard]] inline static size_t _headerSize() {
+        return (sizeof(_DispatchShmHeader) + 63) / 64 * 64;
+    }
+
+};
+
+///
+/// A message channel between processes on one host over shared memory.
+///
+/// Messages go through a ring of fixed-size slots in a `memfd` region that both
+/// processes map. Any number of producers may `send` (the ring is a bounded
+/// multi-producer queue, with a sequence number per slot); one consumer
+/// receives. A sleeping consumer is woken through an `eventfd` doorbell and a
+/// read source, and producers only ring it when the consumer is actually
+/// waiting.
+///
+/// Received messages are `DispatchData` over the shared mapping itself: the
+/// slot is handed back to producers when the data is released, so hold on to
+/// messages no longer than needed.
+///
+/// `create` sets up a channel; the other process gets its descriptors
+/// (`memoryFileDescriptor()` and `doorbellFileDescriptor()`) by inheritance or
+/// over a Unix socket, and `attach`es to them. The region is sealed to its size,
+/// and each side trusts only the slot geometry it checked when it mapped it.
+///
+class DispatchShmChannel: public std::enable_shared_from_this<DispatchShmChannel> {
+
+public:
+
+    typedef void (^MessageHandler)(const std::shared_ptr<DispatchData> message);
+
+    ///
+    /// Creates a channel with `slotCount` slots holding messages of up to `slotSize` bytes.
+    ///
+    /// - returns: The channel, or nullptr with `errno` set.
+    ///
+    inline static std::shared_ptr<DispatchShmChannel> create(uint32_t slotCount, uint32_t slotSize) {
+        if (slotCount == 0 || slotSize == 0) {
+            errno = EINVAL;
+            return nullptr;
+        }
+        int memoryFD = memfd_create("Dispatch++.ShmChannel", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (memoryFD < 0) {
+            return nullptr;
+        }
+        auto size = _DispatchShmRegion::_headerSize() + size_t(slotCount) * _DispatchShmRegion::slotStride(slotSize);
+        int doorbellFD = -1;
+        // Sealed to its size, so no peer can truncate the mapping from under the other.
+        if (ftruncate(memoryFD, off_t(size)) != 0
+                || fcntl(memoryFD, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0
+                || (doorbellFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+            auto error = errno;
+            close(memoryFD);
+            errno = error;
+            return nullptr;
+        }
+
+        auto channel = _map(memoryFD, doorbellFD);
+        if (!channel) {
+            return nullptr;
+        }
+        channel->_region->setGeometry(slotCount, slotSize);
+        auto header = channel->_region->header();
+        header->magic = DISPATCH_SHM_CHANNEL_MAGIC;
+        header->slotCount = slotCount;
+        header->slotSize = slotSize;
+        header->enqueuePosition.store(0);
+        header->dequeuePosition.store(0);
+        header->consumerWaiting.store(0);
+        for (uint64_t i = 0; i < slotCount; i++) {
+            channel->_region->slot(i)->sequence.store(i, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return channel;
+    }
+
+    ///
+    /// Attaches to a channel created by another process. The channel takes ownership of
+    /// both descriptors, and closes them when attaching fails.
+    ///
+    /// The slot count and size are read from the region once, here: later changes to them by
+    /// the peer are ignored, and messages whose length does not fit a slot are dropped.
+    ///
+    /// - returns: The channel, or nullptr with `errno` set: `EPERM` when the region is not
+    ///   sealed against shrinking, `EINVAL` when it does not hold a channel whose slots fit in it.
+    ///
+    inline static std::shared_ptr<DispatchShmChannel> attach(int memoryFileDescriptor, int doorbellFileDescriptor) {
+        auto channel = _map(memoryFileDescriptor, doorbellFileDescriptor);
+        if (!channel) {
+            return nullptr;
+        }
+        auto header = channel->_region->header();
+        uint32_t slotCount = header->slotCount;
+        uint32_t slotSize = header->slotSize;
+        if (header->magic != DISPATCH_SHM_CHANNEL_MAGIC || !channel->_region->setGeometry(slotCount, slotSize)) {
+            errno = EINVAL;
+            return nullptr;
+        }
+        return channel;
+    }
+
+    DispatchShmChannel(const DispatchShmChannel&) = delete;
+    DispatchShmChannel& operator= (const DispatchShmChannel&) = delete;
+
+    inline ~DispatchShmChannel() {
+        if (_doorbellSource) {
+            _doorbellSource->cancel();
+        }
+    }
+
+    [[nodiscard]] inline int memoryFileDescriptor() const {
+        return _region->_memoryFD;
+    }
+
+    [[nodiscard]] inline int doorbellFileDescriptor() const {
+        return _region->_doorbellFD;
+    }
+
+    [[nodiscard]] inline size_t maxMessageSize() const {
+        return _region->_slotSize;
+    }
+
+    ///
+    /// Copies a message into the ring. Does not block, and does not use dispatch queues, so
+    /// it is safe to call in a forked child.
+    ///
+    /// - returns: 0, `EAGAIN` when the ring is full, or `EMSGSIZE` when the message does not fit a slot.
+    ///
+    inline int send(const void *bytes, size_t length) {
+        auto header = _region->header();
+        if (length > _region->_slotSize) {
+            return EMSGSIZE;
+        }
+
+        auto position = header->enqueuePosition.load(std::memory_order_relaxed);
+        _DispatchShmSlot *slot;
+        while (true) {
+            slot = _region->slot(position);
+            auto sequence = slot->sequence.load(std::memory_order_acquire);
+            auto difference = int64_t(sequence) - int64_t(position);
+            if (difference == 0) {
+                if (header->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // The slot still holds a message from the previous lap.
+                return EAGAIN;
+            } else {
+                position = header->enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        memcpy(reinterpret_cast<char *>(slot + 1), bytes, length);
+        slot->length = uint32_t(length);
+        // Sequentially consistent, like the consumer's store of `consumerWaiting` before its
+        // second look: one of the two sees the other's store, and no wakeup is lost.
+        slot->sequence.store(position + 1, std::memory_order_seq_cst);
+
+        if (header->consumerWaiting.load(std::memory_order_seq_cst) != 0 && header->consumerWaiting.exchange(0) != 0) {
+            uint64_t one = 1;
+            while (write(_region->_doorbellFD, &one, sizeof(one)) < 0 && errno == EINTR) {}
+        }
+        return 0;
+    }
+
+    inline int send(DispatchData message) {
+        if (message.count() > _region->_slotSize) {
+            return EMSGSIZE;
+        }
+        __block int result = 0;
+        message.withUnsafeBytes(^(const void *bytes, size_t count) {
+            result = send(bytes, count);
+        });
+        return result;
+    }
+
+    ///
+    /// Starts receiving, as the channel's only consumer.
+    ///
+    /// - parameter queue: The serial queue on which `handler` is invoked, once per message, in order.
+    ///
+    inline void receive(const DispatchQueue& queue, MessageHandler handler) {
+        _handler = _DispatchRetainedBlock<MessageHandler>(handler);
+        _queue = std::make_shared<DispatchQueue>(queue);
+
+        auto weakSelf = std::weak_ptr<DispatchShmChannel>(shared_from_this());
+        _doorbellSource = DispatchSource::makeReadSource(_region->_doorbellFD, _queue.get());
+        _doorbellSource->setEventHandler(^{
+            if (auto channel = weakSelf.lock()) {
+                channel->_drain();
+            }
+        });
+        // The region closes the doorbell when it goes, which must wait for the source to be
+        // cancelled: until then the descriptor is still registered, and must not be reused.
+        auto region = _region;
+        _doorbellSource->setCancelHandler(^{
+            (void)region;
+        });
+        _doorbellSource->resume();
+        queue.async(^{
+            if (auto channel = weakSelf.lock()) {
+                channel->_drain();
+            }
+        });
+    }
+
+    /// Stops receiving. Messages already delivered stay valid.
+    inline void cancel() {
+        if (_doorbellSource) {
+            _doorbellSource->cancel();
+        }
+    }
+
+private:
+
+    inline explicit DispatchShmChannel(std::shared_ptr<_DispatchShmRegion> region): _region(std::move(region)) {}
+
+    std::shared_ptr<_DispatchShmRegion> _region;
+    std::shared_ptr<DispatchQueue> _queue;
+    std::shared_ptr<DispatchSourceRead> _doorbellSource;
+    _DispatchRetainedBlock<MessageHandler> _handler;
+
+    // Takes ownership of both descriptors, and closes them on failure.
+    inline static std::shared_ptr<DispatchShmChannel> _map(int memoryFD, int doorbellFD) {
+        struct stat st {};
+        void *base = MAP_FAILED;
+        auto seals = fcntl(memoryFD, F_GET_SEALS);
+        if (seals == -1 || (seals & F_SEAL_SHRINK) == 0) {
+            errno = EPERM;
+        } else if (fstat(memoryFD, &st) == 0) {
+            if (size_t(st.st_size) < _DispatchShmRegion::_headerSize()) {
+                errno = EINVAL;
+            } else {
+                base = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, memoryFD, 0);
+            }
+        }
+        if (base == MAP_FAILED) {
+            auto error = errno;
+            close(memoryFD);
+            close(doorbellFD);
+            errno = error;
+            return nullptr;
+        }
+        auto region = std::make_shared<_DispatchShmRegion>(memoryFD, doorbellFD, base, size_t(st.st_size));
+        return std::shared_ptr<DispatchShmChannel>(new DispatchShmChannel(region));
+    }
+
+    inline void _drain() {
+        uint64_t rung;
+        while (read(_region->_doorbellFD, &rung, sizeof(rung)) < 0 && errno == EINTR) {}
+
+        auto header = _region->header();
+        while (true) {
+            auto position = header->dequeuePosition.load(std::memory_order_relaxed);
+            auto slot = _region->slot(position);
+            if (slot->sequence.load(std::memory_order_acquire) != position + 1) {
+                // Empty: announce the wait, then look once more for a message that raced it.
+                header->consumerWaiting.store(1, std::memory_order_seq_cst);
+                if (slot->sequence.load(std::memory_order_seq_cst) != position + 1) {
+                    return;
+                }
+                header->consumerWaiting.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            header->dequeuePosition.store(position + 1, std::memory_order_relaxed);
+
+            // The slot goes back to the producers, one lap later, when the data is released.
+            auto region = _region;
+            auto next = position + _region->_slotCount;
+            // Read once: the peer may still be writing it.
+            uint32_t length = *static_cast<volatile uint32_t *>(&slot->length);
+            if (length > _region->_slotSize) {
+                // Written by a broken or hostile peer: the bytes past the slot are not its message.
+                slot->sequence.store(next, std::memory_order_release);
+                continue;
+            }
+            auto message = std::make_shared<DispatchData>(
+                    reinterpret_cast<const char *>(slot + 1), int(length), *_queue, ^{
+                slot->sequence.store(next, std::memory_order_release);
+                (void)region;
+            });
+            if (_handler) {
+                _handler.get()(message);
+            }
+        }
+    }
+
+};
+
+#endif // DISPATCH_HAVE_SHM_CHANNEL
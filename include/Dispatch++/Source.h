@@ -12,6 +12,21 @@
 #include "Dispatch++/Object.h"
 #include <dispatch/dispatch.h>
 #include <cmath>
+#include <memory>
+#include <sys/types.h>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// The epoll backend of libdispatch has no process filter; exits are observed through a pidfd.
+#if defined(__linux__) && defined(SYS_pidfd_open)
+#define DISPATCH_HAVE_PIDFD 1
+#else
+#define DISPATCH_HAVE_PIDFD 0
+#endif
 
 typedef void (^DispatchSourceHandler)(void);
 
@@ -129,10 +144,31 @@ public:
 class DispatchSourceWrite: public DispatchSourceProtocol {
 };
 
+class DispatchSourceFileSystemObject: public DispatchSourceProtocol {
+public:
+    /// The file descriptor being monitored.
+    inline int32_t fileDescriptor() {
+        return int32_t(getHandle());
+    }
+};
+
+class DispatchSourceProcess: public DispatchSourceProtocol {
+public:
+    /// The process being monitored.
+    inline pid_t pid() {
+        return pid_t(getHandle());
+    }
+};
+
+class DispatchSourceMemoryPressure: public DispatchSourceProtocol {
+};
+
 class DispatchSource: public DispatchObject, public DispatchSourceRead,
                       public  DispatchSourceSignal, public DispatchSourceTimer,
                       public DispatchSourceUserDataAdd, public DispatchSourceUserDataOr,
-                      public DispatchSourceUserDataReplace, public DispatchSourceWrite
+                      public DispatchSourceUserDataReplace, public DispatchSourceWrite,
+                      public DispatchSourceProcess, public DispatchSourceFileSystemObject,
+                      public DispatchSourceMemoryPressure
 {
 public:
 
@@ -270,6 +306,21 @@ public:
         ALL     = DELETE | WRITE | EXTEND | ATTRIB | LINK | RENAME | REVOKE | FUNLOCK
     };
 
+    enum struct ProcessEvent: uint {
+        EXIT   = 0x80000000,
+        FORK   = 0x40000000,
+        EXEC   = 0x20000000,
+        SIGNAL = 0x08000000,
+        ALL    = EXIT | FORK | EXEC | SIGNAL
+    };
+
+    enum struct MemoryPressureEvent: uint {
+        NORMAL   = 0x1,
+        WARN     = 0x2,
+        CRITICAL = 0x4,
+        ALL      = NORMAL | WARN | CRITICAL
+    };
+
     static std::shared_ptr<DispatchSourceRead> makeReadSource(int32_t fileDescriptor, const DispatchQueue *queue = nullptr);
     static std::shared_ptr<DispatchSourceSignal> makeSignalSource(int32_t signal, const DispatchQueue *queue = nullptr);
 
@@ -283,6 +334,51 @@ public:
     static std::shared_ptr<DispatchSourceUserDataReplace> makeUserDataReplaceSource(const DispatchQueue *queue = nullptr);
     static std::shared_ptr<DispatchSourceWrite> makeWriteSource(int32_t fileDescriptor, const DispatchQueue *queue = nullptr);
 
+    ///
+    /// Creates a source monitoring the file or directory open as `fileDescriptor` for the
+    /// events in `eventMask`; `getData()` then holds the events that occurred, as
+    /// `FileSystemEvent` bits. The descriptor must stay open until the source is cancelled.
+    ///
+    /// On Linux the source is backed by inotify, which cannot tell `WRITE` from `EXTEND`, nor
+    /// `ATTRIB` from `LINK`, and reports both of each pair; `FUNLOCK` is never reported.
+    ///
+    /// - returns: The source, or nullptr when the file cannot be monitored.
+    ///
+    static std::shared_ptr<DispatchSourceFileSystemObject> makeFileSystemObjectSource(
+            int32_t fileDescriptor,
+            FileSystemEvent eventMask,
+            const DispatchQueue *queue = nullptr);
+
+    ///
+    /// Creates a source monitoring the process `pid` for the events in `eventMask`; `getData()`
+    /// then holds the events that occurred, as `ProcessEvent` bits.
+    ///
+    /// Where libdispatch cannot monitor processes (Linux), only `EXIT` is reported, through a
+    /// pidfd, and the source cancels itself once it has delivered the exit.
+    ///
+    /// - returns: The source, or nullptr when the events cannot be monitored or the process is gone.
+    ///
+    static std::shared_ptr<DispatchSourceProcess> makeProcessSource(
+            pid_t pid,
+            ProcessEvent eventMask,
+            const DispatchQueue *queue = nullptr);
+
+    ///
+    /// Creates a source reporting the memory pressure of the system for the levels in
+    /// `eventMask`; `getData()` then holds the level that was reached, as a
+    /// `MemoryPressureEvent` bit.
+    ///
+    /// On Linux, where libdispatch has no memory pressure source, the pressure is that of the
+    /// cgroup the process runs in, read from its `memory.events`: the `high` limit being hit
+    /// is `WARN`, and the `max` limit or the OOM killer is `CRITICAL`. `NORMAL` is reported
+    /// once a second has passed without either.
+    ///
+    /// - returns: The source, or nullptr when the memory pressure cannot be monitored.
+    ///
+    static std::shared_ptr<DispatchSourceMemoryPressure> makeMemoryPressureSource(
+            MemoryPressureEvent eventMask,
+            const DispatchQueue *queue = nullptr);
+
     // MARK: - DispatchSourceTimer
 
     ///
@@ -506,3 +602,136 @@ private:
     explicit DispatchSource(dispatch_source_t source) : _wrapped(source) {}
 
 };
+
+#if DISPATCH_HAVE_PIDFD
+
+// A process source over a pidfd, which becomes readable once the process has exited.
+class _DispatchPidfdSource: public DispatchSourceProcess {
+
+public:
+
+    inline _DispatchPidfdSource(pid_t pid, int pidfd, const DispatchQueue *queue)
+        : _pid(pid), _pidfd(std::make_shared<_Descriptor>(pidfd)), _source(DispatchSource::makeReadSource(pidfd, queue))
+    {
+        // Every handler holds the descriptor, so it is closed only once the source lets go of them.
+        auto descriptor = _pidfd;
+        _source->setCancelHandler(^{
+            (void)descriptor;
+        });
+    }
+
+    // MARK: - DispatchSourceProtocol
+
+    inline void setEventHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setEventHandler(qos, flags, _wrapEvent(handler).get());
+    }
+
+    inline void setEventHandler(DispatchWorkItem handler) override {
+        _source->setEventHandler(_wrapEvent(handler._block).get());
+    }
+
+    inline void setCancelHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setCancelHandler(qos, flags, _wrap(handler).get());
+    }
+
+    inline void setCancelHandler(DispatchWorkItem handler) override {
+        _source->setCancelHandler(_wrap(handler._block).get());
+    }
+
+    inline void setRegistrationHandler(
+            DispatchQoS qos,
+            DispatchWorkItemFlags flags,
+            DispatchSourceHandler _Nullable handler) override
+    {
+        _source->setRegistrationHandler(qos, flags, _wrap(handler).get());
+    }
+
+    inline void setRegistrationHandler(DispatchWorkItem handler) override {
+        _source->setRegistrationHandler(_wrap(handler._block).get());
+    }
+
+    inline void activate() override {
+        _source->activate();
+    }
+
+    inline void cancel() override {
+        _source->cancel();
+    }
+
+    inline void resume() override {
+        _source->resume();
+    }
+
+    inline void suspend() override {
+        _source->suspend();
+    }
+
+    inline uint getHandle() override {
+        return uint(_pid);
+    }
+
+    inline uint getMask() override {
+        return uint(DispatchSource::ProcessEvent::EXIT);
+    }
+
+    inline uint getData() override {
+        struct pollfd descriptor = {_pidfd->fd, POLLIN, 0};
+        return poll(&descriptor, 1, 0) > 0 ? uint(DispatchSource::ProcessEvent::EXIT) : 0;
+    }
+
+    inline bool isCancelled() override {
+        return _source->isCancelled();
+    }
+
+private:
+
+    struct _Descriptor {
+        int fd;
+        inline explicit _Descriptor(int descriptor): fd(descriptor) {}
+        inline ~_Descriptor() {
+            close(fd);
+        }
+    };
+
+    pid_t _pid;
+    std::shared_ptr<_Descriptor> _pidfd;
+    std::shared_ptr<DispatchSourceRead> _source;
+
+    inline _DispatchRetainedBlock<DispatchSourceHandler> _wrap(DispatchSourceHandler _Nullable handler) {
+        if (handler == nullptr) {
+            return _DispatchRetainedBlock<DispatchSourceHandler>();
+        }
+        auto descriptor = _pidfd;
+        return _DispatchRetainedBlock<DispatchSourceHandler>(^{
+            handler();
+            (void)descriptor;
+        });
+    }
+
+    // The pidfd stays readable, so the exit is delivered once and the source cancelled.
+    inline _DispatchRetainedBlock<DispatchSourceHandler> _wrapEvent(DispatchSourceHandler _Nullable handler) {
+        if (handler == nullptr) {
+            return _DispatchRetainedBlock<DispatchSourceHandler>();
+        }
+        auto descriptor = _pidfd;
+        auto source = std::weak_ptr<DispatchSourceRead>(_source);
+        return _DispatchRetainedBlock<DispatchSourceHandler>(^{
+            if (auto readSource = source.lock(); readSource && !readSource->isCancelled()) {
+                handler();
+                readSource->cancel();
+            }
+            (void)descriptor;
+        });
+    }
+
+};
+
+#endif
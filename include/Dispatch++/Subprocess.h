@@ -0,0 +1,305 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/Group.h"
+#include "Dispatch++/IO.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <fcntl.h>
+#include <memory>
+#include <spawn.h>
+#include <string>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+///
+/// A child process whose standard streams are served by dispatch I/O channels.
+///
+/// `spawn` starts the program with `posix_spawnp`, and reads its standard output
+/// and error through `STREAM` channels, handing each chunk to the output handlers
+/// as it arrives; no thread waits on a pipe. The exit is observed with a process
+/// source, and the termination handler runs once the process has exited and both
+/// of its output streams have reached end-of-file.
+///
+/// Handlers are invoked on the queue given to `spawn`; give a serial queue to get
+/// the chunks of each stream in order. A running subprocess keeps itself alive
+/// until its termination handler has run.
+///
+class DispatchSubprocess: public std::enable_shared_from_this<DispatchSubprocess> {
+
+public:
+
+    typedef void (^OutputHandler)(const std::shared_ptr<DispatchData> chunk);
+
+    /// Invoked with the status from `waitpid`, and whether the timeout killed the process.
+    typedef void (^TerminationHandler)(int status, bool timedOut);
+
+    ///
+    /// Starts a program.
+    ///
+    /// - parameter argv: The program, looked up in `PATH`, followed by its arguments.
+    /// - parameter env: The environment as `NAME=value` strings, or empty to inherit ours.
+    /// - parameter queue: The queue on which the handlers are invoked.
+    /// - parameter timeout: How long the process may run before it is sent `SIGKILL`.
+    /// - returns: The subprocess, or nullptr with `errno` set when it could not be started.
+    ///
+    inline static std::shared_ptr<DispatchSubprocess> spawn(
+            const std::vector<std::string>& argv,
+            const std::vector<std::string>& env,
+            const DispatchQueue& queue,
+            OutputHandler standardOutput,
+            OutputHandler standardError,
+            TerminationHandler termination,
+            const DispatchTimeInterval& timeout = DispatchTimeInterval::never())
+    {
+        if (argv.empty()) {
+            errno = EINVAL;
+            return nullptr;
+        }
+        auto process = std::shared_ptr<DispatchSubprocess>(new DispatchSubprocess(queue));
+        process->_standardOutput = _DispatchRetainedBlock<OutputHandler>(standardOutput);
+        process->_standardError = _DispatchRetainedBlock<OutputHandler>(standardError);
+        process->_termination = _DispatchRetainedBlock<TerminationHandler>(termination);
+
+        auto error = process->_launch(argv, env);
+        if (error != 0) {
+            errno = error;
+            return nullptr;
+        }
+        process->_start(timeout);
+        return process;
+    }
+
+    DispatchSubprocess(const DispatchSubprocess&) = delete;
+    DispatchSubprocess& operator= (const DispatchSubprocess&) = delete;
+
+    [[nodiscard]] inline pid_t pid() const {
+        return _pid;
+    }
+
+    /// Writes `data` to the standard input of the process, after what was written before.
+    inline void write(const DispatchData& data, void (^completion)(int error) = nullptr) {
+        auto retainedCompletion = _DispatchRetainedBlock<void (^)(int)>(completion);
+        _input->write(0, data, _queue, ^(bool done, const std::shared_ptr<DispatchData> remaining, int error) {
+            if (done && retainedCompletion) {
+                retainedCompletion.get()(error);
+            }
+        });
+    }
+
+    /// Closes the standard input of the process, once the pending writes are done.
+    inline void closeInput() {
+        _input->close();
+    }
+
+    /// Sends `signal` to the process, unless it has already exited.
+    inline void terminate(int signal = SIGTERM) {
+        auto process = shared_from_this();
+        _control.async(^{
+            process->_kill(signal);
+        });
+    }
+
+private:
+
+    inline explicit DispatchSubprocess(const DispatchQueue& queue): _queue(queue) {}
+
+    DispatchQueue _queue;
+    DispatchQueue _control {"tech.shifor.Dispatch++.Subprocess"};
+    DispatchGroup _group;
+    pid_t _pid {-1};
+    int _status {0};
+    bool _exited {false};
+    bool _timedOut {false};
+    std::shared_ptr<DispatchIO> _input;
+    std::shared_ptr<DispatchIO> _output;
+    std::shared_ptr<DispatchIO> _error;
+    std::shared_ptr<DispatchSourceProcess> _exitSource;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    _DispatchRetainedBlock<OutputHandler> _standardOutput;
+    _DispatchRetainedBlock<OutputHandler> _standardError;
+    _DispatchRetainedBlock<TerminationHandler> _termination;
+
+    inline static int _pipe(int fds[2]) {
+#if defined(__linux__)
+        return pipe2(fds, O_CLOEXEC) == 0 ? 0 : errno;
+#else
+        if (pipe(fds) != 0) {
+            return errno;
+        }
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        return 0;
+#endif
+    }
+
+    inline static void _closePipes(int pipes[3][2]) {
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 2; j++) {
+                if (pipes[i][j] >= 0) {
+                    ::close(pipes[i][j]);
+                }
+            }
+        }
+    }
+
+    // Our ends of the pipes are close-on-exec; the child's are duplicated onto 0, 1 and 2.
+    inline int _launch(const std::vector<std::string>& argv, const std::vector<std::string>& env) {
+        int pipes[3][2] = {{-1, -1}, {-1, -1}, {-1, -1}};
+        for (auto& pair : pipes) {
+            auto error = _pipe(pair);
+            if (error != 0) {
+                _closePipes(pipes);
+                return error;
+            }
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, pipes[0][0], STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, pipes[1][1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, pipes[2][1], STDERR_FILENO);
+
+        std::vector<char *> arguments;
+        for (auto& argument : argv) {
+            arguments.push_back(const_cast<char *>(argument.c_str()));
+        }
+        arguments.push_back(nullptr);
+        std::vector<char *> environment;
+        for (auto& variable : env) {
+            environment.push_back(const_cast<char *>(variable.c_str()));
+        }
+        environment.push_back(nullptr);
+
+        auto error = posix_spawnp(&_pid, arguments[0], &actions, nullptr, arguments.data(),
+                                  env.empty() ? environ : environment.data());
+        posix_spawn_file_actions_destroy(&actions);
+        if (error != 0) {
+            _closePipes(pipes);
+            return error;
+        }
+
+        ::close(pipes[0][0]);
+        ::close(pipes[1][1]);
+        ::close(pipes[2][1]);
+        auto stdinFD = pipes[0][1];
+        auto stdoutFD = pipes[1][0];
+        auto stderrFD = pipes[2][0];
+        _input = std::make_shared<DispatchIO>(DispatchIO::StreamType::STREAM, stdinFD, _queue, ^(int) {
+            ::close(stdinFD);
+        });
+        _output = std::make_shared<DispatchIO>(DispatchIO::StreamType::STREAM, stdoutFD, _queue, ^(int) {
+            ::close(stdoutFD);
+        });
+        _error = std::make_shared<DispatchIO>(DispatchIO::StreamType::STREAM, stderrFD, _queue, ^(int) {
+            ::close(stderrFD);
+        });
+        return 0;
+    }
+
+    inline void _start(const DispatchTimeInterval& timeout) {
+        auto process = shared_from_this();
+
+        _read(_output, _standardOutput);
+        _read(_error, _standardError);
+
+        _group.enter();
+        _exitSource = DispatchSource::makeProcessSource(_pid, DispatchSource::ProcessEvent::EXIT, &_control);
+        if (_exitSource) {
+            _exitSource->setEventHandler(^{
+                process->_reap();
+            });
+            _exitSource->resume();
+        } else {
+            // Without process sources, a utility thread waits for the exit instead.
+            DispatchQueue::global(DispatchQoS::QoSClass::UTILITY).async(^{
+                int status = 0;
+                while (waitpid(process->_pid, &status, 0) < 0 && errno == EINTR) {}
+                process->_control.async(^{
+                    process->_exited = true;
+                    process->_status = status;
+                    process->_finishExit();
+                });
+            });
+        }
+
+        if (timeout != DispatchTimeInterval::never()) {
+            _timer = DispatchSource::makeTimerSource(&_control);
+            _timer->setEventHandler(^{
+                if (!process->_exited) {
+                    process->_timedOut = true;
+                    process->_kill(SIGKILL);
+                }
+            });
+            _timer->schedule(DispatchTime::now() + timeout);
+            _timer->resume();
+        }
+
+        _group.notify(_queue, ^{
+            if (process->_termination) {
+                process->_termination.get()(process->_status, process->_timedOut);
+            }
+            // Lets go of the handlers, which hold the subprocess.
+            process->_standardOutput = _DispatchRetainedBlock<OutputHandler>();
+            process->_standardError = _DispatchRetainedBlock<OutputHandler>();
+            process->_termination = _DispatchRetainedBlock<TerminationHandler>();
+        });
+    }
+
+    // Low water of one byte: a chunk is delivered as soon as the pipe has anything.
+    inline void _read(const std::shared_ptr<DispatchIO>& channel, const _DispatchRetainedBlock<OutputHandler>& handler) {
+        auto group = _group;
+        group.enter();
+        channel->setLowWater(1);
+        channel->read(0, INT_MAX, _queue, ^(bool done, const std::shared_ptr<DispatchData> data, int error) {
+            if (data && data->count() > 0 && handler) {
+                handler.get()(std::make_shared<DispatchData>(*data));
+            }
+            if (done) {
+                channel->close();
+                group.leave();
+            }
+        });
+    }
+
+    inline void _reap() {
+        int status = 0;
+        while (waitpid(_pid, &status, 0) < 0 && errno == EINTR) {}
+        _exited = true;
+        _status = status;
+        _exitSource->cancel();
+        _finishExit();
+    }
+
+    inline void _finishExit() {
+        if (_timer) {
+            _timer->cancel();
+        }
+        _group.leave();
+    }
+
+    // Runs on the control queue, where the reaping happens, so a reused pid is never signalled.
+    inline void _kill(int signal) {
+        if (!_exited) {
+            ::kill(_pid, signal);
+        }
+    }
+
+};
@@ -0,0 +1,493 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/BufferPool.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/QoS.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define DISPATCH_TCP_READ_BUFFER_SIZE (16 * 1024)
+// Reads per read source event, so one busy connection cannot hold its shard for long.
+#define DISPATCH_TCP_MAX_READS_PER_EVENT 16
+#define DISPATCH_TCP_MAX_IOV 64
+#define DISPATCH_TCP_LISTEN_BACKLOG 1024
+// How long a listener rests when the process or system is out of descriptors.
+#define DISPATCH_TCP_ACCEPT_RETRY_MS 100
+
+// A peer that went away is reported as EPIPE rather than with SIGPIPE.
+#if defined(MSG_NOSIGNAL)
+#define DISPATCH_TCP_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define DISPATCH_TCP_SEND_FLAGS 0
+#endif
+
+///
+/// One accepted connection of a `DispatchTCPServer`.
+///
+/// All of a connection's handlers run on its shard's serial queue. The connection
+/// stays alive while it is open, and closes on end-of-file, on an error, or on
+/// `close()`; the close handler then runs once, and the descriptor is closed once
+/// both sources are cancelled.
+///
+class DispatchTCPConnection: public std::enable_shared_from_this<DispatchTCPConnection> {
+
+public:
+
+    typedef void (^DataHandler)(const std::shared_ptr<DispatchData> data);
+    typedef void (^CloseHandler)(int error);
+
+    DispatchTCPConnection(const DispatchTCPConnection&) = delete;
+    DispatchTCPConnection& operator= (const DispatchTCPConnection&) = delete;
+
+    /// Sets the handler invoked with each piece of data received. Call from the connection handler.
+    inline void onData(DataHandler handler) {
+        _dataHandler = _DispatchRetainedBlock<DataHandler>(handler);
+    }
+
+    /// Sets the handler invoked when the connection closes, with 0 for an orderly close.
+    inline void onClose(CloseHandler handler) {
+        _closeHandler = _DispatchRetainedBlock<CloseHandler>(handler);
+    }
+
+    /// Queues `data` for sending. Writes are coalesced into vectored sends, and never block the shard.
+    inline void send(const DispatchData& data) {
+        auto connection = shared_from_this();
+        auto copy = data;
+        _queue.async(^{
+            connection->_send(copy);
+        });
+    }
+
+    /// Sends what the socket takes right away, then closes the connection.
+    inline void close() {
+        auto connection = shared_from_this();
+        _queue.async(^{
+            connection->_flush();
+            connection->_close(0);
+        });
+    }
+
+    [[nodiscard]] inline int fileDescriptor() const {
+        return _fd;
+    }
+
+    [[nodiscard]] inline const struct sockaddr_storage& peerAddress() const {
+        return _peerAddress;
+    }
+
+    [[nodiscard]] inline const DispatchQueue& queue() const {
+        return _queue;
+    }
+
+private:
+
+    inline DispatchTCPConnection(
+            int fileDescriptor,
+            const struct sockaddr_storage& peerAddress,
+            const DispatchQueue& queue,
+            const std::shared_ptr<DispatchBufferPool>& pool)
+        : _fd(fileDescriptor), _peerAddress(peerAddress), _queue(queue), _pool(pool) {}
+
+    int _fd;
+    struct sockaddr_storage _peerAddress;
+    DispatchQueue _queue;
+    std::shared_ptr<DispatchBufferPool> _pool;
+    std::shared_ptr<DispatchSourceRead> _readSource;
+    std::shared_ptr<DispatchSourceWrite> _writeSource;
+    _DispatchRetainedBlock<DataHandler> _dataHandler;
+    _DispatchRetainedBlock<CloseHandler> _closeHandler;
+    std::deque<std::shared_ptr<DispatchData>> _outgoing;
+    bool _waitingForSpace {false};
+    bool _closed {false};
+
+    // Runs on the shard queue; the sources hold the connection until they are cancelled.
+    inline void _start() {
+        auto connection = shared_from_this();
+        auto fd = _fd;
+        auto cancelled = std::make_shared<std::atomic<int>>(0);
+        auto closeWhenCancelled = _DispatchRetainedBlock<DispatchSourceHandler>(^{
+            if (++*cancelled == 2) {
+                ::close(fd);
+            }
+        });
+
+        _readSource = DispatchSource::makeReadSource(_fd, &_queue);
+        _readSource->setEventHandler(^{
+            connection->_receive();
+        });
+        _readSource->setCancelHandler(closeWhenCancelled.get());
+
+        _writeSource = DispatchSource::makeWriteSource(_fd, &_queue);
+        _writeSource->setEventHandler(^{
+            connection->_flush();
+        });
+        _writeSource->setCancelHandler(closeWhenCancelled.get());
+
+        _readSource->resume();
+        // The write source is resumed only while the socket is full.
+    }
+
+    inline void _receive() {
+        for (int i = 0; i < DISPATCH_TCP_MAX_READS_PER_EVENT && !_closed; i++) {
+            auto buffer = _pool->acquire();
+            auto n = ::read(_fd, buffer, _pool->bufferSize());
+            if (n <= 0) {
+                _pool->release(buffer);
+                if (n == 0) {
+                    _close(0);
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    _close(errno);
+                }
+                return;
+            }
+
+            auto data = std::make_shared<DispatchData>(_pool->wrap(buffer, size_t(n)));
+            if (_dataHandler) {
+                _dataHandler.get()(data);
+            }
+            if (size_t(n) < _pool->bufferSize()) {
+                return;
+            }
+        }
+    }
+
+    inline void _send(const DispatchData& data) {
+        if (_closed || data.count() == 0) {
+            return;
+        }
+        _outgoing.push_back(std::make_shared<DispatchData>(data));
+        if (!_waitingForSpace) {
+            _flush();
+        }
+    }
+
+    inline void _flush() {
+        while (!_outgoing.empty() && !_closed) {
+            std::vector<struct iovec> iov;
+            auto *vector = &iov;
+            for (auto& fragment : _outgoing) {
+                fragment->enumerateBytes(^(const void *bytes, size_t count, size_t offset, bool *stop) {
+                    vector->push_back({const_cast<void *>(bytes), count});
+                    *stop = vector->size() == DISPATCH_TCP_MAX_IOV;
+                });
+                if (iov.size() == DISPATCH_TCP_MAX_IOV) {
+                    break;
+                }
+            }
+
+            struct msghdr message {};
+            message.msg_iov = iov.data();
+            message.msg_iovlen = decltype(message.msg_iovlen)(iov.size());
+            auto written = sendmsg(_fd, &message, DISPATCH_TCP_SEND_FLAGS);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                _waitForSpace(true);
+                return;
+            }
+            if (written < 0) {
+                _close(errno);
+                return;
+            }
+
+            // A partly sent fragment is kept as the subrange still to go.
+            auto remaining = size_t(written);
+            while (remaining > 0) {
+                auto& front = _outgoing.front();
+                auto size = front->count();
+                if (remaining < size) {
+                    front = std::make_shared<DispatchData>(front->subdata(int(remaining), int(size)));
+                    break;
+                }
+                remaining -= size;
+                _outgoing.pop_front();
+            }
+        }
+        _waitForSpace(false);
+    }
+
+    inline void _waitForSpace(bool waiting) {
+        if (waiting == _waitingForSpace || _closed) {
+            return;
+        }
+        _waitingForSpace = waiting;
+        if (waiting) {
+            _writeSource->resume();
+        } else {
+            _writeSource->suspend();
+        }
+    }
+
+    inline void _close(int error) {
+        if (_closed) {
+            return;
+        }
+        _waitForSpace(true);
+        _closed = true;
+        _outgoing.clear();
+        _readSource->cancel();
+        _writeSource->cancel();
+
+        if (_closeHandler) {
+            _closeHandler.get()(error);
+        }
+        _dataHandler = _DispatchRetainedBlock<DataHandler>();
+        _closeHandler = _DispatchRetainedBlock<CloseHandler>();
+    }
+
+    friend class _DispatchTCPServerState;
+
+};
+
+class _DispatchTCPServerState: public std::enable_shared_from_this<_DispatchTCPServerState> {
+
+public:
+
+    typedef void (^ConnectionHandler)(std::shared_ptr<DispatchTCPConnection> connection);
+
+    inline _DispatchTCPServerState(unsigned int shards, bool reusePort)
+        : _reusePort(reusePort), _pool(DispatchBufferPool::make(DISPATCH_TCP_READ_BUFFER_SIZE, 1024))
+    {
+        for (unsigned int i = 0; i < std::max(shards, 1u); i++) {
+            _shards.emplace_back("tech.shifor.Dispatch++.TCPServer.shard", DispatchQoS::userInitiated());
+        }
+    }
+
+    std::vector<DispatchQueue> _shards;
+    _DispatchRetainedBlock<ConnectionHandler> _connectionHandler;
+    std::atomic<uint64_t> _accepted {0};
+    uint16_t _port {0};
+
+    inline int _start(const std::string& host, uint16_t port) {
+        struct sockaddr_storage address {};
+        socklen_t length = 0;
+        auto *v4 = reinterpret_cast<struct sockaddr_in *>(&address);
+        auto *v6 = reinterpret_cast<struct sockaddr_in6 *>(&address);
+        if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1) {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(port);
+            length = sizeof(*v4);
+        } else if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1) {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(port);
+            length = sizeof(*v6);
+        } else {
+            return EINVAL;
+        }
+
+        // With SO_REUSEPORT the kernel balances connections over one listener per shard.
+        auto listeners = _reusePort ? _shards.size() : 1;
+        for (size_t i = 0; i < listeners; i++) {
+            int fd = -1;
+            auto error = _listen(address, length, fd);
+            if (error != 0) {
+                _stop();
+                return error;
+            }
+            if (i == 0) {
+                // Later listeners bind the port the first one was given.
+                getsockname(fd, reinterpret_cast<struct sockaddr *>(&address), &length);
+                _port = ntohs(address.ss_family == AF_INET ? v4->sin_port : v6->sin6_port);
+            }
+            _startListener(fd, i);
+        }
+        return 0;
+    }
+
+    inline void _stop() {
+        for (auto& listener : _listeners) {
+            listener->cancel();
+        }
+        _listeners.clear();
+    }
+
+private:
+
+    bool _reusePort;
+    std::shared_ptr<DispatchBufferPool> _pool;
+    std::vector<std::shared_ptr<DispatchSourceRead>> _listeners;
+    std::atomic<uint64_t> _nextShard {0};
+
+    inline int _listen(const struct sockaddr_storage& address, socklen_t length, int& result) {
+        int fd = socket(address.ss_family, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return errno;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#if defined(SO_REUSEPORT)
+        if (_reusePort) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+#endif
+        if (bind(fd, reinterpret_cast<const struct sockaddr *>(&address), length) != 0
+                || listen(fd, DISPATCH_TCP_LISTEN_BACKLOG) != 0
+                || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+            auto error = errno;
+            ::close(fd);
+            return error;
+        }
+        result = fd;
+        return 0;
+    }
+
+    inline void _startListener(int fd, size_t shard) {
+        auto weakSelf = std::weak_ptr<_DispatchTCPServerState>(shared_from_this());
+        auto listener = DispatchSource::makeReadSource(fd, &_shards[shard]);
+        auto weakListener = std::weak_ptr<DispatchSourceRead>(listener);
+        listener->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_accept(fd, shard, weakListener.lock());
+            }
+        });
+        listener->setCancelHandler(^{
+            ::close(fd);
+        });
+        listener->resume();
+        _listeners.push_back(listener);
+    }
+
+    // Accepts until the backlog is empty.
+    inline void _accept(int listener, size_t shard, const std::shared_ptr<DispatchSourceRead>& source) {
+        while (true) {
+            struct sockaddr_storage peer {};
+            socklen_t length = sizeof(peer);
+#if defined(__linux__)
+            int fd = accept4(listener, reinterpret_cast<struct sockaddr *>(&peer), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+            int fd = accept(listener, reinterpret_cast<struct sockaddr *>(&peer), &length);
+            if (fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+#endif
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if ((errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) && source) {
+                    // The backlog stays readable: rest rather than spin until a descriptor frees up.
+                    // Resumed even once stopped, as a suspended source never finishes cancelling.
+                    source->suspend();
+                    auto resting = source;
+                    _shards[shard].asyncAfter(DispatchTime::now() + DispatchTimeInterval::milliseconds(DISPATCH_TCP_ACCEPT_RETRY_MS), ^{
+                        resting->resume();
+                    });
+                }
+                return;
+            }
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#if defined(SO_NOSIGPIPE)
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+            _accepted++;
+
+            // A listener per shard keeps its connections; a single listener deals them out.
+            auto& queue = _reusePort ? _shards[shard] : _shards[_nextShard++ % _shards.size()];
+            auto connection = std::shared_ptr<DispatchTCPConnection>(new DispatchTCPConnection(fd, peer, queue, _pool));
+            auto handler = _connectionHandler;
+            queue.async(^{
+                if (handler) {
+                    handler.get()(connection);
+                }
+                connection->_start();
+            });
+        }
+    }
+
+};
+
+///
+/// A TCP server built on read and write sources.
+///
+/// Listening sockets accept in batches, until the backlog is empty, and the
+/// connections are spread over `shards` serial queues. With `reusePort` each
+/// shard gets its own `SO_REUSEPORT` listener and the kernel balances the
+/// connections; otherwise one listener deals them out in turn. Each
+/// connection reads into buffers recycled through a `DispatchBufferPool`.
+/// When descriptors run out, a listener stops accepting for a short while
+/// instead of spinning on its readable backlog.
+///
+/// The connection handler runs on the connection's queue before it starts
+/// reading, and is where `onData` and `onClose` are set. Connections stay open
+/// when the server stops.
+///
+class DispatchTCPServer {
+
+public:
+
+    inline explicit DispatchTCPServer(unsigned int shards = std::thread::hardware_concurrency(), bool reusePort = false) {
+        _state = std::make_shared<_DispatchTCPServerState>(shards, reusePort);
+    }
+
+    DispatchTCPServer(const DispatchTCPServer&) = delete;
+    DispatchTCPServer& operator= (const DispatchTCPServer&) = delete;
+
+    inline ~DispatchTCPServer() {
+        stop();
+    }
+
+    /// Sets the handler invoked with each new connection. Call before `start`. The handler gets
+    /// its own reference to the connection, which the blocks it sets may capture.
+    inline void setConnectionHandler(void (^handler)(std::shared_ptr<DispatchTCPConnection> connection)) {
+        _state->_connectionHandler = _DispatchRetainedBlock<_DispatchTCPServerState::ConnectionHandler>(handler);
+    }
+
+    ///
+    /// Starts listening.
+    ///
+    /// - parameter host: The numeric IPv4 or IPv6 address to listen on.
+    /// - parameter port: The port, or 0 for one chosen by the system; see `port()`.
+    /// - returns: 0, or the errno value of the failed call.
+    ///
+    inline int start(const std::string& host, uint16_t port) {
+        return _state->_start(host, port);
+    }
+
+    /// Stops accepting connections and closes the listening sockets.
+    inline void stop() {
+        _state->_stop();
+    }
+
+    [[nodiscard]] inline uint16_t port() const {
+        return _state->_port;
+    }
+
+    /// The number of connections accepted so far.
+    [[nodiscard]] inline uint64_t accepted() const {
+        return _state->_accepted.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchTCPServerState> _state;
+
+};
@@ -0,0 +1,385 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include "Dispatch++/Utils.h"
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define DISPATCH_TIMER_WHEEL_DEFAULT_TICK_MS 10
+#define DISPATCH_TIMER_WHEEL_DEFAULT_SLOTS 256
+#define DISPATCH_TIMER_WHEEL_DEFAULT_LEVELS 4
+
+///
+/// Identifies a timer of a `DispatchTimerWheel`. A handle is only a slot number and a
+/// generation: it stays cheap to keep after the timer has fired or been cancelled, and
+/// is then simply no longer pending.
+///
+struct DispatchTimerWheelHandle {
+    uint32_t index {UINT32_MAX};
+    uint32_t generation {0};
+
+    inline explicit operator bool() const {
+        return index != UINT32_MAX;
+    }
+};
+
+class _DispatchTimerWheelState: public std::enable_shared_from_this<_DispatchTimerWheelState> {
+
+public:
+
+    static constexpr uint32_t _nil = UINT32_MAX;
+
+    // Timers live in one vector and are linked into the buckets by index, so scheduling
+    // allocates nothing once the vector has grown to the number of pending timers.
+    struct _Entry {
+        uint64_t expires {0};
+        uint32_t next {_nil};
+        uint32_t prev {_nil};
+        uint32_t bucket {_nil};
+        uint32_t generation {0};
+        bool pending {false};
+        _DispatchRetainedBlock<DispatchBlock> block;
+    };
+
+    inline _DispatchTimerWheelState(const DispatchQueue& queue, int64_t tick, uint32_t slots, uint32_t levels)
+        : _targetQueue(queue), _tick(tick), _levels(levels)
+    {
+        while ((uint32_t(1) << _bits) < slots) {
+            _bits++;
+        }
+        _slots = uint32_t(1) << _bits;
+        _mask = _slots - 1;
+        _buckets.assign(size_t(_slots) * _levels, _nil);
+        _start = std::chrono::steady_clock::now();
+    }
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.TimerWheel"};
+    DispatchQueue _targetQueue;
+    std::mutex _mutex;
+    int64_t _tick;
+    uint32_t _bits {0};
+    uint32_t _slots {0};
+    uint32_t _mask {0};
+    uint32_t _levels;
+    std::vector<_Entry> _entries;
+    std::vector<uint32_t> _buckets;
+    uint32_t _free {_nil};
+    // The next tick to be processed.
+    uint64_t _current {0};
+    size_t _count {0};
+    bool _armed {false};
+    bool _stopped {false};
+    std::chrono::steady_clock::time_point _start;
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    std::atomic<uint64_t> _fired {0};
+
+    inline void _startTimer() {
+        auto weakSelf = std::weak_ptr<_DispatchTimerWheelState>(shared_from_this());
+        _timer = DispatchSource::makeTimerSource(&_queue);
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_advance();
+            }
+        });
+        _timer->schedule(DispatchTime::distantFuture());
+        _timer->resume();
+    }
+
+    inline void _stop() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+        _timer->cancel();
+        _entries.clear();
+        _buckets.assign(_buckets.size(), _nil);
+        _free = _nil;
+        _count = 0;
+    }
+
+    inline DispatchTimerWheelHandle _schedule(const DispatchTimeInterval& after, DispatchBlock block) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopped) {
+            return DispatchTimerWheelHandle();
+        }
+        if (_count == 0) {
+            // An idle wheel skips the ticks it slept through.
+            auto now = _elapsedTick();
+            if (now > _current) {
+                _current = now;
+            }
+        }
+        uint32_t index;
+        if (_free != _nil) {
+            index = _free;
+            _free = _entries[index].next;
+        } else {
+            index = uint32_t(_entries.size());
+            _entries.emplace_back();
+        }
+        auto& entry = _entries[index];
+        entry.block = _DispatchRetainedBlock<DispatchBlock>(block);
+        entry.pending = true;
+        entry.expires = _expires(after);
+        _add(index);
+        _count++;
+        _arm();
+        return DispatchTimerWheelHandle {index, entry.generation};
+    }
+
+    inline bool _cancel(DispatchTimerWheelHandle handle) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_isPending(handle)) {
+            return false;
+        }
+        _unlink(handle.index);
+        _release(handle.index);
+        return true;
+    }
+
+    inline bool _reschedule(DispatchTimerWheelHandle handle, const DispatchTimeInterval& after) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_isPending(handle)) {
+            return false;
+        }
+        _unlink(handle.index);
+        _entries[handle.index].expires = _expires(after);
+        _add(handle.index);
+        return true;
+    }
+
+    inline size_t _pendingCount() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _count;
+    }
+
+private:
+
+    inline uint64_t _elapsedTick() const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start);
+        return uint64_t(elapsed.count()) / uint64_t(_tick);
+    }
+
+    // The first tick that starts at or after the deadline, so a timer never fires early.
+    inline uint64_t _expires(const DispatchTimeInterval& after) const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start);
+        auto delay = after.rawValue > 0 ? uint64_t(after.rawValue) : 0;
+        auto deadline = uint64_t(elapsed.count()) + delay;
+        auto expires = deadline / uint64_t(_tick) + (deadline % uint64_t(_tick) != 0 ? 1 : 0);
+        return expires > _current ? expires : _current;
+    }
+
+    inline bool _isPending(DispatchTimerWheelHandle handle) const {
+        return handle.index < _entries.size() &&
+               _entries[handle.index].generation == handle.generation &&
+               _entries[handle.index].pending;
+    }
+
+    // Level `n` holds the timers due in less than slots^(n+1) ticks, each bucket spanning
+    // slots^n ticks; timers beyond the last level wait in its farthest bucket.
+    inline void _add(uint32_t index) {
+        auto& entry = _entries[index];
+        auto expires = entry.expires;
+        auto delta = expires - _current;
+        uint32_t level = 0;
+        while (level + 1 < _levels && delta >= (uint64_t(1) << (_bits * (level + 1)))) {
+            level++;
+        }
+        if (level + 1 == _levels && delta >= (uint64_t(1) << (_bits * _levels))) {
+            expires = _current + (uint64_t(1) << (_bits * _levels)) - 1;
+        }
+        auto bucket = uint32_t(level * _slots + ((expires >> (_bits * level)) & _mask));
+        entry.bucket = bucket;
+        entry.prev = _nil;
+        entry.next = _buckets[bucket];
+        if (entry.next != _nil) {
+            _entries[entry.next].prev = index;
+        }
+        _buckets[bucket] = index;
+    }
+
+    inline void _unlink(uint32_t index) {
+        auto& entry = _entries[index];
+        if (entry.prev != _nil) {
+            _entries[entry.prev].next = entry.next;
+        } else {
+            _buckets[entry.bucket] = entry.next;
+        }
+        if (entry.next != _nil) {
+            _entries[entry.next].prev = entry.prev;
+        }
+        entry.next = _nil;
+        entry.prev = _nil;
+        entry.bucket = _nil;
+    }
+
+    // Lets go of the callback, and what it captured, right away.
+    inline void _release(uint32_t index) {
+        auto& entry = _entries[index];
+        entry.pending = false;
+        entry.generation++;
+        entry.block = _DispatchRetainedBlock<DispatchBlock>();
+        entry.next = _free;
+        _free = index;
+        _count--;
+    }
+
+    // The tick timer only runs while there are timers.
+    inline void _arm() {
+        if (_armed) {
+            return;
+        }
+        _armed = true;
+        auto tick = DispatchTimeInterval::nanoseconds(_tick);
+        _timer->schedule(DispatchTime::now() + tick, tick, DispatchTimeInterval::nanoseconds(_tick / 10));
+    }
+
+    // Moves the timers of a bucket of `level` down to the levels below, as its span begins.
+    inline uint32_t _cascade(uint32_t level) {
+        auto slot = uint32_t((_current >> (_bits * level)) & _mask);
+        auto bucket = level * _slots + slot;
+        auto index = _buckets[bucket];
+        _buckets[bucket] = _nil;
+        while (index != _nil) {
+            auto next = _entries[index].next;
+            _add(index);
+            index = next;
+        }
+        return slot;
+    }
+
+    // Runs on the wheel's queue, for each tick of the timer.
+    inline void _advance() {
+        std::vector<_DispatchRetainedBlock<DispatchBlock>> expired;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopped) {
+                return;
+            }
+            auto now = _elapsedTick();
+            while (_current <= now && _count > 0) {
+                auto slot = uint32_t(_current & _mask);
+                if (slot == 0) {
+                    for (uint32_t level = 1; level < _levels && _cascade(level) == 0; level++) {}
+                }
+                auto index = _buckets[slot];
+                _buckets[slot] = _nil;
+                while (index != _nil) {
+                    auto next = _entries[index].next;
+                    expired.push_back(_entries[index].block);
+                    _release(index);
+                    index = next;
+                }
+                _current++;
+            }
+            if (_count == 0) {
+                _armed = false;
+                _timer->schedule(DispatchTime::distantFuture());
+            }
+        }
+        _fired += expired.size();
+        for (auto& block : expired) {
+            _targetQueue.async(block.get());
+        }
+    }
+
+};
+
+///
+/// Runs large numbers of timeouts off a single timer.
+///
+/// Timers are kept in a hierarchical wheel: `levels` rings of `slots` buckets, the
+/// first ring a tick per bucket and each next one `slots` times coarser. One repeating
+/// timer source advances the wheel each tick, and the timers of a coarse bucket move to
+/// the finer rings as its time comes. Scheduling, rescheduling and cancelling are O(1),
+/// and a cancelled timer releases its callback at once, unlike `asyncAfter`.
+///
+/// A timer fires at the first tick at or after its deadline, never before it, and its
+/// callback is submitted to the target queue. The wheel reaches slots^levels ticks
+/// ahead; farther deadlines are held in the last bucket and placed again as it comes.
+///
+class DispatchTimerWheel {
+
+public:
+
+    ///
+    /// - parameter queue: The queue the callbacks are submitted to.
+    /// - parameter tick: The resolution of the wheel.
+    /// - parameter slots: The buckets of each level, rounded up to a power of two.
+    /// - parameter levels: The number of levels.
+    ///
+    inline explicit DispatchTimerWheel(
+            const DispatchQueue& queue,
+            const DispatchTimeInterval& tick = DispatchTimeInterval::milliseconds(DISPATCH_TIMER_WHEEL_DEFAULT_TICK_MS),
+            uint32_t slots = DISPATCH_TIMER_WHEEL_DEFAULT_SLOTS,
+            uint32_t levels = DISPATCH_TIMER_WHEEL_DEFAULT_LEVELS)
+    {
+        DISPATCH_ASSERT(tick.rawValue > 0, "tick must be positive");
+        DISPATCH_ASSERT(slots > 1 && levels > 0, "a wheel needs slots and levels");
+        _state = std::make_shared<_DispatchTimerWheelState>(queue, tick.rawValue, slots, levels);
+        DISPATCH_ASSERT(_state->_bits * levels < 64, "the wheel reaches too far");
+        _state->_startTimer();
+    }
+
+    DispatchTimerWheel(const DispatchTimerWheel&) = delete;
+    DispatchTimerWheel& operator= (const DispatchTimerWheel&) = delete;
+
+    inline ~DispatchTimerWheel() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_stop();
+        });
+    }
+
+    /// Runs `block` on the target queue once `after` has passed.
+    inline DispatchTimerWheelHandle schedule(const DispatchTimeInterval& after, DispatchBlock block) {
+        return _state->_schedule(after, block);
+    }
+
+    ///
+    /// Cancels a timer.
+    ///
+    /// - returns: Whether the timer was still pending; its callback then never runs.
+    ///
+    inline bool cancel(DispatchTimerWheelHandle handle) {
+        return _state->_cancel(handle);
+    }
+
+    ///
+    /// Moves a pending timer to fire once `after` has passed from now, as when a timeout
+    /// is pushed back by activity.
+    ///
+    /// - returns: Whether the timer was still pending.
+    ///
+    inline bool reschedule(DispatchTimerWheelHandle handle, const DispatchTimeInterval& after) {
+        return _state->_reschedule(handle, after);
+    }
+
+    /// The number of pending timers.
+    [[nodiscard]] inline size_t count() const {
+        return _state->_pendingCount();
+    }
+
+    /// The number of timers that have fired so far.
+    [[nodiscard]] inline uint64_t fired() const {
+        return _state->_fired.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchTimerWheelState> _state;
+
+};
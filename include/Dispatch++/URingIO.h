@@ -0,0 +1,722 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/IO.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Utils.h"
+#include <dispatch/dispatch.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define DISPATCH_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifndef DISPATCH_HAVE_IO_URING
+#define DISPATCH_HAVE_IO_URING 0
+#endif
+
+#define DISPATCH_URING_DEFAULT_QUEUE_DEPTH 128
+#define DISPATCH_URING_DEFAULT_CHUNK_SIZE (1024 * 1024)
+#define DISPATCH_URING_SUBMIT_RETRY_MS 1
+
+typedef void (^DispatchURingIOHandler)(bool done, const std::shared_ptr<DispatchData> data, int error);
+
+#if DISPATCH_HAVE_IO_URING
+
+/// A minimal io_uring instance: one submission queue, one completion queue and
+/// an eventfd that becomes readable whenever a completion is posted.
+///
+/// Not thread safe, it is only driven from the owning channel's queue.
+class _DispatchURing {
+
+public:
+
+    _DispatchURing(const _DispatchURing& other) = delete;
+    _DispatchURing& operator= (const _DispatchURing& other) = delete;
+
+    inline ~_DispatchURing() {
+        if (_sqes) {
+            munmap(_sqes, _sqesSize);
+        }
+        if (_cqRing && _cqRing != _sqRing) {
+            munmap(_cqRing, _cqRingSize);
+        }
+        if (_sqRing) {
+            munmap(_sqRing, _sqRingSize);
+        }
+        if (_eventFD >= 0) {
+            ::close(_eventFD);
+        }
+        if (_ringFD >= 0) {
+            ::close(_ringFD);
+        }
+    }
+
+    /// Returns nullptr when the kernel does not provide io_uring, or forbids it.
+    inline static std::shared_ptr<_DispatchURing> make(unsigned int entries) {
+        auto ring = std::shared_ptr<_DispatchURing>(new _DispatchURing());
+        return ring->_setup(entries) ? ring : nullptr;
+    }
+
+    [[nodiscard]] inline int eventFileDescriptor() const {
+        return _eventFD;
+    }
+
+    [[nodiscard]] inline unsigned int entries() const {
+        return _entries;
+    }
+
+    /// Returns a zeroed submission entry, or nullptr when the submission queue is full.
+    inline io_uring_sqe *prepare() {
+        auto head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+        if (_sqLocalTail - head >= _entries) {
+            return nullptr;
+        }
+        auto index = _sqLocalTail & *_sqMask;
+        auto sqe = &_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        _sqArray[index] = index;
+        _sqLocalTail++;
+        return sqe;
+    }
+
+    /// Hands every prepared entry to the kernel. Entries the kernel could not take
+    /// yet are retried by the next call.
+    inline int submit() {
+        __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+        auto count = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+        while (count > 0) {
+            auto n = syscall(__NR_io_uring_enter, _ringFD, count, 0, 0, nullptr, 0);
+            if (n >= 0) {
+                return int(n);
+            }
+            if (errno != EINTR) {
+                return -errno;
+            }
+        }
+        return 0;
+    }
+
+    /// The number of prepared entries the kernel has not taken yet.
+    [[nodiscard]] inline unsigned int unsubmitted() const {
+        return _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    }
+
+    /// Takes back the prepared entries the kernel has not taken yet, invoking
+    /// `handler(userData)` for each of them.
+    template <typename Handler>
+    inline void discard(Handler handler) {
+        auto head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+        for (auto tail = head; tail != _sqLocalTail; tail++) {
+            handler(_sqes[_sqArray[tail & *_sqMask]].user_data);
+        }
+        _sqLocalTail = head;
+        __atomic_store_n(_sqTail, head, __ATOMIC_RELEASE);
+    }
+
+    /// Resets the eventfd and invokes `handler(userData, result)` for every posted completion.
+    template <typename Handler>
+    inline void drain(Handler handler) {
+        uint64_t value;
+        while (::read(_eventFD, &value, sizeof(value)) < 0 && errno == EINTR) {}
+
+        auto head = *_cqHead;
+        auto tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            auto cqe = &_cqes[head & *_cqMask];
+            handler(cqe->user_data, cqe->res);
+            head++;
+            __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+            tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        }
+    }
+
+private:
+
+    _DispatchURing() = default;
+
+    inline bool _setup(unsigned int entries) {
+        io_uring_params params {};
+        _ringFD = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (_ringFD < 0) {
+            return false;
+        }
+
+        _entries = params.sq_entries;
+        _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+        }
+
+        auto sq = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFD, IORING_OFF_SQ_RING);
+        if (sq == MAP_FAILED) {
+            return false;
+        }
+        _sqRing = sq;
+
+        if (singleMap) {
+            _cqRing = _sqRing;
+        } else {
+            auto cq = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFD, IORING_OFF_CQ_RING);
+            if (cq == MAP_FAILED) {
+                return false;
+            }
+            _cqRing = cq;
+        }
+
+        _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        auto sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFD, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        _sqes = static_cast<io_uring_sqe *>(sqes);
+
+        auto sqBase = static_cast<char *>(_sqRing);
+        _sqHead = reinterpret_cast<unsigned *>(sqBase + params.sq_off.head);
+        _sqTail = reinterpret_cast<unsigned *>(sqBase + params.sq_off.tail);
+        _sqMask = reinterpret_cast<unsigned *>(sqBase + params.sq_off.ring_mask);
+        _sqArray = reinterpret_cast<unsigned *>(sqBase + params.sq_off.array);
+        _sqLocalTail = *_sqTail;
+
+        auto cqBase = static_cast<char *>(_cqRing);
+        _cqHead = reinterpret_cast<unsigned *>(cqBase + params.cq_off.head);
+        _cqTail = reinterpret_cast<unsigned *>(cqBase + params.cq_off.tail);
+        _cqMask = reinterpret_cast<unsigned *>(cqBase + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<io_uring_cqe *>(cqBase + params.cq_off.cqes);
+
+        _eventFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_eventFD < 0) {
+            return false;
+        }
+        return syscall(__NR_io_uring_register, _ringFD, IORING_REGISTER_EVENTFD, &_eventFD, 1) == 0;
+    }
+
+    int _ringFD {-1};
+    int _eventFD {-1};
+    unsigned int _entries {0};
+
+    void *_sqRing {nullptr};
+    void *_cqRing {nullptr};
+    io_uring_sqe *_sqes {nullptr};
+    size_t _sqRingSize {0};
+    size_t _cqRingSize {0};
+    size_t _sqesSize {0};
+
+    unsigned *_sqHead {nullptr};
+    unsigned *_sqTail {nullptr};
+    unsigned *_sqMask {nullptr};
+    unsigned *_sqArray {nullptr};
+    unsigned _sqLocalTail {0};
+
+    unsigned *_cqHead {nullptr};
+    unsigned *_cqTail {nullptr};
+    unsigned *_cqMask {nullptr};
+    io_uring_cqe *_cqes {nullptr};
+
+};
+
+class _DispatchURingChannel;
+
+struct _DispatchURingOperation {
+
+    _DispatchURingOperation(
+            bool isWrite,
+            off_t offset,
+            size_t length,
+            const DispatchData& data,
+            const DispatchQueue& queue,
+            DispatchURingIOHandler handler
+    ): isWrite(isWrite), offset(offset), remaining(length), data(data), queue(queue), handler(handler) {}
+
+    bool isWrite;
+    off_t offset;
+    size_t remaining;
+    size_t completed {0};
+    DispatchData data;
+    DispatchQueue queue;
+    _DispatchRetainedBlock<DispatchURingIOHandler> handler;
+
+    // The chunk owned by the kernel while the operation is in flight.
+    iovec vector {};
+    dispatch_data_t _Nullable map {nullptr};
+    const void *mapped {nullptr};
+
+    // Keeps the channel, and with it the ring and the buffers, alive while in flight.
+    std::shared_ptr<_DispatchURingChannel> channel;
+
+};
+
+struct _DispatchURingEntry {
+    _DispatchURingOperation *operation;
+    _DispatchRetainedBlock<DispatchBlock> barrier;
+};
+
+class _DispatchURingChannel: public std::enable_shared_from_this<_DispatchURingChannel> {
+
+public:
+
+    inline _DispatchURingChannel(
+            std::shared_ptr<_DispatchURing> ring,
+            DispatchIO::StreamType type,
+            int fileDescriptor,
+            const DispatchQueue& cleanupQueue,
+            void (^cleanupHandler)(int error)
+    ): _ring(std::move(ring)), _type(type), _fileDescriptor(fileDescriptor),
+       _cleanupQueue(cleanupQueue), _cleanupHandler(cleanupHandler)
+    {
+        if (type == DispatchIO::StreamType::STREAM) {
+            // Seekable streams keep their own position, pipes and sockets ignore it.
+            _streamOffset = lseek(fileDescriptor, 0, SEEK_CUR);
+        }
+    }
+
+    inline ~_DispatchURingChannel() {
+        // Without a close, the operations never handed to the kernel are still queued.
+        for (auto& entry : _pending) {
+            if (entry.operation) {
+                _deliver(entry.operation, true, nullptr, ECANCELED);
+                _release(entry.operation);
+            }
+        }
+        _pending.clear();
+        _finalize();
+    }
+
+    inline void start() {
+        std::weak_ptr<_DispatchURingChannel> weakSelf = shared_from_this();
+        _completions = DispatchSource::makeReadSource(_ring->eventFileDescriptor(), &_queue);
+        _completions->setEventHandler(^{
+            if (auto channel = weakSelf.lock()) {
+                channel->_complete();
+            }
+        });
+        _completions->resume();
+    }
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.URingIO", DispatchQoS::userInitiated()};
+
+    inline void _enqueue(_DispatchURingOperation *operation) {
+        if (_closing) {
+            _deliver(operation, true, nullptr, ECANCELED);
+            _release(operation);
+            return;
+        }
+        _pending.push_back({operation, {}});
+        _pump();
+    }
+
+    inline void _enqueueBarrier(DispatchBlock barrier) {
+        _pending.push_back({nullptr, _DispatchRetainedBlock<DispatchBlock>(barrier)});
+        _pump();
+    }
+
+    inline void _setHighWater(size_t limit) {
+        _highWater = std::max(limit, size_t(1));
+    }
+
+    inline void _close(DispatchIO::CloseFlags flags) {
+        _closing = true;
+        if (flags == DispatchIO::CloseFlags::STOP) {
+            // Operations not handed to the kernel yet are cancelled, the ones
+            // in flight run to completion.
+            std::deque<_DispatchURingEntry> barriers;
+            for (auto& entry : _pending) {
+                if (entry.operation) {
+                    _deliver(entry.operation, true, nullptr, ECANCELED);
+                    _release(entry.operation);
+                } else {
+                    barriers.push_back(entry);
+                }
+            }
+            _pending.swap(barriers);
+        }
+        _pump();
+    }
+
+    [[nodiscard]] inline int _descriptor() const {
+        return _fileDescriptor;
+    }
+
+private:
+
+    std::shared_ptr<_DispatchURing> _ring;
+    DispatchIO::StreamType _type;
+    int _fileDescriptor;
+    off_t _streamOffset {-1};
+    size_t _highWater {DISPATCH_URING_DEFAULT_CHUNK_SIZE};
+
+    DispatchQueue _cleanupQueue;
+    _DispatchRetainedBlock<void (^)(int error)> _cleanupHandler;
+    std::shared_ptr<DispatchSourceRead> _completions;
+
+    std::deque<_DispatchURingEntry> _pending;
+    unsigned int _active {0};
+    bool _closing {false};
+    bool _finalized {false};
+    bool _retrying {false};
+
+    inline void _pump() {
+        bool prepared = false;
+        while (!_pending.empty()) {
+            auto& entry = _pending.front();
+            if (entry.operation == nullptr) {
+                if (_active > 0) {
+                    break;
+                }
+                auto barrier = entry.barrier;
+                _pending.pop_front();
+                barrier.get()();
+                continue;
+            }
+
+            if (_active >= _ring->entries() || (_type == DispatchIO::StreamType::STREAM && _active > 0)) {
+                break;
+            }
+
+            auto operation = entry.operation;
+            _pending.pop_front();
+            _active++;
+            prepared = _prepare(operation) || prepared;
+        }
+
+        if (prepared) {
+            _submit();
+        }
+
+        if (_closing && _active == 0 && _pending.empty()) {
+            _finalize();
+        }
+    }
+
+    inline bool _prepare(_DispatchURingOperation *operation) {
+        auto chunk = std::min(operation->remaining, _highWater);
+
+        if (operation->isWrite) {
+            if (operation->map == nullptr) {
+                size_t size = 0;
+                operation->map = dispatch_data_create_map(operation->data._wrapped, &operation->mapped, &size);
+            }
+            operation->vector.iov_base = const_cast<char *>(static_cast<const char *>(operation->mapped)) + operation->completed;
+        } else if (operation->vector.iov_base == nullptr) {
+            operation->vector.iov_base = malloc(chunk);
+            if (operation->vector.iov_base == nullptr) {
+                _finish(operation, true, nullptr, ENOMEM);
+                return false;
+            }
+        }
+        operation->vector.iov_len = chunk;
+
+        auto sqe = _ring->prepare();
+        DISPATCH_ASSERT(sqe != nullptr, "at most one submission per active operation");
+        sqe->opcode = operation->isWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = _fileDescriptor;
+        sqe->addr = uint64_t(uintptr_t(&operation->vector));
+        sqe->len = 1;
+        if (_type == DispatchIO::StreamType::RANDOM) {
+            sqe->off = uint64_t(operation->offset);
+        } else {
+            sqe->off = _streamOffset >= 0 ? uint64_t(_streamOffset) : uint64_t(-1);
+        }
+        sqe->user_data = uint64_t(uintptr_t(operation));
+        operation->channel = shared_from_this();
+        return true;
+    }
+
+    // Entries the kernel did not take are retried shortly when it is only short of resources,
+    // as nothing in flight may complete to retry them; on any other error they fail with it.
+    inline void _submit() {
+        auto result = _ring->submit();
+        if (_ring->unsubmitted() == 0) {
+            return;
+        }
+
+        std::weak_ptr<_DispatchURingChannel> weakSelf = shared_from_this();
+        if (result >= 0 || result == -EAGAIN || result == -EBUSY) {
+            if (!_retrying) {
+                _retrying = true;
+                _queue.asyncAfter(DispatchTime::now() + DispatchTimeInterval::milliseconds(DISPATCH_URING_SUBMIT_RETRY_MS), ^{
+                    if (auto channel = weakSelf.lock()) {
+                        channel->_retrying = false;
+                        channel->_submit();
+                    }
+                });
+            }
+            return;
+        }
+
+        _ring->discard(^(uint64_t userData) {
+            auto operation = reinterpret_cast<_DispatchURingOperation *>(uintptr_t(userData));
+            auto keepAlive = std::move(operation->channel);
+            _finish(operation, true, operation->isWrite ? _remainingData(operation) : nullptr, -result);
+        });
+        // The operations queued behind them get their turn.
+        _queue.async(^{
+            if (auto channel = weakSelf.lock()) {
+                channel->_pump();
+            }
+        });
+    }
+
+    inline void _complete() {
+        _ring->drain(^(uint64_t userData, int result) {
+            _handle(reinterpret_cast<_DispatchURingOperation *>(uintptr_t(userData)), result);
+        });
+        _pump();
+    }
+
+    inline void _handle(_DispatchURingOperation *operation, int result) {
+        // The operation may hold the last reference to this channel.
+        auto keepAlive = std::move(operation->channel);
+
+        if (result == -EINTR || result == -EAGAIN) {
+            if (_prepare(operation)) {
+                _submit();
+            }
+            return;
+        }
+
+        if (result < 0) {
+            _finish(operation, true, operation->isWrite ? _remainingData(operation) : nullptr, -result);
+            return;
+        }
+
+        operation->remaining -= size_t(result);
+        operation->completed += size_t(result);
+        operation->offset += result;
+        if (_type == DispatchIO::StreamType::STREAM && _streamOffset >= 0) {
+            _streamOffset += result;
+        }
+
+        if (operation->isWrite) {
+            if (operation->remaining == 0) {
+                _finish(operation, true, nullptr, 0);
+            } else {
+                _deliver(operation, false, _remainingData(operation), 0);
+                if (_prepare(operation)) {
+                    _submit();
+                }
+            }
+            return;
+        }
+
+        if (result == 0) {
+            // End of file.
+            _finish(operation, true, std::make_shared<DispatchData>(), 0);
+            return;
+        }
+
+        auto data = std::make_shared<DispatchData>(operation->vector.iov_base, result, DispatchData::Deallocator::FREE);
+        operation->vector.iov_base = nullptr;
+        if (operation->remaining == 0) {
+            _finish(operation, true, data, 0);
+        } else {
+            _deliver(operation, false, data, 0);
+            if (_prepare(operation)) {
+                _submit();
+            }
+        }
+    }
+
+    inline std::shared_ptr<DispatchData> _remainingData(_DispatchURingOperation *operation) {
+        auto total = int(operation->data.count());
+        return std::make_shared<DispatchData>(operation->data.subdata(int(operation->completed), total));
+    }
+
+    inline void _deliver(_DispatchURingOperation *operation, bool done, std::shared_ptr<DispatchData> data, int error) {
+        auto handler = operation->handler;
+        operation->queue.async(^{
+            handler.get()(done, data, error);
+        });
+    }
+
+    inline void _finish(_DispatchURingOperation *operation, bool done, std::shared_ptr<DispatchData> data, int error) {
+        _deliver(operation, done, std::move(data), error);
+        _release(operation);
+        _active--;
+    }
+
+    inline static void _release(_DispatchURingOperation *operation) {
+        free(operation->isWrite ? nullptr : operation->vector.iov_base);
+        if (operation->map) {
+            dispatch_release(operation->map);
+        }
+        delete operation;
+    }
+
+    inline void _finalize() {
+        if (_finalized || !_completions) {
+            return;
+        }
+        _finalized = true;
+
+        // The eventfd is closed with the ring, which must outlive the read source.
+        __block auto ring = _ring;
+        auto cleanupQueue = _cleanupQueue;
+        auto cleanupHandler = _cleanupHandler;
+        _completions->setCancelHandler(^{
+            ring.reset();
+            cleanupQueue.async(^{
+                cleanupHandler.get()(0);
+            });
+        });
+        _completions->cancel();
+    }
+
+};
+
+#endif // DISPATCH_HAVE_IO_URING
+
+///
+/// A channel with the surface of `DispatchIO` that submits its reads and writes
+/// to an io_uring instance instead of blocking a worker thread per operation.
+///
+/// Up to `queueDepth` operations of a `RANDOM` channel are in flight at once;
+/// completions are collected by a read source on the ring's eventfd and the
+/// handlers invoked on the queues given to `read` and `write`. Operations of a
+/// `STREAM` channel are performed one after the other.
+///
+/// When io_uring is not available (other platforms, older kernels, or a sandbox
+/// forbidding it) the channel transparently forwards to a `DispatchIO`.
+///
+class DispatchURingIO {
+
+public:
+
+    /// Creates a channel for `fileDescriptor`. The descriptor must stay open until
+    /// `cleanupHandler` has been invoked on `queue`.
+    inline DispatchURingIO(
+            DispatchIO::StreamType type,
+            int fileDescriptor,
+            const DispatchQueue& queue,
+            void (^cleanupHandler)(int error),
+            unsigned int queueDepth = DISPATCH_URING_DEFAULT_QUEUE_DEPTH)
+    {
+#if DISPATCH_HAVE_IO_URING
+        if (auto ring = _DispatchURing::make(queueDepth)) {
+            _channel = std::make_shared<_DispatchURingChannel>(ring, type, fileDescriptor, queue, cleanupHandler);
+            _channel->start();
+            return;
+        }
+#endif
+        _fallback = std::make_shared<DispatchIO>(type, fileDescriptor, queue, cleanupHandler);
+    }
+
+    /// Whether the channel is backed by io_uring rather than `DispatchIO`.
+    [[nodiscard]] inline bool isURingBacked() const {
+        return _fallback == nullptr;
+    }
+
+    inline void read(off_t offset, int length, const DispatchQueue& queue, DispatchURingIOHandler ioHandler) {
+        if (_fallback) {
+            _fallback->read(offset, length, queue, ioHandler);
+            return;
+        }
+#if DISPATCH_HAVE_IO_URING
+        auto channel = _channel;
+        auto operation = new _DispatchURingOperation(false, offset, size_t(length), DispatchData(), queue, ioHandler);
+        channel->_queue.async(^{
+            channel->_enqueue(operation);
+        });
+#endif
+    }
+
+    inline void write(off_t offset, const DispatchData& data, const DispatchQueue& queue, DispatchURingIOHandler ioHandler) {
+        if (_fallback) {
+            _fallback->write(offset, data, queue, ioHandler);
+            return;
+        }
+#if DISPATCH_HAVE_IO_URING
+        auto channel = _channel;
+        auto operation = new _DispatchURingOperation(true, offset, data.count(), data, queue, ioHandler);
+        channel->_queue.async(^{
+            channel->_enqueue(operation);
+        });
+#endif
+    }
+
+    inline void close(DispatchIO::CloseFlags flags = DispatchIO::CloseFlags::NONE) {
+        if (_fallback) {
+            _fallback->close(flags);
+            return;
+        }
+#if DISPATCH_HAVE_IO_URING
+        auto channel = _channel;
+        channel->_queue.async(^{
+            channel->_close(flags);
+        });
+#endif
+    }
+
+    /// Runs `execute` once every operation submitted before it has completed, and
+    /// before any operation submitted after it starts.
+    inline void barrier(void (^execute)(void)) const {
+        if (_fallback) {
+            _fallback->barrier(execute);
+            return;
+        }
+#if DISPATCH_HAVE_IO_URING
+        auto channel = _channel;
+        channel->_queue.async(^{
+            channel->_enqueueBarrier(execute);
+        });
+#endif
+    }
+
+    [[nodiscard]] inline int fileDescriptor() const {
+        if (_fallback) {
+            return _fallback->fileDescriptor();
+        }
+#if DISPATCH_HAVE_IO_URING
+        return _channel->_descriptor();
+#else
+        return -1;
+#endif
+    }
+
+    /// Sets the largest chunk read or written by one kernel operation; longer
+    /// operations deliver their data in several calls to their handler.
+    inline void setHighWater(int limit) const {
+        if (_fallback) {
+            _fallback->setHighWater(limit);
+            return;
+        }
+#if DISPATCH_HAVE_IO_URING
+        auto channel = _channel;
+        channel->_queue.async(^{
+            channel->_setHighWater(size_t(limit));
+        });
+#endif
+    }
+
+private:
+
+#if DISPATCH_HAVE_IO_URING
+    std::shared_ptr<_DispatchURingChannel> _channel;
+#endif
+    std::shared_ptr<DispatchIO> _fallback;
+
+};
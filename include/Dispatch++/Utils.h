@@ -23,3 +23,16 @@ do {                                        \
 #endif // NDEBUG
 
 #endif // DISPATCH_ASSERT
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Tells the CPU that the thread is spinning, to spare the other hyper-thread and power.
+inline void dispatchCPURelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
@@ -0,0 +1,198 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Dispatch++/Block.h"
+#include "Dispatch++/Data.h"
+#include "Dispatch++/IO.h"
+#include "Dispatch++/Queue.h"
+#include "Dispatch++/Source.h"
+#include "Dispatch++/Time.h"
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+#define DISPATCH_WAL_DEFAULT_BATCH_SIZE (256 * 1024)
+
+typedef void (^DispatchWALCompletion)(int error);
+
+struct _DispatchWALWaiter {
+    DispatchQueue queue;
+    _DispatchRetainedBlock<DispatchWALCompletion> completion;
+};
+
+class _DispatchWALState: public std::enable_shared_from_this<_DispatchWALState> {
+
+public:
+
+    inline _DispatchWALState(int fileDescriptor, size_t batchSize, const DispatchTimeInterval& maxDelay)
+        : _fd(fileDescriptor), _batchSize(batchSize), _maxDelay(maxDelay) {}
+
+    DispatchQueue _queue {"tech.shifor.Dispatch++.WALWriter"};
+    std::shared_ptr<DispatchSourceTimer> _timer;
+    std::atomic<uint64_t> _batches {0};
+    std::atomic<uint64_t> _records {0};
+
+    inline void _start() {
+        _timer = DispatchSource::makeTimerSource(&_queue);
+        auto weakSelf = std::weak_ptr<_DispatchWALState>(shared_from_this());
+        _timer->setEventHandler(^{
+            if (auto state = weakSelf.lock()) {
+                state->_flush();
+            }
+        });
+        _timer->schedule(DispatchTime::distantFuture());
+        _timer->resume();
+    }
+
+    inline void _append(const DispatchData& record, const DispatchQueue& queue, DispatchWALCompletion completion) {
+        _records++;
+        _buffer->append(record);
+        _waiters.push_back({queue, _DispatchRetainedBlock<DispatchWALCompletion>(completion)});
+
+        if (_buffer->count() >= _batchSize) {
+            _flush();
+        } else if (_waiters.size() == 1 && !_inFlight) {
+            // The first record of a batch starts its deadline.
+            _timer->schedule(DispatchTime::now() + _maxDelay);
+        }
+    }
+
+    // Writes and syncs everything buffered as one batch. While a batch is in flight new
+    // records keep accumulating, and go out together as soon as it completes.
+    inline void _flush() {
+        if (_inFlight || _waiters.empty()) {
+            return;
+        }
+        _timer->schedule(DispatchTime::distantFuture());
+        _inFlight = true;
+        _batches++;
+
+        auto batch = std::move(_buffer);
+        auto waiters = std::make_shared<std::vector<_DispatchWALWaiter>>(std::move(_waiters));
+        _buffer = std::make_shared<DispatchData>();
+        _waiters.clear();
+
+        auto state = shared_from_this();
+        auto fd = _fd;
+        DispatchIO::write(fd, *batch, _syncQueue, ^(const std::shared_ptr<DispatchData> remaining, int error) {
+            if (error == 0 && _dispatchWALSync(fd) != 0) {
+                error = errno;
+            }
+            state->_queue.async(^{
+                for (auto& waiter : *waiters) {
+                    auto completion = waiter.completion;
+                    waiter.queue.async(^{
+                        completion.get()(error);
+                    });
+                }
+                state->_inFlight = false;
+                if (!state->_waiters.empty()) {
+                    state->_flush();
+                }
+            });
+        });
+    }
+
+private:
+
+    int _fd;
+    size_t _batchSize;
+    DispatchTimeInterval _maxDelay;
+    DispatchQueue _syncQueue {"tech.shifor.Dispatch++.WALWriter.sync", DispatchQoS::userInitiated()};
+
+    std::shared_ptr<DispatchData> _buffer {std::make_shared<DispatchData>()};
+    std::vector<_DispatchWALWaiter> _waiters;
+    bool _inFlight {false};
+
+    inline static int _dispatchWALSync(int fd) {
+#if defined(__APPLE__)
+        // Darwin's fsync does not reach the media; F_FULLFSYNC does.
+        return fcntl(fd, F_FULLFSYNC) == 0 ? 0 : fsync(fd);
+#else
+        return fdatasync(fd);
+#endif
+    }
+
+};
+
+///
+/// An append-only log writer with group commit.
+///
+/// Records appended from any queue are collected into a single buffer. A batch goes
+/// out when it reaches `batchSize` bytes, when `maxDelay` has passed since its first
+/// record, or at once when the previous batch completes: one `DispatchIO::write` on
+/// the file descriptor followed by one `fdatasync`. Each record's completion runs
+/// only after the sync of its batch, with the error of the write or the sync.
+///
+/// Records are written at the current offset of `fileDescriptor`, in the order they
+/// were appended; open the file with `O_APPEND` to always add to its end. The file
+/// descriptor is not closed.
+///
+class DispatchWALWriter {
+
+public:
+
+    inline explicit DispatchWALWriter(
+            int fileDescriptor,
+            size_t batchSize = DISPATCH_WAL_DEFAULT_BATCH_SIZE,
+            const DispatchTimeInterval& maxDelay = DispatchTimeInterval::milliseconds(2))
+    {
+        _state = std::make_shared<_DispatchWALState>(fileDescriptor, batchSize, maxDelay);
+        _state->_start();
+    }
+
+    DispatchWALWriter(const DispatchWALWriter&) = delete;
+    DispatchWALWriter& operator= (const DispatchWALWriter&) = delete;
+
+    /// Writes out the pending records and stops the deadline timer; completions still run.
+    inline ~DispatchWALWriter() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_flush();
+            state->_timer->cancel();
+        });
+    }
+
+    inline void append(const DispatchData& record, const DispatchQueue& queue, DispatchWALCompletion completion) {
+        auto state = _state;
+        auto data = record;
+        auto target = queue;
+        auto retainedCompletion = _DispatchRetainedBlock<DispatchWALCompletion>(completion);
+        state->_queue.async(^{
+            state->_append(data, target, retainedCompletion.get());
+        });
+    }
+
+    /// Starts the pending batch now instead of at its deadline.
+    inline void flush() {
+        auto state = _state;
+        state->_queue.async(^{
+            state->_flush();
+        });
+    }
+
+    /// The number of write and sync rounds so far.
+    [[nodiscard]] inline uint64_t batches() const {
+        return _state->_batches.load();
+    }
+
+    /// The number of records appended so far.
+    [[nodiscard]] inline uint64_t records() const {
+        return _state->_records.load();
+    }
+
+private:
+
+    std::shared_ptr<_DispatchWALState> _state;
+
+};
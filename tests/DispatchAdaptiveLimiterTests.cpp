@@ -0,0 +1,76 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <atomic>
+#include <numeric>
+
+#define WORK_COUNT 1000
+#define DOWNSTREAM_CAPACITY 8
+
+static std::atomic<int> active {0};
+
+// A downstream service that slows down tenfold past its capacity.
+static void callDownstream() {
+    auto now = ++active;
+    sleep_for(now > DOWNSTREAM_CAPACITY ? 10ms : 1ms);
+    active--;
+}
+
+static void runAll(const std::shared_ptr<DispatchAdaptiveLimiter>& limiter) {
+    __block auto semaphore = DispatchSemaphore(0);
+    for (int i = 0; i < WORK_COUNT; i++) {
+        limiter->async(^{
+            callDownstream();
+            semaphore.signal();
+        });
+    }
+    for (int i = 0; i < WORK_COUNT; i++) {
+        REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10)), DispatchTimeoutResult::SUCCESS);
+    }
+}
+
+TEST_CASE("Dispatch++ AdaptiveLimiter AIMD Finds The Capacity") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchAdaptiveLimiterTests", DispatchQueue::Attributes::CONCURRENT);
+    active = 0;
+
+    auto limiter = std::make_shared<DispatchAdaptiveLimiter>(
+            q, DispatchTimeInterval::milliseconds(4), DispatchAdaptiveLimiter::Algorithm::AIMD, 2, 1, 64);
+    runAll(limiter);
+    q.sync(DispatchWorkItemFlags::BARRIER, ^{});
+
+    // Grew from 2 while the latency held, and backed off once past the capacity.
+    CHECK_GT(limiter->increases(), 0u);
+    CHECK_GT(limiter->decreases(), 0u);
+    CHECK_GE(limiter->limit(), 4u);
+    CHECK_LE(limiter->limit(), 2u * DOWNSTREAM_CAPACITY);
+    CHECK_EQ(limiter->completed(), uint64_t(WORK_COUNT));
+
+    auto histogram = limiter->latencyHistogram();
+    CHECK_EQ(std::accumulate(histogram.begin(), histogram.end(), uint64_t(0)), uint64_t(WORK_COUNT));
+    // Most calls take about 1ms: the median falls in the bucket up to 1024us, or in the one
+    // up to 2048us once the sleep overshoots.
+    auto median = limiter->latencyPercentile(0.5).rawValue;
+    CHECK_GE(median, DispatchTimeInterval::microseconds(1024).rawValue);
+    CHECK_LE(median, DispatchTimeInterval::microseconds(2048).rawValue);
+}
+
+TEST_CASE("Dispatch++ AdaptiveLimiter Gradient Stays Near The Capacity") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchAdaptiveLimiterTests.Gradient", DispatchQueue::Attributes::CONCURRENT);
+    active = 0;
+
+    auto limiter = std::make_shared<DispatchAdaptiveLimiter>(
+            q, DispatchTimeInterval::milliseconds(4), DispatchAdaptiveLimiter::Algorithm::GRADIENT, 32, 1, 64);
+    runAll(limiter);
+    q.sync(DispatchWorkItemFlags::BARRIER, ^{});
+
+    // Started far past the capacity, and came down to it.
+    CHECK_GT(limiter->decreases(), 0u);
+    CHECK_LE(limiter->limit(), 2u * DOWNSTREAM_CAPACITY);
+    CHECK_GT(limiter->meanLatency().rawValue, 0);
+}
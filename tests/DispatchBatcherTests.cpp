@@ -0,0 +1,67 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <algorithm>
+#include <vector>
+
+#define PUSH_COUNT 10000
+
+static std::vector<int> batched;
+static std::vector<size_t> batchSizes;
+
+TEST_CASE("Dispatch++ Batcher Hands Over Full Batches") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchBatcherTests");
+    batched.clear();
+    batchSizes.clear();
+
+    auto batcher = std::make_shared<DispatchBatcher<int>>(q, 100, DispatchTimeInterval::seconds(10), ^(std::vector<int>& batch) {
+        batchSizes.push_back(batch.size());
+        batched.insert(batched.end(), batch.begin(), batch.end());
+    });
+    DispatchQueue::concurrentPerform(PUSH_COUNT, ^(size_t i) {
+        batcher->push(int(i));
+    });
+    batcher->flush();
+    sleep_for(200ms);
+    q.sync(^{});
+
+    REQUIRE_EQ(batched.size(), size_t(PUSH_COUNT));
+    std::sort(batched.begin(), batched.end());
+    for (int i = 0; i < PUSH_COUNT; i++) {
+        CHECK_EQ(batched[size_t(i)], i);
+    }
+    CHECK(std::all_of(batchSizes.begin(), batchSizes.end(), [](size_t size) { return size <= 100; }));
+    CHECK_GE(batcher->batches(), uint64_t(PUSH_COUNT / 100));
+    CHECK_EQ(batcher->items(), uint64_t(PUSH_COUNT));
+    CHECK_EQ(batcher->pending(), 0u);
+}
+
+TEST_CASE("Dispatch++ Batcher Hands Over On The Deadline") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchBatcherTests.Deadline");
+    __block auto semaphore = DispatchSemaphore(0);
+    auto start = steady_clock::now();
+    batched.clear();
+    batchSizes.clear();
+
+    auto batcher = std::make_shared<DispatchBatcher<int>>(q, 1000, DispatchTimeInterval::milliseconds(50), ^(std::vector<int>& batch) {
+        batchSizes.push_back(batch.size());
+        batched.insert(batched.end(), batch.begin(), batch.end());
+        semaphore.signal();
+    });
+    for (int i = 0; i < 10; i++) {
+        batcher->push(i);
+    }
+
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(2)), DispatchTimeoutResult::SUCCESS);
+    CHECK_GE(duration_cast<milliseconds>(steady_clock::now() - start).count(), 45);
+    // The thread may move between CPUs while pushing, so only the contents are compared.
+    CHECK_EQ(batchSizes, std::vector<size_t> {10});
+    std::sort(batched.begin(), batched.end());
+    CHECK_EQ(batched, std::vector<int> {0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+}
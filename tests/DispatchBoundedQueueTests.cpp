@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <atomic>
+
+#define CAPACITY 4
+#define SUBMIT_COUNT 200
+
+static std::atomic<int> active {0};
+static std::atomic<int> maxActive {0};
+static std::atomic<int> done {0};
+
+TEST_CASE("Dispatch++ BoundedQueue Rejects When Full") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchBoundedQueueTests");
+    __block auto gate = DispatchSemaphore(0);
+    auto bounded = DispatchBoundedQueue(q, CAPACITY);
+
+    for (int i = 0; i < CAPACITY; i++) {
+        CHECK(bounded.tryAsync(^{
+            gate.wait();
+        }));
+    }
+    CHECK_FALSE(bounded.tryAsync(^{}));
+    CHECK_FALSE(bounded.asyncOrWait(^{}, DispatchTime::now() + DispatchTimeInterval::milliseconds(20)));
+    CHECK_EQ(bounded.pending() + bounded.running(), size_t(CAPACITY));
+    CHECK_EQ(bounded.rejected(), 2u);
+
+    for (int i = 0; i < CAPACITY; i++) {
+        gate.signal();
+    }
+    q.sync(^{});
+    CHECK(bounded.tryAsync(^{}));
+    q.sync(^{});
+    CHECK_EQ(bounded.admitted(), uint64_t(CAPACITY + 1));
+    CHECK_EQ(bounded.maxDepth(), size_t(CAPACITY));
+}
+
+TEST_CASE("Dispatch++ BoundedQueue Blocks The Producer") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchBoundedQueueTests.Wait", DispatchQueue::Attributes::CONCURRENT);
+    active = 0;
+    maxActive = 0;
+    done = 0;
+    auto bounded = DispatchBoundedQueue(q, CAPACITY);
+
+    // A producer far faster than its consumers never gets ahead by more than the capacity.
+    for (int i = 0; i < SUBMIT_COUNT; i++) {
+        bounded.asyncOrWait(^{
+            auto now = ++active;
+            auto seen = maxActive.load();
+            while (now > seen && !maxActive.compare_exchange_weak(seen, now)) {}
+            sleep_for(1ms);
+            active--;
+            done++;
+        });
+        CHECK_LE(bounded.pending() + bounded.running(), size_t(CAPACITY));
+    }
+    q.sync(DispatchWorkItemFlags::BARRIER, ^{});
+    CHECK_EQ(done.load(), SUBMIT_COUNT);
+    CHECK_LE(maxActive.load(), CAPACITY);
+    CHECK_LE(bounded.maxDepth(), size_t(CAPACITY));
+    CHECK_EQ(bounded.rejected(), 0u);
+}
+
+TEST_CASE("Dispatch++ BoundedQueue Notifies When A Slot Frees Up") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchBoundedQueueTests.Notify");
+    auto notifyQueue = DispatchQueue("tech.shifor.Dispatch++.DispatchBoundedQueueTests.Notified");
+    __block auto gate = DispatchSemaphore(0);
+    __block auto notified = DispatchSemaphore(0);
+    done = 0;
+    auto bounded = DispatchBoundedQueue(q, 1);
+
+    CHECK(bounded.asyncOrNotify(^{
+        gate.wait();
+    }, notifyQueue, ^{
+        done++;
+    }));
+    CHECK_FALSE(bounded.asyncOrNotify(^{}, notifyQueue, ^{
+        notified.signal();
+    }));
+    CHECK_EQ(notified.wait(DispatchTime::now() + DispatchTimeInterval::milliseconds(50)), DispatchTimeoutResult::TIMED_OUT);
+
+    gate.signal();
+    REQUIRE_EQ(notified.wait(DispatchTime::now() + DispatchTimeInterval::seconds(2)), DispatchTimeoutResult::SUCCESS);
+    CHECK(bounded.tryAsync(^{}));
+    q.sync(^{});
+    notifyQueue.sync(^{});
+    // Only the submission turned away is notified.
+    CHECK_EQ(done.load(), 0);
+}
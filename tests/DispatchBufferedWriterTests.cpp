@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define FRAGMENT_COUNT 10000
+
+// Reads exactly `length` bytes from a blocking descriptor.
+static std::string test_read_exactly(int fd, size_t length) {
+    std::string received;
+    char buf[64 * 1024];
+    while (received.size() < length) {
+        auto n = read(fd, buf, std::min(sizeof(buf), length - received.size()));
+        REQUIRE_MESSAGE(n > 0, "read");
+        received.append(buf, size_t(n));
+    }
+    return received;
+}
+
+static void test_wait_drained(DispatchBufferedWriter& writer) {
+    __block auto semaphore = DispatchSemaphore(0);
+    writer.notify(DispatchQueue::global(), ^{
+        semaphore.signal();
+    });
+    auto res = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "drain timed out");
+}
+
+TEST_CASE("Dispatch++ Buffered Writer Coalesces") {
+    int fds[2];
+    REQUIRE_MESSAGE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair");
+
+    // Many tiny protocol messages; the reader drains them concurrently.
+    std::string expected;
+    auto *writer = new DispatchBufferedWriter(fds[0], 16 * 1024, DispatchTimeInterval::milliseconds(1));
+    for (int i = 0; i < FRAGMENT_COUNT; i++) {
+        char message[32];
+        auto length = snprintf(message, sizeof(message), "msg %05d;", i);
+        expected.append(message, size_t(length));
+        writer->write(DispatchData(message, size_t(length)));
+    }
+    auto received = test_read_exactly(fds[1], expected.size());
+    test_wait_drained(*writer);
+
+    CHECK_MESSAGE(received == expected, "received contents");
+    CHECK_EQ(writer->bytesWritten(), uint64_t(expected.size()));
+    printf("%d fragments in %llu writev calls\n", FRAGMENT_COUNT, (unsigned long long)writer->syscalls());
+    CHECK_LT(writer->syscalls(), uint64_t(FRAGMENT_COUNT / 10));
+    delete writer;
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_CASE("Dispatch++ Buffered Writer Partial Writes") {
+    int fds[2];
+    REQUIRE_MESSAGE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair");
+    int size = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    // Far more than the socket buffer holds, in uneven pieces, before anyone reads.
+    std::string expected;
+    auto writer = DispatchBufferedWriter(fds[0], 1024);
+    for (int i = 0; i < 512; i++) {
+        std::string fragment(size_t(1000 + i * 7), char('A' + i % 26));
+        expected += fragment;
+        writer.write(DispatchData(fragment.data(), fragment.size()));
+    }
+    usleep(50000);
+
+    auto received = test_read_exactly(fds[1], expected.size());
+    test_wait_drained(writer);
+    CHECK_MESSAGE(received == expected, "received contents");
+
+    close(fds[1]);
+    close(fds[0]);
+}
+
+TEST_CASE("Dispatch++ Buffered Writer Error") {
+    int fds[2];
+    REQUIRE_MESSAGE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair");
+    close(fds[1]);
+    // The write fails with EPIPE rather than killing the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    __block int result = 0;
+    auto writer = DispatchBufferedWriter(fds[0], 1, DispatchTimeInterval::milliseconds(1), ^(int error) {
+        result = error;
+    });
+    writer.write(DispatchData("lost", 4));
+    test_wait_drained(writer);
+    CHECK_EQ(result, EPIPE);
+
+    close(fds[0]);
+}
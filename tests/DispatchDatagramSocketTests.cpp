@@ -0,0 +1,186 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <vector>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define DATAGRAM_COUNT 512
+#define SEND_BATCH 64
+
+static std::atomic<int> received_count {0};
+static std::atomic<int> corrupted {0};
+
+static int test_bind_loopback(struct sockaddr_in *address) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    REQUIRE_MESSAGE(fd >= 0, "socket");
+    int size = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE_MESSAGE(bind(fd, reinterpret_cast<struct sockaddr *>(address), sizeof(*address)) == 0, "bind");
+    socklen_t length = sizeof(*address);
+    getsockname(fd, reinterpret_cast<struct sockaddr *>(address), &length);
+    return fd;
+}
+
+TEST_CASE("Dispatch++ Datagram Socket Batches") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchDatagramSocketTests");
+    struct sockaddr_in receiverAddress {};
+    struct sockaddr_in senderAddress {};
+    int receiverFD = test_bind_loopback(&receiverAddress);
+    int senderFD = test_bind_loopback(&senderAddress);
+    auto senderPort = senderAddress.sin_port;
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto receiver = DispatchDatagramSocket(receiverFD, q, 32);
+    receiver.setReceiveHandler(^(const std::vector<DispatchDatagram>& datagrams) {
+        for (auto& datagram : datagrams) {
+            int sequence = -1;
+            if (datagram.data->count() == sizeof(sequence)) {
+                datagram.data->copyBytes(&sequence, sizeof(sequence));
+            }
+            auto *from = reinterpret_cast<const struct sockaddr_in *>(&datagram.address);
+            if (sequence < 0 || sequence >= DATAGRAM_COUNT || from->sin_port != senderPort) {
+                corrupted++;
+            }
+            if (++received_count == DATAGRAM_COUNT) {
+                semaphore.signal();
+            }
+        }
+    });
+    receiver.resume();
+
+    auto sender = DispatchDatagramSocket(senderFD, q);
+    for (int batch = 0; batch < DATAGRAM_COUNT / SEND_BATCH; batch++) {
+        std::vector<DispatchDatagram> datagrams(SEND_BATCH);
+        for (int i = 0; i < SEND_BATCH; i++) {
+            int sequence = batch * SEND_BATCH + i;
+            datagrams[size_t(i)].data = std::make_shared<DispatchData>(&sequence, sizeof(sequence));
+            memcpy(&datagrams[size_t(i)].address, &receiverAddress, sizeof(receiverAddress));
+            datagrams[size_t(i)].addressLength = sizeof(receiverAddress);
+        }
+
+        __block size_t batchSent = 0;
+        __block int batchError = 0;
+        __block auto sent = DispatchSemaphore(0);
+        sender.send(datagrams, q, ^(size_t count, int error) {
+            batchSent = count;
+            batchError = error;
+            sent.signal();
+        });
+        sent.wait();
+        CHECK_EQ(batchError, 0);
+        CHECK_EQ(batchSent, size_t(SEND_BATCH));
+    }
+
+    auto res = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10));
+    CHECK_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "datagrams lost");
+    CHECK_EQ(corrupted.load(), 0);
+    printf("%llu datagrams in %llu receive calls, %llu send calls\n", (unsigned long long)receiver.received(),
+           (unsigned long long)receiver.receiveCalls(), (unsigned long long)sender.sendCalls());
+    CHECK_LE(sender.sendCalls(), uint64_t(DATAGRAM_COUNT / SEND_BATCH * 2));
+
+    receiver.cancel();
+    sender.cancel();
+    close(receiverFD);
+    close(senderFD);
+}
+
+TEST_CASE("Dispatch++ Datagram Socket Regions And Truncation") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchDatagramSocketTests.Truncation");
+    struct sockaddr_in receiverAddress {};
+    struct sockaddr_in senderAddress {};
+    int receiverFD = test_bind_loopback(&receiverAddress);
+    int senderFD = test_bind_loopback(&senderAddress);
+
+    __block auto semaphore = DispatchSemaphore(0);
+    __block std::vector<DispatchDatagram> arrived;
+    auto receiver = DispatchDatagramSocket(receiverFD, q, 4, 64);
+    receiver.setReceiveHandler(^(const std::vector<DispatchDatagram>& datagrams) {
+        for (auto& datagram : datagrams) {
+            arrived.push_back(datagram);
+            if (arrived.size() == 2) {
+                semaphore.signal();
+            }
+        }
+    });
+    receiver.resume();
+
+    // Each made of 12 regions, more than a message takes: the first fits, the second does not.
+    std::vector<DispatchDatagram> datagrams(2);
+    for (size_t d = 0; d < datagrams.size(); d++) {
+        datagrams[d].data = std::make_shared<DispatchData>();
+        for (int i = 0; i < 12; i++) {
+            int chunk[2] = {int(d) * 100 + i, int(d) * 100 + i};
+            datagrams[d].data->append(chunk, d == 0 ? sizeof(int) : sizeof(chunk));
+        }
+        memcpy(&datagrams[d].address, &receiverAddress, sizeof(receiverAddress));
+        datagrams[d].addressLength = sizeof(receiverAddress);
+    }
+
+    auto sender = DispatchDatagramSocket(senderFD, q);
+    __block int sendError = -1;
+    __block auto sent = DispatchSemaphore(0);
+    sender.send(datagrams, q, ^(size_t count, int error) {
+        sendError = error;
+        sent.signal();
+    });
+    sent.wait();
+    CHECK_EQ(sendError, 0);
+
+    auto res = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "datagrams lost");
+    CHECK_EQ(arrived[0].data->count(), 12 * sizeof(int));
+    CHECK_FALSE(arrived[0].truncated);
+    int values[12] = {};
+    arrived[0].data->copyBytes(values, sizeof(values));
+    CHECK_EQ(values[11], 11);
+    CHECK_EQ(arrived[1].data->count(), 64);
+    CHECK(arrived[1].truncated);
+    CHECK_EQ(receiver.truncated(), 1);
+
+    receiver.cancel();
+    sender.cancel();
+    arrived.clear();
+    close(receiverFD);
+    close(senderFD);
+}
+
+TEST_CASE("Dispatch++ Buffer Pool") {
+    auto pool = DispatchBufferPool::make(1024, 2);
+    void *first = pool->acquire();
+    {
+        auto data = pool->wrap(first, 10);
+        CHECK_EQ(data.count(), 10);
+    }
+    // The release goes through a queue; wait for the buffer to come back.
+    void *again = nullptr;
+    for (int i = 0; i < 100 && again != first; i++) {
+        usleep(1000);
+        again = pool->acquire();
+        if (again != first) {
+            pool->release(again);
+        }
+    }
+    CHECK_EQ(again, first);
+    pool->release(again);
+}
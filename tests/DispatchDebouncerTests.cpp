@@ -0,0 +1,106 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <vector>
+
+#define TRIGGER_COUNT 10000
+
+static std::vector<uint64_t> received;
+static std::vector<int64_t> runTimes;
+
+TEST_CASE("Dispatch++ Debouncer Coalesces A Burst") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchDebouncerTests");
+    __block auto semaphore = DispatchSemaphore(0);
+    received.clear();
+
+    auto debouncer = std::make_shared<DispatchDebouncer>(q, DispatchTimeInterval::milliseconds(50), ^(uint64_t data) {
+        received.push_back(data);
+        semaphore.signal();
+    });
+    DispatchQueue::concurrentPerform(TRIGGER_COUNT, ^(size_t i) {
+        debouncer->trigger();
+    });
+
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::milliseconds(200)), DispatchTimeoutResult::TIMED_OUT);
+    CHECK_EQ(received, std::vector<uint64_t> {TRIGGER_COUNT});
+    CHECK_EQ(debouncer->triggers(), uint64_t(TRIGGER_COUNT));
+    CHECK_EQ(debouncer->runs(), 1u);
+}
+
+TEST_CASE("Dispatch++ Debouncer Merges Flags And Flushes") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchDebouncerTests.Or");
+    __block auto semaphore = DispatchSemaphore(0);
+    received.clear();
+
+    auto debouncer = std::make_shared<DispatchDebouncer>(q, DispatchTimeInterval::seconds(10), ^(uint64_t data) {
+        received.push_back(data);
+        semaphore.signal();
+    }, DispatchDebouncer::Merge::OR);
+    debouncer->trigger(0x1);
+    debouncer->trigger(0x4);
+    debouncer->trigger(0x1);
+    sleep_for(20ms);
+    // Without waiting out the 10 seconds.
+    debouncer->flush();
+
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(2)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(received, std::vector<uint64_t> {0x5});
+}
+
+TEST_CASE("Dispatch++ Debouncer Maximum Delay") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchDebouncerTests.MaxDelay");
+    received.clear();
+
+    // Triggers every 10ms never leave the 50ms window quiet; the maximum delay still runs it.
+    auto debouncer = std::make_shared<DispatchDebouncer>(q, DispatchTimeInterval::milliseconds(50), ^(uint64_t data) {
+        received.push_back(data);
+    }, DispatchDebouncer::Merge::ADD, DispatchTimeInterval::milliseconds(100));
+    for (int i = 0; i < 35; i++) {
+        debouncer->trigger();
+        sleep_for(10ms);
+    }
+    auto runsDuringBurst = debouncer->runs();
+    CHECK_GE(runsDuringBurst, 2u);
+    CHECK_LE(runsDuringBurst, 4u);
+}
+
+TEST_CASE("Dispatch++ Throttler Leading And Trailing Edges") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchThrottlerTests");
+    auto start = steady_clock::now();
+    received.clear();
+    runTimes.clear();
+
+    auto throttler = std::make_shared<DispatchThrottler>(q, DispatchTimeInterval::milliseconds(50), ^(uint64_t data) {
+        received.push_back(data);
+        runTimes.push_back(duration_cast<milliseconds>(steady_clock::now() - start).count());
+    });
+    for (int i = 0; i < 60; i++) {
+        throttler->trigger();
+        sleep_for(5ms);
+    }
+    sleep_for(120ms);
+    q.sync(^{});
+
+    REQUIRE_GE(runTimes.size(), 2u);
+    // The first trigger is not delayed.
+    CHECK_LT(runTimes[0], 20);
+    CHECK_EQ(received[0], 1u);
+    // About 300ms of triggers make one run per 50ms window, and nothing is lost.
+    CHECK_GE(throttler->runs(), 5u);
+    CHECK_LE(throttler->runs(), 8u);
+    uint64_t total = 0;
+    for (size_t i = 0; i < received.size(); i++) {
+        total += received[i];
+        if (i > 0) {
+            CHECK_GE(runTimes[i] - runTimes[i - 1], 45);
+        }
+    }
+    CHECK_EQ(total, 60u);
+}
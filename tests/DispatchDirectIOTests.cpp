@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+// Runs a direct read and waits for it.
+static std::string test_direct_read(DispatchDirectIO& io, off_t offset, size_t length, const DispatchQueue& q, int *error) {
+    __block std::string received;
+    __block int result_error = 0;
+    __block auto semaphore = DispatchSemaphore(0);
+    io.read(offset, length, q, ^(const std::shared_ptr<DispatchData> data, int error) {
+        result_error = error;
+        if (data) {
+            data->withUnsafeBytes(^(const void *bytes, size_t count) {
+                received.append(static_cast<const char *>(bytes), count);
+            });
+        }
+        semaphore.signal();
+    });
+    semaphore.wait();
+    *error = result_error;
+    return received;
+}
+
+static int test_direct_write(DispatchDirectIO& io, off_t offset, const DispatchData& data, const DispatchQueue& q) {
+    __block int result_error = 0;
+    __block auto semaphore = DispatchSemaphore(0);
+    io.write(offset, data, q, ^(int error) {
+        result_error = error;
+        semaphore.signal();
+    });
+    semaphore.wait();
+    return result_error;
+}
+
+TEST_CASE("Dispatch++ Aligned Data") {
+    auto data = DispatchData::aligned(10000, 4096, ^(void *bytes, size_t capacity) {
+        CHECK_EQ(capacity, 12288);
+        memset(bytes, 'x', 10000);
+    });
+    CHECK_EQ(data.count(), 10000);
+    CHECK(data.isAligned(4096));
+    CHECK_EQ(data[9999], 'x');
+
+    data.append("y", 1);
+    CHECK_FALSE(data.isAligned(4096));
+}
+
+TEST_CASE("Dispatch++ Direct IO") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchDirectIOTests");
+    // Not in /tmp, which is often a tmpfs without O_DIRECT support.
+    char path[] = "dispatch_direct_io.XXXXXX";
+    int tmp = mkstemp(path);
+    REQUIRE_MESSAGE(tmp >= 0, "mkstemp");
+    close(tmp);
+
+    int fd = DispatchDirectIO::open(path, O_RDWR);
+    REQUIRE_MESSAGE(fd >= 0, "open");
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto io = DispatchDirectIO(fd, q, ^(int error) {
+        close(fd);
+        semaphore.signal();
+    });
+    printf("direct: %d, block size: %zu, memory alignment: %zu\n", io.isDirect(), io.blockSize(), io.memoryAlignment());
+    auto block = io.blockSize();
+
+    // Two and a half blocks, from an unaligned buffer.
+    std::string expected;
+    for (size_t i = 0; i < block * 5 / 2; i++) {
+        expected.push_back(char('a' + i % 26));
+    }
+    CHECK_EQ(test_direct_write(io, 0, DispatchData(expected.data(), expected.size()), q), 0);
+
+    struct stat st {};
+    fstat(fd, &st);
+    CHECK_EQ(st.st_size, off_t(expected.size()));
+
+    int error = 0;
+    CHECK_EQ(test_direct_read(io, 0, block * 4, q, &error), expected);
+    CHECK_EQ(error, 0);
+    CHECK_EQ(test_direct_read(io, off_t(block), 100, q, &error), expected.substr(block, 100));
+
+    // A short write in the middle keeps the bytes around it.
+    expected.replace(block, 10, "0123456789");
+    auto patch = io.makeBuffer(10, ^(void *bytes, size_t capacity) {
+        memcpy(bytes, "0123456789", 10);
+    });
+    CHECK_EQ(test_direct_write(io, off_t(block), patch, q), 0);
+    CHECK_EQ(test_direct_read(io, 0, expected.size(), q, &error), expected);
+    fstat(fd, &st);
+    CHECK_EQ(st.st_size, off_t(expected.size()));
+
+    // Unaligned offsets are rejected.
+    test_direct_read(io, 1, 100, q, &error);
+    CHECK_EQ(error, EINVAL);
+    CHECK_EQ(test_direct_write(io, 1, patch, q), EINVAL);
+
+    io.close();
+    semaphore.wait();
+    CHECK_EQ(test_direct_write(io, 0, patch, q), EBADF);
+    unlink(path);
+}
@@ -0,0 +1,126 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define FILE_COUNT 3
+
+static std::vector<std::vector<std::string>> reloads;
+
+static void test_write_file(const std::string& path, const char *contents) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    REQUIRE_MESSAGE(fd >= 0, "open");
+    CHECK_EQ(write(fd, contents, strlen(contents)), ssize_t(strlen(contents)));
+    close(fd);
+}
+
+static std::string test_make_directory() {
+    char pattern[] = "/tmp/dispatchpp-watch-XXXXXX";
+    REQUIRE_MESSAGE(mkdtemp(pattern) != nullptr, "mkdtemp");
+    return pattern;
+}
+
+TEST_CASE("Dispatch++ File System Object Source") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchFileSystemSourceTests");
+    auto directory = test_make_directory();
+    auto path = directory + "/watched";
+    test_write_file(path, "v1");
+
+    int fd = open(path.c_str(), O_RDONLY);
+    REQUIRE(fd >= 0);
+    auto mask = DispatchSource::FileSystemEvent(
+            uint(DispatchSource::FileSystemEvent::WRITE) | uint(DispatchSource::FileSystemEvent::DELETE));
+    auto source = DispatchSource::makeFileSystemObjectSource(fd, mask, &q);
+    REQUIRE(source);
+    CHECK_EQ(source->fileDescriptor(), fd);
+    CHECK_EQ(source->getMask(), uint(mask));
+
+    __block auto semaphore = DispatchSemaphore(0);
+    __block uint events = 0;
+    source->setEventHandler(^{
+        events |= source->getData();
+        semaphore.signal();
+    });
+    source->setCancelHandler(^{
+        close(fd);
+    });
+    source->resume();
+
+    int writer = open(path.c_str(), O_WRONLY | O_APPEND);
+    CHECK_EQ(write(writer, "v2", 2), 2);
+    close(writer);
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    CHECK_NE(events & uint(DispatchSource::FileSystemEvent::WRITE), 0u);
+
+    source->cancel();
+    unlink(path.c_str());
+    rmdir(directory.c_str());
+}
+
+TEST_CASE("Dispatch++ File Watcher Debounce And Replace") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchFileWatcherTests");
+    auto directory = test_make_directory();
+    std::vector<std::string> paths;
+    for (int i = 0; i < FILE_COUNT; i++) {
+        paths.push_back(directory + "/config-" + std::to_string(i));
+        test_write_file(paths.back(), "initial");
+    }
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto watcher = std::make_shared<DispatchFileWatcher>(q, ^(const std::vector<std::string>& changed) {
+        reloads.push_back(changed);
+        semaphore.signal();
+    }, DispatchTimeInterval::milliseconds(150));
+    watcher->watch(paths);
+    sleep_for(100ms);
+
+    // A burst of writes to every file is one reload.
+    for (int round = 0; round < 5; round++) {
+        for (auto& path : paths) {
+            test_write_file(path, "burst");
+        }
+    }
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::milliseconds(400)), DispatchTimeoutResult::TIMED_OUT);
+    REQUIRE_EQ(reloads.size(), 1u);
+    CHECK_EQ(reloads[0], paths);
+    CHECK_GE(watcher->events(), uint64_t(FILE_COUNT));
+
+    // Replacing a file by renaming another over it is a change, and the watch moves to the new file.
+    auto replacement = directory + "/replacement";
+    test_write_file(replacement, "replaced");
+    REQUIRE_EQ(rename(replacement.c_str(), paths[0].c_str()), 0);
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    REQUIRE_EQ(reloads.size(), 2u);
+    CHECK_EQ(reloads[1], std::vector<std::string> {paths[0]});
+
+    sleep_for(100ms);
+    test_write_file(paths[0], "after replace");
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    REQUIRE_EQ(reloads.size(), 3u);
+    CHECK_EQ(reloads[2], std::vector<std::string> {paths[0]});
+    CHECK_EQ(watcher->reloads(), 3u);
+
+    watcher = nullptr;
+    for (auto& path : paths) {
+        unlink(path.c_str());
+    }
+    rmdir(directory.c_str());
+}
@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#define SAMPLE_COUNT 2000
+
+static std::vector<std::pair<uint64_t, uint64_t>> ticks;
+
+TEST_CASE("Dispatch++ Fixed Rate Timer Does Not Drift") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchFixedRateTimerTests");
+    __block auto semaphore = DispatchSemaphore(0);
+    __block int64_t lastElapsed = 0;
+    auto start = steady_clock::now();
+
+    // 1 kHz; the last sample is due 2 seconds after the start.
+    auto timer = std::make_shared<DispatchFixedRateTimer>(q, DispatchTimeInterval::milliseconds(1), ^(uint64_t tick, uint64_t count) {
+        if (tick == SAMPLE_COUNT - 1) {
+            lastElapsed = duration_cast<microseconds>(steady_clock::now() - start).count();
+            semaphore.signal();
+        }
+    });
+    timer->start();
+
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10)), DispatchTimeoutResult::SUCCESS);
+    timer->cancel();
+    printf("sample %d at %lldus, mean lateness %lldns, max %lldns\n", SAMPLE_COUNT, (long long) lastElapsed,
+           (long long) timer->meanLateness().rawValue, (long long) timer->maxLateness().rawValue);
+    CHECK_GE(lastElapsed, SAMPLE_COUNT * 1000);
+    CHECK_LT(lastElapsed, SAMPLE_COUNT * 1000 + 5000);
+    CHECK_GE(timer->fires(), uint64_t(SAMPLE_COUNT - 100));
+}
+
+static void test_stall(DispatchFixedRateTimer::MissedTicks policy) {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchFixedRateTimerTests.Stall");
+    __block auto semaphore = DispatchSemaphore(0);
+    ticks.clear();
+
+    // Every 5ms; the handler of tick 3 stalls the queue for about 10 ticks.
+    auto timer = std::make_shared<DispatchFixedRateTimer>(q, DispatchTimeInterval::milliseconds(5), ^(uint64_t tick, uint64_t count) {
+        ticks.emplace_back(tick, count);
+        if (tick == 3) {
+            sleep_for(52ms);
+        }
+        if (tick >= 20) {
+            semaphore.signal();
+        }
+    }, policy);
+    timer->start();
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    timer->cancel();
+    q.sync(^{});
+
+    // The first tick after the stall, and everything before it in order.
+    size_t after = 0;
+    while (after < ticks.size() && ticks[after].first <= 3) {
+        after++;
+    }
+    REQUIRE_LT(after, ticks.size());
+    CHECK_EQ(ticks[after - 1].first, 3u);
+    switch (policy) {
+        case DispatchFixedRateTimer::MissedTicks::SKIP:
+            CHECK_GE(ticks[after].first, 12u);
+            CHECK_EQ(ticks[after].second, 1u);
+            CHECK_GE(timer->skipped(), 8u);
+            break;
+        case DispatchFixedRateTimer::MissedTicks::FIRE_ALL:
+            for (size_t i = 0; i < ticks.size(); i++) {
+                CHECK_EQ(ticks[i].first, i);
+            }
+            CHECK_EQ(timer->skipped(), 0u);
+            break;
+        case DispatchFixedRateTimer::MissedTicks::COALESCE:
+            CHECK_GE(ticks[after].first, 12u);
+            CHECK_EQ(ticks[after].first - ticks[after].second, 3u);
+            break;
+    }
+    CHECK_GE(timer->maxLateness().rawValue, 40000000);
+}
+
+TEST_CASE("Dispatch++ Fixed Rate Timer Missed Ticks") {
+    test_stall(DispatchFixedRateTimer::MissedTicks::SKIP);
+    test_stall(DispatchFixedRateTimer::MissedTicks::FIRE_ALL);
+    test_stall(DispatchFixedRateTimer::MissedTicks::COALESCE);
+}
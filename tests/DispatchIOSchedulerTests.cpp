@@ -0,0 +1,115 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define BLOCK_SIZE 4096
+#define CLUSTER_COUNT 8
+#define CLUSTER_BLOCKS 16
+
+static std::atomic<int> mismatches {0};
+
+TEST_CASE("Dispatch++ IO Read Scheduler Merges Clustered Reads") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchIOSchedulerTests", DispatchQueue::Attributes::CONCURRENT);
+    char *path = dispatch_test_get_large_file();
+    auto expected = dispatch_test_read_file(path);
+    auto *contents = &expected;
+
+    int fd = open(path, O_RDONLY);
+    REQUIRE_MESSAGE(fd >= 0, "open");
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto io = DispatchIO(DispatchIO::StreamType::RANDOM, fd, q, ^(int error) {
+        close(fd);
+        semaphore.signal();
+    });
+    auto scheduler = DispatchIOReadScheduler(io, DispatchTimeInterval::milliseconds(5), 64 * BLOCK_SIZE);
+
+    // Clusters of 4 KiB lookups, submitted out of order and with duplicates.
+    auto g = DispatchGroup();
+    for (int block = CLUSTER_BLOCKS - 1; block >= 0; block--) {
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+            off_t offset = off_t(cluster) * 64 * 1024 + off_t(block) * BLOCK_SIZE;
+            for (int copy = 0; copy < (block % 4 == 0 ? 2 : 1); copy++) {
+                g.enter();
+                scheduler.read(offset, BLOCK_SIZE, q, ^(bool done, const std::shared_ptr<DispatchData> data, int error) {
+                    CHECK_MESSAGE(done, "single invocation");
+                    std::string received;
+                    if (data) {
+                        data->withUnsafeBytes(^(const void *bytes, size_t count) {
+                            received.append(static_cast<const char *>(bytes), count);
+                        });
+                    }
+                    if (error != 0 || contents->compare(size_t(offset), BLOCK_SIZE, received) != 0) {
+                        mismatches++;
+                    }
+                    g.leave();
+                });
+            }
+        }
+    }
+
+    auto res = g.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "reads timed out");
+    CHECK_EQ(mismatches.load(), 0);
+    printf("requested: %llu, issued: %llu\n",
+           (unsigned long long)scheduler.requestedReads(), (unsigned long long)scheduler.issuedReads());
+    CHECK_EQ(scheduler.requestedReads(), uint64_t(CLUSTER_COUNT * (CLUSTER_BLOCKS + CLUSTER_BLOCKS / 4)));
+    CHECK_LT(scheduler.issuedReads(), scheduler.requestedReads() / 4);
+
+    io.close();
+    semaphore.wait();
+    dispatch_test_release_large_file(path);
+    free(path);
+}
+
+TEST_CASE("Dispatch++ IO Read Scheduler Respects Coalesced Size") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchIOSchedulerTests");
+    char *path = dispatch_test_get_large_file();
+
+    int fd = open(path, O_RDONLY);
+    REQUIRE_MESSAGE(fd >= 0, "open");
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto io = DispatchIO(DispatchIO::StreamType::RANDOM, fd, q, ^(int error) {
+        close(fd);
+        semaphore.signal();
+    });
+    auto scheduler = DispatchIOReadScheduler(io, DispatchTimeInterval::seconds(10), 4 * BLOCK_SIZE);
+
+    // 16 contiguous blocks, at most 4 per merged read; an explicit flush skips the window.
+    auto g = DispatchGroup();
+    for (int block = 0; block < 16; block++) {
+        g.enter();
+        scheduler.read(off_t(block) * BLOCK_SIZE, BLOCK_SIZE, q, ^(bool done, const std::shared_ptr<DispatchData> data, int error) {
+            CHECK_MESSAGE(error == 0, "read error");
+            CHECK_MESSAGE((data && data->count() == BLOCK_SIZE), "read size");
+            g.leave();
+        });
+    }
+    scheduler.flush();
+
+    auto res = g.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "reads timed out");
+    CHECK_EQ(scheduler.issuedReads(), uint64_t(4));
+
+    io.close();
+    semaphore.wait();
+    dispatch_test_release_large_file(path);
+    free(path);
+}
@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+static int test_make_temp_file(char *path) {
+    strcpy(path, "/tmp/dispatch_transfer.XXXXXX");
+    int fd = mkstemp(path);
+    REQUIRE_MESSAGE(fd >= 0, "mkstemp");
+    return fd;
+}
+
+// Runs a transfer and waits for its final progress callback.
+static size_t test_transfer(int from, int to, size_t length, const DispatchQueue& q) {
+    __block size_t result = 0;
+    __block int result_error = 0;
+    __block size_t last_progress = 0;
+    __block auto semaphore = DispatchSemaphore(0);
+
+    DispatchIO::transfer(from, to, length, q, ^(bool done, size_t transferred, int error) {
+        CHECK_MESSAGE(transferred >= last_progress, "progress is monotonic");
+        last_progress = transferred;
+        if (done) {
+            result = transferred;
+            result_error = error;
+            semaphore.signal();
+        }
+    });
+
+    auto res = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(25));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "transfer timed out");
+    CHECK_MESSAGE(result_error == 0, "transfer error");
+    return result;
+}
+
+TEST_CASE("Dispatch++ IO Transfer File To File") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchIOTransferTests");
+    char *src_path = dispatch_test_get_large_file();
+    char dst_path[64];
+
+    int src = open(src_path, O_RDONLY);
+    REQUIRE_MESSAGE(src >= 0, "open");
+    int dst = test_make_temp_file(dst_path);
+
+    auto expected = dispatch_test_read_file(src_path);
+    auto transferred = test_transfer(src, dst, SIZE_MAX, q);
+    close(src);
+    close(dst);
+
+    CHECK_EQ(transferred, expected.size());
+    CHECK_MESSAGE(dispatch_test_read_file(dst_path) == expected, "copied contents");
+
+    unlink(dst_path);
+    dispatch_test_release_large_file(src_path);
+    free(src_path);
+}
+
+TEST_CASE("Dispatch++ IO Transfer Through Pipe") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchIOTransferTests");
+    char *src_path = dispatch_test_get_large_file();
+    char dst_path[64];
+
+    int fds[2];
+    REQUIRE_MESSAGE(pipe(fds) == 0, "pipe");
+    int src = open(src_path, O_RDONLY);
+    REQUIRE_MESSAGE(src >= 0, "open");
+    int dst = test_make_temp_file(dst_path);
+    auto expected = dispatch_test_read_file(src_path);
+    int readFD = fds[0];
+    int writeFD = fds[1];
+
+    // file -> pipe on one side, pipe -> file on the other.
+    auto g = DispatchGroup();
+    __block size_t into_pipe = 0;
+    g.enter();
+    DispatchIO::transfer(src, writeFD, SIZE_MAX, q, ^(bool done, size_t transferred, int error) {
+        if (done) {
+            CHECK_MESSAGE(error == 0, "file to pipe");
+            into_pipe = transferred;
+            close(writeFD);
+            g.leave();
+        }
+    });
+    auto out_of_pipe = test_transfer(readFD, dst, SIZE_MAX, q);
+    CHECK_MESSAGE(g.wait(DispatchTime::now() + DispatchTimeInterval::seconds(25)) == DispatchTimeoutResult::SUCCESS,
+                  "file to pipe timed out");
+
+    close(readFD);
+    close(src);
+    close(dst);
+
+    CHECK_EQ(into_pipe, expected.size());
+    CHECK_EQ(out_of_pipe, expected.size());
+    CHECK_MESSAGE(dispatch_test_read_file(dst_path) == expected, "copied contents");
+
+    unlink(dst_path);
+    dispatch_test_release_large_file(src_path);
+    free(src_path);
+}
+
+TEST_CASE("Dispatch++ IO Transfer Read/Write Fallback") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchIOTransferTests");
+    int from[2];
+    int to[2];
+    REQUIRE_MESSAGE(socketpair(AF_UNIX, SOCK_STREAM, 0, from) == 0, "socketpair");
+    REQUIRE_MESSAGE(socketpair(AF_UNIX, SOCK_STREAM, 0, to) == 0, "socketpair");
+
+    // Neither end is a pipe or a regular file, so no zero-copy call applies.
+    char buf[8192];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = char(i * 7);
+    }
+    REQUIRE_EQ(write(from[0], buf, sizeof(buf)), ssize_t(sizeof(buf)));
+    shutdown(from[0], SHUT_WR);
+
+    auto transferred = test_transfer(from[1], to[0], sizeof(buf), q);
+    CHECK_EQ(transferred, sizeof(buf));
+
+    char received[sizeof(buf)];
+    size_t pos = 0;
+    while (pos < sizeof(received)) {
+        auto n = read(to[1], received + pos, sizeof(received) - pos);
+        REQUIRE_MESSAGE(n > 0, "read");
+        pos += size_t(n);
+    }
+    CHECK_MESSAGE(memcmp(buf, received, sizeof(buf)) == 0, "copied contents");
+
+    close(from[0]);
+    close(from[1]);
+    close(to[0]);
+    close(to[1]);
+}
@@ -0,0 +1,71 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <atomic>
+#include <vector>
+
+#define MAX_CONCURRENT 16
+#define WORK_COUNT 500
+
+static std::atomic<int> active {0};
+static std::atomic<int> maxActive {0};
+static std::vector<int> order;
+
+TEST_CASE("Dispatch++ LimitedQueue Caps The Work In Flight") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchLimitedQueueTests", DispatchQueue::Attributes::CONCURRENT);
+    __block auto semaphore = DispatchSemaphore(0);
+    active = 0;
+    maxActive = 0;
+
+    auto limited = std::make_shared<DispatchLimitedQueue>(q, MAX_CONCURRENT);
+    // Submitted from many threads at once, none of which waits.
+    DispatchQueue::concurrentPerform(WORK_COUNT, ^(size_t i) {
+        limited->async(^{
+            auto now = ++active;
+            auto seen = maxActive.load();
+            while (now > seen && !maxActive.compare_exchange_weak(seen, now)) {}
+            sleep_for(2ms);
+            active--;
+            semaphore.signal();
+        });
+    });
+
+    for (int i = 0; i < WORK_COUNT; i++) {
+        REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    }
+    q.sync(DispatchWorkItemFlags::BARRIER, ^{});
+    CHECK_LE(maxActive.load(), MAX_CONCURRENT);
+    CHECK_GE(maxActive.load(), 2);
+    CHECK_EQ(limited->completed(), uint64_t(WORK_COUNT));
+    CHECK_EQ(limited->pending(), 0u);
+    CHECK_EQ(limited->running(), 0u);
+}
+
+TEST_CASE("Dispatch++ LimitedQueue Of One Runs In Order") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchLimitedQueueTests.Serial", DispatchQueue::Attributes::CONCURRENT);
+    __block auto semaphore = DispatchSemaphore(0);
+    order.clear();
+
+    auto limited = std::make_shared<DispatchLimitedQueue>(q, 1);
+    for (int i = 0; i < 100; i++) {
+        limited->async(^{
+            order.push_back(i);
+            semaphore.signal();
+        });
+    }
+    for (int i = 0; i < 100; i++) {
+        REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    }
+    q.sync(DispatchWorkItemFlags::BARRIER, ^{});
+
+    REQUIRE_EQ(order.size(), 100u);
+    for (int i = 0; i < 100; i++) {
+        CHECK_EQ(order[size_t(i)], i);
+    }
+}
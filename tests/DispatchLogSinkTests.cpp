@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define THREAD_COUNT 4
+#define LINE_COUNT 50000
+
+static size_t test_count_lines(const char *path, const char *needle) {
+    FILE *file = fopen(path, "r");
+    REQUIRE_MESSAGE(file != nullptr, "fopen");
+    size_t count = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        if (strstr(line, needle)) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static void test_flush(DispatchLogSink& sink) {
+    __block auto semaphore = DispatchSemaphore(0);
+    sink.flush(DispatchQueue::global(), ^{
+        semaphore.signal();
+    });
+    auto res = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "flush timed out");
+}
+
+TEST_CASE("Dispatch++ Log Sink Backpressure") {
+    char path[] = "/tmp/dispatch_log.XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE_MESSAGE(fd >= 0, "mkstemp");
+
+    // Small rings, so the writers keep running into the drainer.
+    auto *sink = new DispatchLogSink(fd, DispatchLogSink::OverflowPolicy::BLOCK, 64);
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchLogSinkTests", DispatchQueue::Attributes::CONCURRENT);
+    auto g = DispatchGroup();
+    for (int t = 0; t < THREAD_COUNT; t++) {
+        q.async(g, ^{
+            char line[64];
+            for (int i = 0; i < LINE_COUNT; i++) {
+                auto length = snprintf(line, sizeof(line), "worker %d line %d", t, i);
+                sink->info(std::string_view(line, size_t(length)));
+            }
+        });
+    }
+    g.wait();
+    test_flush(*sink);
+
+    CHECK_EQ(sink->dropped(), uint64_t(0));
+    CHECK_EQ(sink->written(), uint64_t(THREAD_COUNT * LINE_COUNT));
+    delete sink;
+
+    CHECK_EQ(test_count_lines(path, " INFO worker "), size_t(THREAD_COUNT * LINE_COUNT));
+    close(fd);
+    unlink(path);
+}
+
+TEST_CASE("Dispatch++ Log Sink Drop") {
+    char path[] = "/tmp/dispatch_log.XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE_MESSAGE(fd >= 0, "mkstemp");
+
+    auto sink = DispatchLogSink(fd, DispatchLogSink::OverflowPolicy::DROP, 8);
+    for (int i = 0; i < LINE_COUNT; i++) {
+        sink.warning("dropped or written");
+    }
+    test_flush(sink);
+
+    printf("dropped: %llu\n", (unsigned long long)sink.dropped());
+    CHECK_EQ(sink.dropped() + sink.written(), uint64_t(LINE_COUNT));
+    CHECK_EQ(test_count_lines(path, " WARNING dropped or written"), size_t(sink.written()));
+    close(fd);
+    unlink(path);
+}
+
+TEST_CASE("Dispatch++ Log Sink Flush On Signal") {
+    char path[] = "/tmp/dispatch_log.XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE_MESSAGE(fd >= 0, "mkstemp");
+
+    auto sink = DispatchLogSink(fd);
+    sink.flushOnSignal(SIGUSR2);
+    sink.error("before the signal");
+    raise(SIGUSR2);
+    test_flush(sink);
+
+    CHECK_EQ(test_count_lines(path, " ERROR before the signal"), size_t(1));
+    close(fd);
+    unlink(path);
+}
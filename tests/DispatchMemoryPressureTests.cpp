@@ -0,0 +1,117 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+static std::vector<int> trimmed;
+static std::vector<DispatchSource::MemoryPressureEvent> levels;
+
+TEST_CASE("Dispatch++ Memory Pressure Source") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchMemoryPressureSourceTests");
+    auto source = DispatchSource::makeMemoryPressureSource(DispatchSource::MemoryPressureEvent::ALL, &q);
+    if (!source) {
+        printf("memory pressure cannot be monitored here (%s)\n", strerror(errno));
+        return;
+    }
+    CHECK_EQ(source->getMask(), uint(DispatchSource::MemoryPressureEvent::ALL));
+    source->setEventHandler(^{});
+    source->resume();
+    source->cancel();
+}
+
+#if defined(__linux__)
+
+static void test_write_events(const char *path, int high, int max) {
+    char contents[128];
+    auto count = snprintf(contents, sizeof(contents), "low 0\nhigh %d\nmax %d\noom 0\noom_kill 0\n", high, max);
+    // Rewritten in place, as the kernel does, so the watch stays on the same file.
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    REQUIRE(fd >= 0);
+    CHECK_EQ(pwrite(fd, contents, size_t(count), 0), ssize_t(count));
+    close(fd);
+}
+
+TEST_CASE("Dispatch++ Cgroup Memory Pressure Levels") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchCgroupMemoryPressureTests");
+    char directory[] = "/tmp/dispatchpp-memory-XXXXXX";
+    REQUIRE(mkdtemp(directory) != nullptr);
+    auto path = std::string(directory) + "/memory.events";
+    test_write_events(path.c_str(), 0, 0);
+
+    auto source = _DispatchCgroupMemoryPressureSource::make(path, uint(DispatchSource::MemoryPressureEvent::ALL), &q);
+    REQUIRE(source);
+    __block auto semaphore = DispatchSemaphore(0);
+    source->setEventHandler(^{
+        levels.push_back(DispatchSource::MemoryPressureEvent(source->getData()));
+        semaphore.signal();
+    });
+    source->resume();
+    sleep_for(100ms);
+
+    test_write_events(path.c_str(), 1, 0);
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    test_write_events(path.c_str(), 1, 1);
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+
+    REQUIRE_EQ(levels.size(), 3u);
+    CHECK_EQ(levels[0], DispatchSource::MemoryPressureEvent::WARN);
+    CHECK_EQ(levels[1], DispatchSource::MemoryPressureEvent::NORMAL);
+    CHECK_EQ(levels[2], DispatchSource::MemoryPressureEvent::CRITICAL);
+
+    source->cancel();
+    unlink(path.c_str());
+    rmdir(directory);
+}
+
+#endif
+
+TEST_CASE("Dispatch++ Memory Pressure Coordinator Trims In Order") {
+    auto coordinator = std::make_shared<DispatchMemoryPressureCoordinator>();
+    __block auto semaphore = DispatchSemaphore(0);
+    __block int expected = 3;
+
+    auto cache = ^(int priority, size_t bytes) {
+        return coordinator->registerCache(priority, ^(DispatchSource::MemoryPressureEvent level) {
+            trimmed.push_back(level == DispatchSource::MemoryPressureEvent::CRITICAL ? -priority : priority);
+            if (--expected == 0) {
+                semaphore.signal();
+            }
+            return bytes;
+        });
+    };
+    auto large = cache(10, 1000);
+    cache(0, 10);
+    cache(5, 100);
+
+    coordinator->simulate(DispatchSource::MemoryPressureEvent::WARN);
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(trimmed, std::vector<int> {0, 5, 10});
+
+    // Once unregistered, a cache is left alone.
+    coordinator->unregisterCache(large);
+    CHECK_EQ(coordinator->released(), 1110u);
+    expected = 2;
+    coordinator->simulate(DispatchSource::MemoryPressureEvent::CRITICAL);
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(trimmed, std::vector<int> {0, 5, 10, 0, -5});
+
+    // The return to normal is not a reason to trim.
+    coordinator->simulate(DispatchSource::MemoryPressureEvent::NORMAL);
+    coordinator->unregisterCache(0);
+    CHECK_EQ(coordinator->trims(), 2u);
+}
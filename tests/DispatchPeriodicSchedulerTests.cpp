@@ -0,0 +1,86 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#define JOB_COUNT 2000
+#define PHASES 20
+
+static std::atomic<uint64_t> jobRuns {0};
+static std::vector<int64_t> runTimes;
+
+TEST_CASE("Dispatch++ Periodic Scheduler Shares Wakeups") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchPeriodicSchedulerTests", DispatchQueue::Attributes::CONCURRENT);
+    auto scheduler = std::make_shared<DispatchPeriodicScheduler>(q);
+
+    // Jobs every 20ms that may run 10ms late, their phases spread over the period.
+    for (int phase = 0; phase < PHASES; phase++) {
+        for (int i = 0; i < JOB_COUNT / PHASES; i++) {
+            scheduler->add(DispatchTimeInterval::milliseconds(20), DispatchTimeInterval::milliseconds(10), ^{
+                jobRuns++;
+            });
+        }
+        sleep_for(1ms);
+    }
+    CHECK_EQ(scheduler->count(), size_t(JOB_COUNT));
+    sleep_for(600ms);
+
+    auto runs = scheduler->runs();
+    auto wakeups = scheduler->wakeups();
+    printf("%llu runs of %d jobs on %llu wakeups\n", (unsigned long long) runs, JOB_COUNT, (unsigned long long) wakeups);
+    CHECK_GE(runs, uint64_t(JOB_COUNT * 25));
+    // A timer per job would wake once per distinct phase and period.
+    CHECK_LT(wakeups, uint64_t(PHASES * 30 / 2));
+    CHECK_EQ(scheduler->missed(), 0u);
+}
+
+static void test_missed_deadlines(DispatchPeriodicScheduler::MissedDeadlines policy, uint64_t expectedMissed) {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchPeriodicSchedulerTests.Missed");
+    auto scheduler = std::make_shared<DispatchPeriodicScheduler>(q);
+    runTimes.clear();
+    auto start = steady_clock::now();
+    auto job = scheduler->add(DispatchTimeInterval::milliseconds(20), DispatchTimeInterval::nanoseconds(0), ^{
+        runTimes.push_back(duration_cast<milliseconds>(steady_clock::now() - start).count());
+        if (runTimes.size() == 1) {
+            // Overruns three deadlines.
+            sleep_for(70ms);
+        }
+    }, policy);
+    sleep_for(200ms);
+    scheduler->remove(job);
+    q.sync(^{});
+
+    REQUIRE_GE(runTimes.size(), 4u);
+    CHECK_EQ(scheduler->missed(), expectedMissed);
+    auto gap = runTimes[1] - runTimes[0];
+    switch (policy) {
+        case DispatchPeriodicScheduler::MissedDeadlines::SKIP:
+            // The deadline 80ms after the first.
+            CHECK_GE(gap, 70);
+            CHECK_LE(runTimes[2] - runTimes[1], 30);
+            break;
+        case DispatchPeriodicScheduler::MissedDeadlines::RUN_MISSED:
+            // The three missed runs straight after the late one.
+            CHECK_GE(gap, 68);
+            CHECK_LE(runTimes[3] - runTimes[0], 85);
+            break;
+        case DispatchPeriodicScheduler::MissedDeadlines::DELAY:
+            // An interval after the late run ended.
+            CHECK_GE(gap, 88);
+            break;
+    }
+}
+
+TEST_CASE("Dispatch++ Periodic Scheduler Missed Deadlines") {
+    test_missed_deadlines(DispatchPeriodicScheduler::MissedDeadlines::SKIP, 3);
+    test_missed_deadlines(DispatchPeriodicScheduler::MissedDeadlines::RUN_MISSED, 0);
+    test_missed_deadlines(DispatchPeriodicScheduler::MissedDeadlines::DELAY, 1);
+}
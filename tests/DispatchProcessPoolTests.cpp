@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define JOB_COUNT 64
+
+static std::atomic<int> matched {0};
+static std::atomic<int> mismatched {0};
+
+TEST_CASE("Dispatch++ Process Source Exit") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchProcessSourceTests");
+    auto pid = fork();
+    REQUIRE_MESSAGE(pid >= 0, "fork");
+    if (pid == 0) {
+        usleep(200000);
+        _exit(3);
+    }
+
+    __block auto semaphore = DispatchSemaphore(0);
+    __block uint events = 0;
+    auto source = DispatchSource::makeProcessSource(pid, DispatchSource::ProcessEvent::EXIT, &q);
+    REQUIRE(source);
+    CHECK_EQ(source->pid(), pid);
+    source->setEventHandler(^{
+        events = source->getData();
+        semaphore.signal();
+    });
+    source->resume();
+
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    source->cancel();
+    CHECK_NE(events & uint(DispatchSource::ProcessEvent::EXIT), 0u);
+
+    int status = 0;
+    CHECK_EQ(waitpid(pid, &status, 0), pid);
+    CHECK(WIFEXITED(status));
+    CHECK_EQ(WEXITSTATUS(status), 3);
+}
+
+TEST_CASE("Dispatch++ Process Pool Jobs And Restarts") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchProcessPoolTests");
+
+    // Reverses the request, and crashes on one starting with '!'.
+    auto pool = std::make_shared<DispatchProcessPool>(2, ^(const void *bytes, size_t count) {
+        auto begin = static_cast<const char *>(bytes);
+        if (count > 0 && begin[0] == '!') {
+            abort();
+        }
+        std::vector<char> response(begin, begin + count);
+        std::reverse(response.begin(), response.end());
+        return response;
+    });
+    auto pids = pool->pids();
+    CHECK_EQ(pids.size(), 2u);
+
+    auto group = DispatchGroup();
+    for (int i = 0; i < JOB_COUNT; i++) {
+        auto text = "job-" + std::to_string(i);
+        auto expected = std::string(text.rbegin(), text.rend());
+        group.enter();
+        pool->submit(DispatchData(text.data(), text.size()), q, ^(const std::shared_ptr<DispatchData> response, int error) {
+            std::string received(response ? response->count() : 0, '\0');
+            if (response) {
+                response->copyBytes(received.data(), int(received.size()));
+            }
+            (error == 0 && received == expected ? matched : mismatched)++;
+            group.leave();
+        });
+    }
+    REQUIRE_EQ(group.wait(DispatchTime::now() + DispatchTimeInterval::seconds(20)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(matched.load(), JOB_COUNT);
+    CHECK_EQ(mismatched.load(), 0);
+
+    __block int crashError = 0;
+    group.enter();
+    pool->submit(DispatchData("!boom", 5), q, ^(const std::shared_ptr<DispatchData> response, int error) {
+        crashError = error;
+        group.leave();
+    });
+    REQUIRE_EQ(group.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(crashError, ECHILD);
+    CHECK_EQ(pool->failed(), 1u);
+
+    // The replacement is forked from the exit event, before the next job is dispatched.
+    __block int afterError = -1;
+    group.enter();
+    pool->submit(DispatchData("abc", 3), q, ^(const std::shared_ptr<DispatchData> response, int error) {
+        afterError = error;
+        group.leave();
+    });
+    REQUIRE_EQ(group.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(afterError, 0);
+    CHECK_EQ(pool->restarts(), 1u);
+    CHECK_EQ(pool->pids().size(), 2u);
+    CHECK_EQ(pool->completed(), uint64_t(JOB_COUNT + 1));
+}
@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define READ_SIZE 16384
+#define CHUNK_SIZE (64 * 1024)
+
+TEST_CASE("Dispatch++ IO Read Ahead Sequential") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchReadAheadTests");
+    char *path = dispatch_test_get_large_file();
+    auto expected = dispatch_test_read_file(path);
+
+    int fd = open(path, O_RDONLY);
+    REQUIRE_MESSAGE(fd >= 0, "open");
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto io = DispatchIO(DispatchIO::StreamType::RANDOM, fd, q, ^(int error) {
+        close(fd);
+        semaphore.signal();
+    });
+    auto readAhead = DispatchReadAhead(io, DispatchIO::StreamType::RANDOM, CHUNK_SIZE, 4);
+
+    // Reads one piece at a time, the way a parser walks a file, past the end of it.
+    __block std::string received;
+    __block bool finished = false;
+    __block int failed = 0;
+    for (off_t offset = 0; !finished; offset += READ_SIZE) {
+        auto before = received.size();
+        readAhead.read(offset, READ_SIZE, q, ^(bool done, const std::shared_ptr<DispatchData> data, int error) {
+            failed = error;
+            if (data) {
+                data->withUnsafeBytes(^(const void *bytes, size_t count) {
+                    received.append(static_cast<const char *>(bytes), count);
+                });
+            }
+            if (done) {
+                finished = received.size() - before < READ_SIZE;
+                semaphore.signal();
+            }
+        });
+        auto res = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5));
+        REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "read timed out");
+        REQUIRE_MESSAGE(failed == 0, "read error");
+    }
+
+    CHECK_EQ(received.size(), expected.size());
+    CHECK_MESSAGE(received == expected, "read contents");
+    printf("read ahead hits: %llu\n", (unsigned long long)readAhead.hits());
+    CHECK_GT(readAhead.hits(), 0);
+
+    io.close();
+    semaphore.wait();
+    dispatch_test_release_large_file(path);
+    free(path);
+}
+
+TEST_CASE("Dispatch++ IO Read Ahead Random") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchReadAheadTests");
+    char *path = dispatch_test_get_large_file();
+    auto expected = dispatch_test_read_file(path);
+    auto *contents = &expected;
+
+    int fd = open(path, O_RDONLY);
+    REQUIRE_MESSAGE(fd >= 0, "open");
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto io = DispatchIO(DispatchIO::StreamType::RANDOM, fd, q, ^(int error) {
+        close(fd);
+        semaphore.signal();
+    });
+    auto readAhead = DispatchReadAhead(io, DispatchIO::StreamType::RANDOM, CHUNK_SIZE, 4);
+
+    // Scattered reads never build a streak, so they are passed straight through.
+    __block int mismatches = 0;
+    for (int i = 0; i < 32; i++) {
+        off_t offset = off_t((size_t(i) * 7919 * 4096) % (expected.size() - READ_SIZE));
+        auto *piece = new std::string();
+        readAhead.read(offset, READ_SIZE, q, ^(bool done, const std::shared_ptr<DispatchData> data, int error) {
+            if (data) {
+                data->withUnsafeBytes(^(const void *bytes, size_t count) {
+                    piece->append(static_cast<const char *>(bytes), count);
+                });
+            }
+            if (done) {
+                if (error != 0 || contents->compare(size_t(offset), READ_SIZE, *piece) != 0) {
+                    mismatches++;
+                }
+                delete piece;
+                semaphore.signal();
+            }
+        });
+        auto res = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5));
+        REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "read timed out");
+    }
+
+    CHECK_EQ(mismatches, 0);
+    CHECK_EQ(readAhead.hits(), 0);
+
+    io.close();
+    semaphore.wait();
+    dispatch_test_release_large_file(path);
+    free(path);
+}
@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define FRAME_SIZE (16 * 1024 * 1024)
+
+static uint64_t test_checksum(const DispatchData& data) {
+    __block uint64_t sum = 0;
+    data.enumerateBytes(^(const void *bytes, size_t count, size_t offset, bool *stop) {
+        auto words = static_cast<const uint32_t *>(bytes);
+        for (size_t i = 0; i < count / sizeof(uint32_t); i++) {
+            sum = sum * 31 + words[i];
+        }
+    });
+    return sum;
+}
+
+TEST_CASE("Dispatch++ Shared Data Passed Over A Socket") {
+    auto frame = DispatchSharedData::make(FRAME_SIZE, ^(void *bytes, size_t count) {
+        auto words = static_cast<uint32_t *>(bytes);
+        for (size_t i = 0; i < count / sizeof(uint32_t); i++) {
+            words[i] = uint32_t(i * 2654435761u);
+        }
+    });
+    REQUIRE_MESSAGE(frame, "make");
+    CHECK_EQ(frame->count(), size_t(FRAME_SIZE));
+    CHECK_EQ(frame->data().count(), size_t(FRAME_SIZE));
+
+#if DISPATCH_HAVE_MEMFD_SEALS
+    CHECK(frame->isSealed());
+    uint32_t word = 0;
+    CHECK_LT(pwrite(frame->fileDescriptor(), &word, sizeof(word), 0), 0);
+    CHECK_EQ(errno, EPERM);
+    auto writable = mmap(nullptr, FRAME_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, frame->fileDescriptor(), 0);
+    CHECK_EQ(writable, MAP_FAILED);
+#endif
+
+    int sockets[2];
+    REQUIRE_MESSAGE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0, "socketpair");
+    CHECK_EQ(frame->sendTo(sockets[0]), 0);
+
+    std::shared_ptr<DispatchSharedData> received;
+    REQUIRE_EQ(DispatchSharedData::receive(sockets[1], received), 0);
+    REQUIRE(received);
+    CHECK_NE(received->fileDescriptor(), frame->fileDescriptor());
+    CHECK_EQ(received->count(), frame->count());
+    CHECK_EQ(received->isSealed(), frame->isSealed());
+    CHECK_EQ(test_checksum(received->data()), test_checksum(frame->data()));
+
+    // The data outlives its region: the mapping goes away with the last data.
+    auto bytes = received->data();
+    received.reset();
+    CHECK_EQ(test_checksum(bytes), test_checksum(frame->data()));
+
+    // A message without a descriptor is refused.
+    uint64_t count = FRAME_SIZE;
+    CHECK_EQ(write(sockets[0], &count, sizeof(count)), ssize_t(sizeof(count)));
+    CHECK_EQ(DispatchSharedData::receive(sockets[1], received), EBADMSG);
+
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+TEST_CASE("Dispatch++ Shared Data Unsealed") {
+    auto region = DispatchSharedData::make(4096, ^(void *bytes, size_t count) {
+        memset(bytes, 'x', count);
+    }, false);
+    REQUIRE(region);
+    CHECK_FALSE(region->isSealed());
+#if DISPATCH_HAVE_MEMFD_SEALS
+    // The sender could shrink it under the mapping.
+    CHECK(DispatchSharedData::adopt(dup(region->fileDescriptor())) == nullptr);
+    CHECK_EQ(errno, EPERM);
+#endif
+    CHECK(DispatchSharedData::make(0, nullptr) == nullptr);
+    CHECK_EQ(errno, EINVAL);
+}
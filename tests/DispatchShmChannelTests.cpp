@@ -0,0 +1,264 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#if DISPATCH_HAVE_SHM_CHANNEL
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#define MESSAGE_COUNT 200000
+#define SLOT_COUNT 1024
+
+struct TestMessage {
+    uint64_t sequence;
+    uint64_t sentAt;
+    char payload[48];
+};
+
+static std::vector<uint64_t> latencies;
+static uint64_t expected_sequence;
+static int out_of_order;
+
+static uint64_t test_now_ns() {
+    struct timespec ts {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+}
+
+static void test_record(const TestMessage& message) {
+    latencies.push_back(test_now_ns() - message.sentAt);
+    if (message.sequence != expected_sequence) {
+        out_of_order++;
+    }
+    expected_sequence = message.sequence + 1;
+}
+
+static void test_report(const char *name, uint64_t elapsed) {
+    std::sort(latencies.begin(), latencies.end());
+    printf("%s: %.0f msgs/s, latency p50 %.1fus p99 %.1fus\n",
+           name,
+           double(MESSAGE_COUNT) / (double(elapsed) / 1e9),
+           double(latencies[latencies.size() / 2]) / 1e3,
+           double(latencies[latencies.size() * 99 / 100]) / 1e3);
+}
+
+static void test_reset() {
+    latencies.clear();
+    latencies.reserve(MESSAGE_COUNT);
+    expected_sequence = 0;
+    out_of_order = 0;
+}
+
+TEST_CASE("Dispatch++ Shm Channel Between Processes") {
+    test_reset();
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchShmChannelTests");
+    auto channel = DispatchShmChannel::create(SLOT_COUNT, sizeof(TestMessage));
+    REQUIRE_MESSAGE(channel, "create");
+    CHECK_EQ(channel->send(nullptr, sizeof(TestMessage) + 1), EMSGSIZE);
+
+    __block auto semaphore = DispatchSemaphore(0);
+    __block bool wellFormed = true;
+    channel->receive(q, ^(const std::shared_ptr<DispatchData> data) {
+        TestMessage message {};
+        if (data->count() != sizeof(message)) {
+            wellFormed = false;
+            return;
+        }
+        data->copyBytes(&message, sizeof(message));
+        test_record(message);
+        if (latencies.size() == MESSAGE_COUNT) {
+            semaphore.signal();
+        }
+    });
+
+    auto start = test_now_ns();
+    auto pid = fork();
+    REQUIRE_MESSAGE(pid >= 0, "fork");
+    if (pid == 0) {
+        // No dispatch queues past fork: `send` only touches the mapping and the doorbell.
+        TestMessage message {};
+        for (uint64_t i = 0; i < MESSAGE_COUNT; i++) {
+            message.sequence = i;
+            message.sentAt = test_now_ns();
+            while (channel->send(&message, sizeof(message)) == EAGAIN) {
+                sched_yield();
+            }
+        }
+        _exit(0);
+    }
+
+    auto result = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(30));
+    auto elapsed = test_now_ns() - start;
+    int status = 0;
+    waitpid(pid, &status, 0);
+    channel->cancel();
+
+    REQUIRE_EQ(result, DispatchTimeoutResult::SUCCESS);
+    CHECK(WIFEXITED(status));
+    CHECK(wellFormed);
+    CHECK_EQ(out_of_order, 0);
+    test_report("shm channel", elapsed);
+}
+
+// A region sealed against shrinking, with a header claiming `slotCount` slots of `slotSize`.
+static int test_make_region(size_t size, uint32_t slotCount, uint32_t slotSize) {
+    int fd = memfd_create("Dispatch++.ShmChannelTests", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    REQUIRE_GE(fd, 0);
+    REQUIRE_EQ(ftruncate(fd, off_t(size)), 0);
+    if (size >= sizeof(_DispatchShmHeader)) {
+        auto header = static_cast<_DispatchShmHeader *>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        REQUIRE(header != MAP_FAILED);
+        header->magic = DISPATCH_SHM_CHANNEL_MAGIC;
+        header->slotCount = slotCount;
+        header->slotSize = slotSize;
+        munmap(header, size);
+    }
+    REQUIRE_EQ(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK), 0);
+    return fd;
+}
+
+static void test_check_rejected(int memoryFD, int error) {
+    int doorbellFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    REQUIRE_GE(doorbellFD, 0);
+    errno = 0;
+    CHECK_FALSE(DispatchShmChannel::attach(memoryFD, doorbellFD));
+    CHECK_EQ(errno, error);
+}
+
+TEST_CASE("Dispatch++ Shm Channel Rejects Malformed Regions") {
+    auto headerSize = _DispatchShmRegion::_headerSize();
+    auto stride = _DispatchShmRegion::slotStride(64);
+
+    // A region its creator could still shrink under the mapping.
+    int unsealed = memfd_create("Dispatch++.ShmChannelTests", MFD_CLOEXEC);
+    REQUIRE_GE(unsealed, 0);
+    REQUIRE_EQ(ftruncate(unsealed, off_t(headerSize + stride)), 0);
+    test_check_rejected(unsealed, EPERM);
+
+    // Too small for the header, with no slots, and with more slots than the region holds.
+    test_check_rejected(test_make_region(0, 1, 64), EINVAL);
+    test_check_rejected(test_make_region(headerSize + stride, 0, 64), EINVAL);
+    test_check_rejected(test_make_region(headerSize + stride, 4, 64), EINVAL);
+}
+
+TEST_CASE("Dispatch++ Shm Channel Survives A Corrupted Region") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchShmChannelTests.Corrupted");
+    auto channel = DispatchShmChannel::create(4, 64);
+    REQUIRE(channel);
+
+    __block auto semaphore = DispatchSemaphore(0);
+    __block std::vector<std::string> received;
+    channel->receive(q, ^(const std::shared_ptr<DispatchData> message) {
+        std::string text(message->count(), '\0');
+        message->copyBytes(text.data(), int(text.size()));
+        received.push_back(text);
+        semaphore.signal();
+    });
+
+    // The peer's view of the region: the geometry the channel read at creation still holds.
+    auto size = _DispatchShmRegion::_headerSize() + 4 * _DispatchShmRegion::slotStride(64);
+    auto base = static_cast<char *>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, channel->memoryFileDescriptor(), 0));
+    REQUIRE(base != MAP_FAILED);
+    auto header = reinterpret_cast<_DispatchShmHeader *>(base);
+    header->slotCount = 0;
+    header->slotSize = 1u << 30;
+    CHECK_EQ(channel->maxMessageSize(), size_t(64));
+    CHECK_EQ(channel->send("first", 5), 0);
+    CHECK_EQ(channel->send(std::string(65, 'x').data(), 65), EMSGSIZE);
+
+    // A message claiming more bytes than a slot holds is dropped.
+    auto position = header->enqueuePosition.fetch_add(1);
+    auto slot = reinterpret_cast<_DispatchShmSlot *>(
+            base + _DispatchShmRegion::_headerSize() + (position % 4) * _DispatchShmRegion::slotStride(64));
+    slot->length = 1u << 20;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    CHECK_EQ(channel->send("second", 6), 0);
+
+    for (int i = 0; i < 2; i++) {
+        REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    }
+    q.sync(^{
+        CHECK_EQ(received, std::vector<std::string> {"first", "second"});
+    });
+    channel->cancel();
+    munmap(base, size);
+}
+
+TEST_CASE("Dispatch++ Shm Channel Pipe Baseline") {
+    test_reset();
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchShmChannelTests.Pipe");
+    int fds[2];
+    REQUIRE_MESSAGE(pipe(fds) == 0, "pipe");
+
+    auto start = test_now_ns();
+    auto pid = fork();
+    REQUIRE_MESSAGE(pid >= 0, "fork");
+    if (pid == 0) {
+        close(fds[0]);
+        TestMessage message {};
+        for (uint64_t i = 0; i < MESSAGE_COUNT; i++) {
+            message.sequence = i;
+            message.sentAt = test_now_ns();
+            if (write(fds[1], &message, sizeof(message)) != sizeof(message)) {
+                _exit(1);
+            }
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    __block auto semaphore = DispatchSemaphore(0);
+    __block std::vector<char> pending;
+    auto readFD = fds[0];
+    auto source = DispatchSource::makeReadSource(readFD, &q);
+    source->setEventHandler(^{
+        char buffer[16 * sizeof(TestMessage)];
+        ssize_t n;
+        while ((n = read(readFD, buffer, sizeof(buffer))) > 0) {
+            pending.insert(pending.end(), buffer, buffer + n);
+        }
+        size_t offset = 0;
+        for (; offset + sizeof(TestMessage) <= pending.size(); offset += sizeof(TestMessage)) {
+            TestMessage message {};
+            memcpy(&message, pending.data() + offset, sizeof(message));
+            test_record(message);
+        }
+        pending.erase(pending.begin(), pending.begin() + long(offset));
+        if (latencies.size() == MESSAGE_COUNT || n == 0) {
+            semaphore.signal();
+        }
+    });
+    source->resume();
+
+    auto result = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(30));
+    auto elapsed = test_now_ns() - start;
+    int status = 0;
+    waitpid(pid, &status, 0);
+    source->cancel();
+    close(readFD);
+
+    REQUIRE_EQ(result, DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(latencies.size(), MESSAGE_COUNT);
+    CHECK_EQ(out_of_order, 0);
+    test_report("pipe", elapsed);
+}
+
+#endif
@@ -0,0 +1,124 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define SHORT_TOOL_COUNT 200
+
+static std::atomic<int> succeeded {0};
+
+static std::string test_string(const std::shared_ptr<DispatchData>& chunk) {
+    std::string text(chunk->count(), '\0');
+    chunk->copyBytes(text.data(), int(text.size()));
+    return text;
+}
+
+TEST_CASE("Dispatch++ Subprocess Streams And Status") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchSubprocessTests");
+    __block std::string out;
+    __block std::string err;
+    __block int status = -1;
+    __block bool timedOut = true;
+    __block auto semaphore = DispatchSemaphore(0);
+
+    auto process = DispatchSubprocess::spawn(
+            {"/bin/sh", "-c", "echo out; echo err 1>&2; echo \"$GREETING\"; exit 7"},
+            {"GREETING=hello"},
+            q,
+            ^(const std::shared_ptr<DispatchData> chunk) {
+                out += test_string(chunk);
+            },
+            ^(const std::shared_ptr<DispatchData> chunk) {
+                err += test_string(chunk);
+            },
+            ^(int exitStatus, bool killed) {
+                status = exitStatus;
+                timedOut = killed;
+                semaphore.signal();
+            });
+    REQUIRE(process);
+    CHECK_GT(process->pid(), 0);
+    process->closeInput();
+
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(out, "out\nhello\n");
+    CHECK_EQ(err, "err\n");
+    CHECK(WIFEXITED(status));
+    CHECK_EQ(WEXITSTATUS(status), 7);
+    CHECK_FALSE(timedOut);
+}
+
+TEST_CASE("Dispatch++ Subprocess Standard Input") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchSubprocessTests.Input");
+    __block std::string out;
+    __block auto semaphore = DispatchSemaphore(0);
+
+    auto process = DispatchSubprocess::spawn({"cat"}, {}, q, ^(const std::shared_ptr<DispatchData> chunk) {
+        out += test_string(chunk);
+    }, nullptr, ^(int status, bool timedOut) {
+        semaphore.signal();
+    });
+    REQUIRE(process);
+    process->write(DispatchData("hello, ", 7));
+    process->write(DispatchData("cat", 3));
+    process->closeInput();
+
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(10)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(out, "hello, cat");
+}
+
+TEST_CASE("Dispatch++ Subprocess Timeout And Spawn Failure") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchSubprocessTests.Timeout");
+    __block int status = 0;
+    __block bool timedOut = false;
+    __block auto semaphore = DispatchSemaphore(0);
+
+    auto process = DispatchSubprocess::spawn({"sleep", "10"}, {}, q, nullptr, nullptr, ^(int exitStatus, bool killed) {
+        status = exitStatus;
+        timedOut = killed;
+        semaphore.signal();
+    }, DispatchTimeInterval::milliseconds(200));
+    REQUIRE(process);
+
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    CHECK(timedOut);
+    CHECK(WIFSIGNALED(status));
+    CHECK_EQ(WTERMSIG(status), SIGKILL);
+
+    auto missing = DispatchSubprocess::spawn({"/nonexistent/tool"}, {}, q, nullptr, nullptr, nullptr);
+    CHECK(missing == nullptr);
+}
+
+TEST_CASE("Dispatch++ Subprocess Many Short Tools") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchSubprocessTests.Many");
+    auto group = DispatchGroup();
+    auto start = steady_clock::now();
+    for (int i = 0; i < SHORT_TOOL_COUNT; i++) {
+        group.enter();
+        auto process = DispatchSubprocess::spawn({"true"}, {}, q, nullptr, nullptr, ^(int status, bool timedOut) {
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                succeeded++;
+            }
+            group.leave();
+        });
+        if (!process) {
+            group.leave();
+        }
+    }
+    REQUIRE_EQ(group.wait(DispatchTime::now() + DispatchTimeInterval::seconds(60)), DispatchTimeoutResult::SUCCESS);
+    auto elapsed = duration<double>(steady_clock::now() - start).count();
+    printf("%d short tools in %.2fs (%.0f/s)\n", SHORT_TOOL_COUNT, elapsed, SHORT_TOOL_COUNT / elapsed);
+    CHECK_EQ(succeeded.load(), SHORT_TOOL_COUNT);
+}
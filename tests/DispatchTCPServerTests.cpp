@@ -0,0 +1,174 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define CLIENT_COUNT 32
+#define ROUND_TRIPS 500
+#define MESSAGE_SIZE 64
+#define SHORT_CONNECTIONS 500
+
+static std::atomic<int> closed_connections {0};
+
+static int test_connect(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE_MESSAGE(fd >= 0, "socket");
+    struct sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE_MESSAGE(connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0, "connect");
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// Sends one message and waits for all of its echo.
+static bool test_round_trip(int fd, const char *message, size_t length) {
+    if (write(fd, message, length) != ssize_t(length)) {
+        return false;
+    }
+    char echo[MESSAGE_SIZE];
+    size_t received = 0;
+    while (received < length) {
+        auto n = read(fd, echo + received, length - received);
+        if (n <= 0) {
+            return false;
+        }
+        received += size_t(n);
+    }
+    return memcmp(echo, message, length) == 0;
+}
+
+static void test_start_echo_server(DispatchTCPServer& server) {
+    server.setConnectionHandler(^(std::shared_ptr<DispatchTCPConnection> connection) {
+        connection->onData(^(const std::shared_ptr<DispatchData> data) {
+            connection->send(*data);
+        });
+        connection->onClose(^(int error) {
+            closed_connections++;
+        });
+    });
+    REQUIRE_EQ(server.start("127.0.0.1", 0), 0);
+    REQUIRE_NE(server.port(), 0);
+}
+
+TEST_CASE("Dispatch++ TCP Server Echo Benchmark") {
+    auto server = DispatchTCPServer(4);
+    test_start_echo_server(server);
+    auto port = server.port();
+    closed_connections = 0;
+
+    // Connections per second: connect, one round trip, close.
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SHORT_CONNECTIONS; i++) {
+        int fd = test_connect(port);
+        CHECK(test_round_trip(fd, "ping", 4));
+        close(fd);
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("connections/s: %.0f\n", SHORT_CONNECTIONS / elapsed);
+
+    // Throughput and latency: concurrent clients doing back to back round trips.
+    std::mutex mutex;
+    std::vector<double> latencies;
+    std::atomic<int> failures {0};
+    std::vector<std::thread> clients;
+    start = std::chrono::steady_clock::now();
+    for (int c = 0; c < CLIENT_COUNT; c++) {
+        clients.emplace_back([&, c] {
+            int fd = test_connect(port);
+            char message[MESSAGE_SIZE];
+            std::vector<double> local;
+            local.reserve(ROUND_TRIPS);
+            for (int i = 0; i < ROUND_TRIPS; i++) {
+                memset(message, 'a' + (c + i) % 26, sizeof(message));
+                auto sent = std::chrono::steady_clock::now();
+                if (!test_round_trip(fd, message, sizeof(message))) {
+                    failures++;
+                    break;
+                }
+                local.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+            }
+            close(fd);
+            std::lock_guard<std::mutex> lock(mutex);
+            latencies.insert(latencies.end(), local.begin(), local.end());
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK_EQ(failures.load(), 0);
+    REQUIRE_EQ(latencies.size(), size_t(CLIENT_COUNT * ROUND_TRIPS));
+    std::sort(latencies.begin(), latencies.end());
+    printf("throughput: %.1f MiB/s, %.0f round trips/s, p50 %.1fus, p99 %.1fus\n",
+           2.0 * MESSAGE_SIZE * latencies.size() / elapsed / (1024 * 1024),
+           latencies.size() / elapsed,
+           latencies[latencies.size() / 2],
+           latencies[latencies.size() * 99 / 100]);
+
+    CHECK_EQ(server.accepted(), uint64_t(SHORT_CONNECTIONS + CLIENT_COUNT));
+    for (int i = 0; i < 100 && closed_connections.load() < SHORT_CONNECTIONS + CLIENT_COUNT; i++) {
+        usleep(10000);
+    }
+    CHECK_EQ(closed_connections.load(), SHORT_CONNECTIONS + CLIENT_COUNT);
+    server.stop();
+}
+
+TEST_CASE("Dispatch++ TCP Server Large Send") {
+    auto server = DispatchTCPServer(2, true);
+    test_start_echo_server(server);
+
+    // Much more than the socket buffers hold, so the echo backs up into the write sources.
+    std::string sent(8 * 1024 * 1024, '\0');
+    for (size_t i = 0; i < sent.size(); i++) {
+        sent[i] = char(i * 31 + i / 4096);
+    }
+    int fd = test_connect(server.port());
+    std::thread writer([&] {
+        size_t offset = 0;
+        while (offset < sent.size()) {
+            auto n = write(fd, sent.data() + offset, std::min(sent.size() - offset, size_t(256 * 1024)));
+            if (n <= 0) {
+                break;
+            }
+            offset += size_t(n);
+        }
+    });
+
+    std::string received;
+    char buf[64 * 1024];
+    while (received.size() < sent.size()) {
+        auto n = read(fd, buf, sizeof(buf));
+        REQUIRE_MESSAGE(n > 0, "read");
+        received.append(buf, size_t(n));
+    }
+    writer.join();
+    close(fd);
+    CHECK_MESSAGE(received == sent, "echoed contents");
+}
@@ -113,3 +113,18 @@ dispatch_test_release_large_file(const char *path)
 #error "dispatch_test_release_large_file not implemented on this platform"
 #endif
 }
+
+std::string
+dispatch_test_read_file(const char *path)
+{
+    std::string contents;
+    int fd = open(path, O_RDONLY);
+    REQUIRE_MESSAGE(fd >= 0, "open");
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        contents.append(buf, size_t(n));
+    }
+    close(fd);
+    return contents;
+}
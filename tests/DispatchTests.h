@@ -8,6 +8,7 @@
 #pragma once
 
 #include <chrono>
+#include <string>
 #include <thread>
 #include "doctest.h"
 #include "Dispatch++/Dispatch.h"
@@ -18,3 +19,4 @@ using namespace std::this_thread;
 
 char * dispatch_test_get_large_file();
 void dispatch_test_release_large_file(const char *path);
+std::string dispatch_test_read_file(const char *path);
@@ -7,9 +7,11 @@
 
 #include "DispatchTests.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <cmath>
+#include <vector>
 #ifdef __APPLE__
 #include <mach/mach_time.h>
 #include <libkern/OSAtomic.h>
@@ -113,3 +115,64 @@ TEST_CASE("Dispatch++ Short Timer") { // <rdar://problem/7765184>
     test_short_timer();
     semaphore.wait();
 }
+
+#define PACED_COUNT 2000
+#define PACED_INTERVAL_US 250
+
+static std::vector<int64_t> strictLateness;
+static std::vector<int64_t> preciseLateness;
+
+static void test_print_jitter(const char *name, std::vector<int64_t>& lateness) {
+    std::sort(lateness.begin(), lateness.end());
+    fprintf(stderr, "%s lateness: p50 %lld ns, p99 %lld ns, max %lld ns\n", name,
+            (long long) lateness[lateness.size() / 2],
+            (long long) lateness[lateness.size() * 99 / 100],
+            (long long) lateness.back());
+}
+
+TEST_CASE("Dispatch++ Precise Timer Jitter") {
+    auto interval = DispatchTimeInterval::microseconds(PACED_INTERVAL_US);
+    __block auto done = DispatchSemaphore(0);
+
+    // Baseline: a strict timer source, each fire measured against start + n * interval.
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchPreciseTimerTests", DispatchQoS::userInteractive());
+    auto strict = DispatchSource::makeTimerSource(DispatchSource::TimerFlags::STRICT, &q);
+    __block auto strictStart = steady_clock::now() + 10ms;
+    strict->schedule(DispatchTime::now() + DispatchTimeInterval::milliseconds(10), interval);
+    strict->setEventHandler(^{
+        auto due = strictStart + microseconds(PACED_INTERVAL_US) * strictLateness.size();
+        strictLateness.push_back(duration_cast<nanoseconds>(steady_clock::now() - due).count());
+        if (strictLateness.size() == PACED_COUNT) {
+            strict->cancel();
+            done.signal();
+        }
+    });
+    strict->resume();
+    done.wait();
+
+    __block std::shared_ptr<DispatchPreciseTimer> precise;
+    precise = std::make_shared<DispatchPreciseTimer>(^{
+        preciseLateness.push_back(precise->lastLateness().rawValue);
+        if (preciseLateness.size() == PACED_COUNT) {
+            precise->cancel();
+            done.signal();
+        } else if (preciseLateness.size() == PACED_COUNT + 1) {
+            // The fire scheduled again after the cancel.
+            done.signal();
+        }
+    });
+    precise->schedule(DispatchTime::now() + DispatchTimeInterval::milliseconds(10), interval);
+    done.wait();
+
+    test_print_jitter("strict timer source", strictLateness);
+    test_print_jitter("precise timer", preciseLateness);
+    fprintf(stderr, "precise timer spun %lld us in total\n", (long long) precise->spinTime().rawValue / 1000);
+    CHECK_EQ(precise->fires(), uint64_t(PACED_COUNT));
+    CHECK_LE(preciseLateness[PACED_COUNT / 2], strictLateness[PACED_COUNT / 2]);
+
+    // Cancelling only disarms the timer: it fires again once scheduled.
+    precise->schedule(DispatchTime::now() + DispatchTimeInterval::milliseconds(1));
+    CHECK(done.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)) == DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(precise->fires(), uint64_t(PACED_COUNT + 1));
+    precise = nullptr;
+}
@@ -0,0 +1,109 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#define TIMEOUT_COUNT 250000
+
+static std::atomic<int> early {0};
+static std::atomic<int> late {0};
+static std::atomic<int> ran {0};
+static std::vector<int> order;
+
+TEST_CASE("Dispatch++ Timer Wheel Deadlines Across Levels") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchTimerWheelTests");
+    // 8 slots of 2ms on 3 levels reach 1024ms; the last timer goes past that.
+    auto wheel = std::make_shared<DispatchTimerWheel>(q, DispatchTimeInterval::milliseconds(2), 8, 3);
+    auto group = DispatchGroup();
+    auto start = steady_clock::now();
+
+    for (int delay : {300, 5, 40, 1500, 120}) {
+        group.enter();
+        wheel->schedule(DispatchTimeInterval::milliseconds(delay), ^{
+            auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start).count();
+            if (elapsed < delay) {
+                early++;
+            } else if (elapsed > delay + 100) {
+                late++;
+            }
+            order.push_back(delay);
+            group.leave();
+        });
+    }
+    CHECK_EQ(wheel->count(), 5u);
+
+    REQUIRE_EQ(group.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)), DispatchTimeoutResult::SUCCESS);
+    CHECK_EQ(early.load(), 0);
+    CHECK_EQ(late.load(), 0);
+    CHECK_EQ(order, std::vector<int> {5, 40, 120, 300, 1500});
+    CHECK_EQ(wheel->count(), 0u);
+    CHECK_EQ(wheel->fired(), 5u);
+}
+
+TEST_CASE("Dispatch++ Timer Wheel Cancel And Reschedule") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchTimerWheelTests.Cancel");
+    auto wheel = std::make_shared<DispatchTimerWheel>(q, DispatchTimeInterval::milliseconds(5));
+    __block bool rescheduledRan = false;
+
+    std::vector<DispatchTimerWheelHandle> handles;
+    for (int i = 0; i < 100; i++) {
+        handles.push_back(wheel->schedule(DispatchTimeInterval::milliseconds(50), ^{
+            ran++;
+        }));
+    }
+    for (int i = 0; i < 100; i += 2) {
+        CHECK(wheel->cancel(handles[i]));
+    }
+    CHECK_FALSE(wheel->cancel(handles[0]));
+    CHECK_EQ(wheel->count(), 50u);
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto pushed = wheel->schedule(DispatchTimeInterval::milliseconds(50), ^{
+        rescheduledRan = true;
+        semaphore.signal();
+    });
+    CHECK(wheel->reschedule(pushed, DispatchTimeInterval::milliseconds(200)));
+
+    sleep_for(150ms);
+    CHECK_EQ(ran.load(), 50);
+    CHECK_FALSE(rescheduledRan);
+    REQUIRE_EQ(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(2)), DispatchTimeoutResult::SUCCESS);
+
+    // A fired timer's handle is stale, even once its slot is reused.
+    CHECK_FALSE(wheel->cancel(pushed));
+    CHECK_FALSE(wheel->reschedule(handles[1], DispatchTimeInterval::milliseconds(10)));
+    auto reused = wheel->schedule(DispatchTimeInterval::seconds(10), ^{});
+    CHECK_FALSE(wheel->cancel(handles[0]));
+    CHECK(wheel->cancel(reused));
+}
+
+TEST_CASE("Dispatch++ Timer Wheel Many Timeouts") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchTimerWheelTests.Many");
+    auto wheel = std::make_shared<DispatchTimerWheel>(q);
+    std::vector<DispatchTimerWheelHandle> handles(TIMEOUT_COUNT);
+
+    // The usual life of a request timeout: armed, pushed back once, then cancelled.
+    auto start = steady_clock::now();
+    for (int i = 0; i < TIMEOUT_COUNT; i++) {
+        handles[i] = wheel->schedule(DispatchTimeInterval::seconds(30 + i % 60), ^{});
+    }
+    for (auto& handle : handles) {
+        wheel->reschedule(handle, DispatchTimeInterval::seconds(60));
+    }
+    CHECK_EQ(wheel->count(), size_t(TIMEOUT_COUNT));
+    for (auto& handle : handles) {
+        wheel->cancel(handle);
+    }
+    auto elapsed = duration<double>(steady_clock::now() - start).count();
+    printf("%d timeouts scheduled, rescheduled and cancelled in %.3fs\n", TIMEOUT_COUNT, elapsed);
+    CHECK_EQ(wheel->count(), 0u);
+    CHECK_EQ(wheel->fired(), 0u);
+}
@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define READ_COUNT 256
+#define READ_SIZE 4096
+
+static std::atomic<int> mismatches {0};
+
+TEST_CASE("Dispatch++ URing IO Random Reads") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchURingIOTests", DispatchQueue::Attributes::CONCURRENT);
+    char *path = dispatch_test_get_large_file();
+    auto expected = dispatch_test_read_file(path);
+    auto *contents = &expected;
+
+    int fd = open(path, O_RDONLY);
+    REQUIRE_MESSAGE(fd >= 0, "open");
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto io = DispatchURingIO(DispatchIO::StreamType::RANDOM, fd, q, ^(int error) {
+        CHECK_MESSAGE(error == 0, "cleanup error");
+        close(fd);
+        semaphore.signal();
+    });
+    printf("io_uring backed: %d\n", io.isURingBacked());
+
+    auto g = DispatchGroup();
+    for (int i = 0; i < READ_COUNT; i++) {
+        // Scatter the reads over the file, all of them outstanding at once.
+        off_t offset = off_t((size_t(i) * 7919 * READ_SIZE) % (expected.size() - READ_SIZE));
+        auto *received = new std::string();
+        g.enter();
+        io.read(offset, READ_SIZE, q, ^(bool done, const std::shared_ptr<DispatchData> data, int error) {
+            CHECK_MESSAGE(error == 0, "read error");
+            if (data) {
+                data->withUnsafeBytes(^(const void *bytes, size_t count) {
+                    received->append(static_cast<const char *>(bytes), count);
+                });
+            }
+            if (done) {
+                if (contents->compare(size_t(offset), READ_SIZE, *received) != 0) {
+                    mismatches++;
+                }
+                delete received;
+                g.leave();
+            }
+        });
+    }
+
+    auto res = g.wait(DispatchTime::now() + DispatchTimeInterval::seconds(25));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "reads timed out");
+    CHECK_EQ(mismatches.load(), 0);
+
+    io.close();
+    CHECK_MESSAGE(semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5)) == DispatchTimeoutResult::SUCCESS,
+                  "cleanup handler");
+
+    dispatch_test_release_large_file(path);
+    free(path);
+}
+
+TEST_CASE("Dispatch++ URing IO Writes And Barrier") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchURingIOTests");
+    char path[] = "/tmp/dispatch_uring.XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE_MESSAGE(fd >= 0, "mkstemp");
+
+    __block auto semaphore = DispatchSemaphore(0);
+    auto io = DispatchURingIO(DispatchIO::StreamType::RANDOM, fd, q, ^(int error) {
+        close(fd);
+        semaphore.signal();
+    });
+    // Forces the writes through several kernel operations each.
+    io.setHighWater(1000);
+
+    std::string expected;
+    for (int i = 0; i < 16; i++) {
+        std::string block(READ_SIZE, char('a' + i));
+        expected += block;
+        io.write(off_t(i) * READ_SIZE, DispatchData(block.data(), block.size()), q,
+                 ^(bool done, const std::shared_ptr<DispatchData> remaining, int error) {
+            CHECK_MESSAGE(error == 0, "write error");
+        });
+    }
+
+    __block off_t size = 0;
+    io.barrier(^{
+        struct stat st {};
+        fstat(io.fileDescriptor(), &st);
+        size = st.st_size;
+        semaphore.signal();
+    });
+    semaphore.wait();
+    CHECK_EQ(size, off_t(expected.size()));
+
+    io.close();
+    semaphore.wait();
+    CHECK_MESSAGE(dispatch_test_read_file(path) == expected, "written contents");
+    unlink(path);
+}
@@ -0,0 +1,103 @@
+//------------------------------------------------------------------------------
+// This source file is part of the Dispatch++ open source project
+//
+// Copyright (c) 2022 - 2022 Dispatch++ authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//------------------------------------------------------------------------------
+
+#include "DispatchTests.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <string>
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#define RECORD_COUNT 2000
+#define RECORD_SIZE 32
+
+static std::atomic<int> failures {0};
+
+TEST_CASE("Dispatch++ WAL Writer Group Commit") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchWALTests", DispatchQueue::Attributes::CONCURRENT);
+    char path[] = "/tmp/dispatch_wal.XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE_MESSAGE(fd >= 0, "mkstemp");
+
+    auto *wal = new DispatchWALWriter(fd, 16 * 1024, DispatchTimeInterval::milliseconds(1));
+    auto g = DispatchGroup();
+    auto start = std::chrono::steady_clock::now();
+
+    // Many writers, each waiting for its own record to be durable.
+    for (int i = 0; i < RECORD_COUNT; i++) {
+        g.enter();
+        q.async(^{
+            char record[RECORD_SIZE + 1];
+            snprintf(record, sizeof(record), "%0*d\n", RECORD_SIZE - 1, i);
+            wal->append(DispatchData(record, RECORD_SIZE), q, ^(int error) {
+                if (error != 0) {
+                    failures++;
+                }
+                g.leave();
+            });
+        });
+    }
+
+    auto res = g.wait(DispatchTime::now() + DispatchTimeInterval::seconds(25));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "commits timed out");
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%d commits in %.3fs, %llu batches\n", RECORD_COUNT, elapsed, (unsigned long long)wal->batches());
+
+    CHECK_EQ(failures.load(), 0);
+    CHECK_EQ(wal->records(), uint64_t(RECORD_COUNT));
+    CHECK_LT(wal->batches(), wal->records());
+    delete wal;
+
+    // Every record made it to the file, whole.
+    struct stat st {};
+    fstat(fd, &st);
+    CHECK_EQ(st.st_size, off_t(RECORD_COUNT * RECORD_SIZE));
+
+    std::set<int> seen;
+    lseek(fd, 0, SEEK_SET);
+    char record[RECORD_SIZE];
+    while (read(fd, record, RECORD_SIZE) == RECORD_SIZE) {
+        seen.insert(atoi(record));
+    }
+    CHECK_EQ(seen.size(), size_t(RECORD_COUNT));
+
+    close(fd);
+    unlink(path);
+}
+
+TEST_CASE("Dispatch++ WAL Writer Deadline") {
+    auto q = DispatchQueue("tech.shifor.Dispatch++.DispatchWALTests");
+    char path[] = "/tmp/dispatch_wal.XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE_MESSAGE(fd >= 0, "mkstemp");
+
+    // A lone small record is far below the batch size, so only the deadline sends it.
+    auto wal = DispatchWALWriter(fd, 1024 * 1024, DispatchTimeInterval::milliseconds(20));
+    __block auto semaphore = DispatchSemaphore(0);
+    __block int result = -1;
+    wal.append(DispatchData("commit\n", 7), q, ^(int error) {
+        result = error;
+        semaphore.signal();
+    });
+
+    auto res = semaphore.wait(DispatchTime::now() + DispatchTimeInterval::seconds(5));
+    REQUIRE_MESSAGE(res == DispatchTimeoutResult::SUCCESS, "deadline flush");
+    CHECK_EQ(result, 0);
+    CHECK_EQ(wal.batches(), uint64_t(1));
+
+    close(fd);
+    unlink(path);
+}